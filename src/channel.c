@@ -0,0 +1,104 @@
+#include <stdlib.h>
+
+#include "channel.h"
+#include "util.h"
+
+/**@name	Channels
+ *@see	channel.h
+ */
+//@{
+/**Makes an empty channel, whose ends are both open.
+ *@param	capacity	number of words the channel holds, rounded up to a power of two, CHANNEL_CAPACITY if 0
+ *@returns	false if there is no memory left for the words
+ *@see	channel_free
+ */
+bool channel_new(sivm_channel *channel, unsigned int capacity)
+{
+	uint32_t size = 1;
+	while (size < (capacity ? capacity : CHANNEL_CAPACITY) && size < (1u << 31))
+		size <<= 1;
+
+	*channel = (sivm_channel) { .mask = size - 1, .batch = (size / 4 < CHANNEL_BATCH ? (size / 4 ? size / 4 : 1) : CHANNEL_BATCH) };
+	if (! (channel->words = malloc(size * sizeof(REG)))) {
+		logm(LOG_ERROR, "Not enough memory for a channel of %u words", size);
+		return false;
+	}
+	return true;
+}
+
+/**Frees the words of the given channel, which no SIVM must use anymore.*/
+void channel_free(sivm_channel *channel)
+{
+	free(channel->words);
+	channel->words = NULL;
+}
+
+/**Publishes the count of the given end of a channel to the other end, waking up the thread of the other end if it sleeps.
+ *Ends are flushed this way every batch of words, and should be by their thread whenever it stops running them.
+ */
+void channel_publish(channel_end *end, channel_end *other)
+{
+	__atomic_store_n(&end->shared, end->count, __ATOMIC_RELEASE);
+	if (other->waiter)
+		channel_wake(other->waiter);
+}
+
+/**Ends the given end of a channel, after publishing its count.
+ *The other end may still read the words left once the producer is over, and stops writing once the consumer is.
+ */
+void channel_close(channel_end *end, channel_end *other)
+{
+	__atomic_store_n(&end->shared, end->count, __ATOMIC_RELEASE);
+	__atomic_store_n(&end->closed, true, __ATOMIC_RELEASE);
+	if (other->waiter)
+		channel_wake(other->waiter);
+}
+
+/**Makes a waiter, for a thread that isn't sleeping.
+ *@see	channel_waiter_free
+ */
+void channel_waiter_new(channel_waiter *waiter)
+{
+	pthread_mutex_init(&waiter->lock, NULL);
+	pthread_cond_init(&waiter->cond, NULL);
+	waiter->sleeping = 0;
+}
+
+void channel_waiter_free(channel_waiter *waiter)
+{
+	pthread_mutex_destroy(&waiter->lock);
+	pthread_cond_destroy(&waiter->cond);
+}
+
+/**Wakes up the thread of the given waiter if it sleeps, or keeps it from going to sleep if it's about to.
+ *The fence orders what the caller published before it with the check of sleeping, as channel_sleep orders the setting of sleeping with the checks of the sleeper: either the waker sees the sleeper, or the sleeper sees what was published, so that no wake up is lost.
+ */
+void channel_wake(channel_waiter *waiter)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (! __atomic_load_n(&waiter->sleeping, __ATOMIC_RELAXED))
+		return;
+	pthread_mutex_lock(&waiter->lock);
+	__atomic_store_n(&waiter->sleeping, 0, __ATOMIC_RELAXED);
+	pthread_cond_signal(&waiter->cond);
+	pthread_mutex_unlock(&waiter->lock);
+}
+
+/**Marks the thread of the given waiter as about to sleep: the thread has to check all of its channels again, then either call channel_sleep or clear sleeping if one of them changed.
+ *@see	channel_wake
+ */
+void channel_prepare_sleep(channel_waiter *waiter)
+{
+	__atomic_store_n(&waiter->sleeping, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/**Puts the calling thread to sleep until the other end of one of its channels publishes its count or closes, once channel_prepare_sleep was called.*/
+void channel_sleep(channel_waiter *waiter)
+{
+	pthread_mutex_lock(&waiter->lock);
+	while (__atomic_load_n(&waiter->sleeping, __ATOMIC_RELAXED))
+		pthread_cond_wait(&waiter->cond, &waiter->lock);
+	pthread_mutex_unlock(&waiter->lock);
+}
+//@}
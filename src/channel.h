@@ -0,0 +1,121 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "sivm.h"
+#include "instructions.h"
+
+/**@name	Channels
+ *Channels carry words from an SIVM, their producer, to another one, their consumer, which may run on another thread: SEND writes to the output channel of an SIVM, RECV reads from its input channel (see sivm.h#sivm).
+ *A channel is a lock-free ring of words, with a single producer and a single consumer. Each end counts the words it wrote or read, and only publishes its count to the other end every batch of words or when it's flushed, so that the cache line of the count goes from one processor to the other once per batch instead of once per word ; each end also keeps the count of the other end it last read, and only reads it again when the ring looks full or empty.
+ *SEND on a full channel and RECV on an empty one aren't executed: sivm_run returns SIVM_BLOCKED with PC left on them, for the caller to run something else until the channel changes (see pipeline.h).
+ *Once the producer ended and the consumer read all of its words, RECV leaves its register as it is and sets the carry flag ; once the consumer ended, words sent are dropped.
+ *@see	channel.c
+ */
+//@{
+/**Number of words of a channel when none is given.*/
+#define CHANNEL_CAPACITY 1024
+/**Number of words an end writes or reads before publishing its count, at most a quarter of the capacity of its channel.*/
+#define CHANNEL_BATCH 64
+
+/**Thread sleeping until one of the channel ends it runs changes.
+ *@see	channel.c#channel_prepare_sleep
+ */
+typedef struct
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int sleeping;			/*!< whether the thread sleeps or is about to, cleared by channel_wake */
+} channel_waiter;
+
+/**End of a channel, alone on its cache line.*/
+typedef struct
+{
+	uint32_t count;			/*!< number of words written or read by this end */
+	uint32_t seen;			/*!< count of the other end, as last read */
+	uint32_t shared;		/*!< count published to the other end */
+	bool closed;			/*!< whether this end is over, see channel_close */
+	channel_waiter *waiter;	/*!< thread running this end, woken up when the other end publishes its count or closes, NULL if it never sleeps */
+} __attribute__((aligned(64))) channel_end;
+
+/**Channel.*/
+typedef struct sivm_channel
+{
+	REG *words;				/*!< ring of words */
+	uint32_t mask;			/*!< number of words of the ring minus one, the number of words being a power of two */
+	uint32_t batch;			/*!< number of words an end writes or reads before publishing its count */
+	channel_end producer;
+	channel_end consumer;
+} sivm_channel;
+
+bool channel_new(sivm_channel *channel, unsigned int capacity);
+void channel_free(sivm_channel *channel);
+void channel_publish(channel_end *end, channel_end *other);
+void channel_close(channel_end *end, channel_end *other);
+
+void channel_waiter_new(channel_waiter *waiter);
+void channel_waiter_free(channel_waiter *waiter);
+void channel_wake(channel_waiter *waiter);
+void channel_prepare_sleep(channel_waiter *waiter);
+void channel_sleep(channel_waiter *waiter);
+
+/**Tells whether the given end of a channel is over.*/
+static inline bool channel_closed(channel_end *end)
+{
+	return __atomic_load_n(&end->closed, __ATOMIC_ACQUIRE);
+}
+
+/**Tells whether there is a word to read from the given channel, reading the count of the producer again if needed.*/
+static inline bool channel_can_recv(sivm_channel *channel)
+{
+	channel_end *end = &channel->consumer;
+	if (end->count == end->seen)
+		end->seen = __atomic_load_n(&channel->producer.shared, __ATOMIC_ACQUIRE);
+	return end->count != end->seen;
+}
+
+/**Tells whether there is room to write a word to the given channel, reading the count of the consumer again if needed.*/
+static inline bool channel_can_send(sivm_channel *channel)
+{
+	channel_end *end = &channel->producer;
+	if (end->count - end->seen > channel->mask)
+		end->seen = __atomic_load_n(&channel->consumer.shared, __ATOMIC_ACQUIRE);
+	return end->count - end->seen <= channel->mask;
+}
+
+/**Reads a word from the given channel, which channel_can_recv must have found.*/
+static inline REG channel_recv(sivm_channel *channel)
+{
+	channel_end *end = &channel->consumer;
+	REG word = channel->words[end->count++ & channel->mask];
+	if (end->count - end->shared >= channel->batch)
+		channel_publish(end, &channel->producer);
+	return word;
+}
+
+/**Writes a word to the given channel, in which channel_can_send must have found room.*/
+static inline void channel_send(sivm_channel *channel, REG word)
+{
+	channel_end *end = &channel->producer;
+	channel->words[end->count++ & channel->mask] = word;
+	if (end->count - end->shared >= channel->batch)
+		channel_publish(end, &channel->consumer);
+}
+
+/**Tells whether the instruction of the given code would block the given SIVM: a SEND on a full channel, or a RECV on an empty one whose producer isn't over.
+ *@see	engine.h#SIVM_BLOCKED
+ */
+static inline bool channel_waits(SIVM *sivm, unsigned int codeop)
+{
+	if (codeop == RECV)
+		return sivm->input && ! channel_can_recv(sivm->input) && ! channel_closed(&sivm->input->producer);
+	if (codeop == SEND)
+		return sivm->output && ! channel_closed(&sivm->output->consumer) && ! channel_can_send(sivm->output);
+	return false;
+}
+//@}
+
+#endif /*CHANNEL_H*/
@@ -14,40 +14,14 @@
 bool getModes(cmd_word *w, mode *destMode, mode *sourceMode)
 {
 	switch (w->codage.mode) {
-		case REGREG:
-			*destMode = REGISTER;
-			*sourceMode = REGISTER;
-			break;
-		case REGIMM:
-			*destMode = REGISTER;
-			*sourceMode = IMMEDIATE;
-			break;
-		case REGDIR:
-			*destMode = REGISTER;
-			*sourceMode = DIRECT;
-			break;
-		case REGIND:
-			*destMode = REGISTER;
-			*sourceMode = INDIRECT;
-			break;
-		case DIRIMM:
-			*destMode = DIRECT;
-			*sourceMode = IMMEDIATE;
-			break;
-		case DIRREG:
-			*destMode = DIRECT;
-			*sourceMode = REGISTER;
-			break;
-		case INDIMM:
-			*destMode = INDIRECT;
-			*sourceMode = IMMEDIATE;
-			break;
-		case INDREG:
-			*destMode = INDIRECT;
-			*sourceMode = REGISTER;
+#define MODE_CASE(name, value, destination, source, a, b) \
+		case name: \
+			*destMode = destination; \
+			*sourceMode = source; \
 			break;
+		ADRESSING_MODES(MODE_CASE, , )
+#undef MODE_CASE
 		default:
-			logm(LOG_FATAL_ERROR, "Invalid adressing mode");
 			return false;
 	}
 	return true;
@@ -109,11 +83,14 @@ char* appendParameter(char *string, const cmd_word w, mode m, int paramType)
 			break;
 	}
 	
-	char buffer2[sizeof(buffer)];
-	strcpy(buffer2, buffer);
-	sprintf(buffer, "%s%s%s%s", (paramType == CMD_WORD_SOURCE_INDEX ? "\t" : ""), color, buffer2, (ANSI_OUTPUT ? "\e[0m" : ""));
+	if (paramType == CMD_WORD_SOURCE_INDEX)
+		strcat(string, "\t");
+	strcat(string, color);
+	strcat(string, buffer);
+	if (ANSI_OUTPUT)
+		strcat(string, "\e[0m");
 
-	return strcat(string, buffer);
+	return string;
 }
 
 /**Increment the disassembler pointer securely.
@@ -187,7 +164,18 @@ int disassemble_single_instruction(char *buffer, const cmd_word words[])
 	mode sourceMode, destMode;
 	getModes(&currentWord, &destMode, &sourceMode);
 	
-	if (instruction.source || instruction.destination)
+	if (PACKED_INSTRUCTION(currentWord.codage.codeop) && currentWord.codage.mode == REGIMM)
+	{
+		cmd_word registers = currentWord;
+		
+		appendParameter(buffer, currentWord, REGISTER, CMD_WORD_DEST_INDEX);
+		read++;
+		registers.codage.source = BLOCK_SOURCE(words[read].brut);
+		appendParameter(buffer, registers, REGISTER, CMD_WORD_SOURCE_INDEX);
+		registers.codage.source = BLOCK_COUNT(words[read].brut);
+		appendParameter(buffer, registers, REGISTER, CMD_WORD_SOURCE_INDEX);
+	}
+	else if (instruction.source || instruction.destination)
 	{
 		switch (currentWord.codage.mode) {
 				//whole command is 3 words long
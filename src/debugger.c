@@ -8,6 +8,9 @@
 
 #include "debugger.h"
 #include "breakpoint.h"
+#include "engine.h"
+#include "fusion.h"
+#include "jit.h"
 #include "instructions.h"
 #include "util.h"
 #include "cmd_word.h"
@@ -31,9 +34,13 @@ typedef enum
 {
     RUN = 0,
     STEP,
+    UNTIL,
+    FINISH,
 	PROGRAM,
 	INFO,
 	INSTR,
+	FUSIONS,
+	FRAMES,
     RESTART,
     DISPLAY,
     BREAKPOINT,
@@ -42,7 +49,7 @@ typedef enum
     UNKNOWN
 } type_command;
 
-#define NB_COMMANDS 10 /*!< number of commands */
+#define NB_COMMANDS 14 /*!< number of commands */
 
 /**
  * @brief Array of available commands
@@ -50,10 +57,14 @@ typedef enum
  */
 const Command commands[NB_COMMANDS] = {
     [RUN]        = { "run", "run the program all at once" },
-    [STEP]       = { "step", "execute one instruction in the program" },
+    [STEP]       = { "step", "execute one instruction in the program, or N instructions at once\n\tUsage: step [N]" },
+    [UNTIL]      = { "until", "run the program until PC reaches the given index or label\n\tUsage: until (PC_INDEX|LABEL)" },
+    [FINISH]     = { "finish", "run the program until the current CALL returns" },
     [PROGRAM]    = { "program", "display the disassembled program currently loaded in the VM" },
     [INFO]       = { "info", "display specifications of the current VM" },
     [INSTR]      = { "instr", "display current instruction for the VM (the next to be executed in step-by-step mode)" },
+    [FUSIONS]    = { "fusions", "display the superinstructions found in the program, and how many times each was executed" },
+    [FRAMES]     = { "frames", "display the frames of the CALLs not returned from yet, with the registers saved by each one (only with --frames)" },
     [RESTART]    = { "reload", "reload the program (updates from the file)" },
     [DISPLAY]    = { "display", "display a register or memory unit value, or the whole VM status\n\tUsage: display [(reg number|PC|SP|SR) | (mem number)]" },
     [BREAKPOINT] = { "breakpoint", "add or remove a breakpoint\n\tUsage: breakpoint (add|rm) PC_INDEX\n\tYou'll notice that the index is the PC, not a line number (in order to have consistency between source and disassembled files).\n\tPlease refer to the PCs given by the \"program\" command." },
@@ -85,6 +96,18 @@ void display_help()
         printf((ANSI_OUTPUT ? "  \e[33m%s\e[0m:\n\t%s\n" : "  %s:\n\t%s\n"), commands[i].name, commands[i].help);
 }
 
+/**
+ * @brief Fault handler of the debugger's VM, letting the user fix the faulty value with SuperRecover
+ * @see   sivm_fault_handler
+ * @returns true if the user gave another value
+ */
+bool debugger_recover(SIVM *sivm, REG *value, void *data)
+{
+    if (!value)
+        return false;
+    return superRecover(value, "%s", sivm->fault_message);
+}
+
 void debugger_new(Debugger *debug, char *filename, bool isSource)
 {
     debug->filename = (char*)malloc(strlen(filename)+1);
@@ -107,7 +130,10 @@ void debugger_new(Debugger *debug, char *filename, bool isSource)
         logm(LOG_STEP, "Loading successful");
     }
 
-    sivm_new(&debug->sivm);
+    if (!sivm_new(&debug->sivm, &debug->config))
+        logm(LOG_FATAL_ERROR, "Unable to initialize the VM");
+    logm(LOG_STEP, "VM successfully initialized.");
+    sivm_set_fault_policy(&debug->sivm, SIVM_CALLBACK, debugger_recover, NULL);
 
 /*	//A program loaded in memory has this form:
  
@@ -125,8 +151,67 @@ void debugger_new(Debugger *debug, char *filename, bool isSource)
     };
     int memsize = sizeof(prg) / sizeof(cmd_word);
 */	
+    if (!sivm_load(&debug->sivm, debug->presult.memsize, debug->presult.mem))
+        logm(LOG_FATAL_ERROR, "Program is too big (%d words, memsize being %u)", (int) debug->presult.memsize, debug->sivm.memsize);
     logm(LOG_STEP, "Program loaded");
-    sivm_load(&debug->sivm, debug->presult.memsize, debug->presult.mem);
+
+    if (debug->jit && !jit_enable(&debug->sivm))
+        debug->jit = false;
+}
+
+/**
+ * @brief Mirror a list of breakpoints into the VM, so that sivm_run stops on them
+ * @param debug pointer to debugger structure
+ * @param list  pointer to a breakpoint_list
+ */
+void debugger_sync_breakpoints(Debugger *debug, breakpoints_list *list)
+{
+    for (unsigned int i = 0; i < debug->sivm.memsize; ++i)
+        sivm_set_breakpoint(&debug->sivm, i, false);
+    for (breakpoint *b = list->head; b != 0; b = b->next)
+        sivm_set_breakpoint(&debug->sivm, b->line, true);
+}
+
+/**
+ * @brief Show the user the instruction at PC
+ * @param debug pointer to debugger structure
+ */
+static void debugger_print_instruction(Debugger *debug)
+{
+    char *instruction = sivm_get_instruction_string(&debug->sivm);
+    logm(LOG_INFO, "%s", instruction);
+    free(instruction);
+}
+
+/**
+ * @brief Tell the user why the VM stopped running
+ * @param debug pointer to debugger structure
+ * @param stop  reason returned by sivm_run
+ * @returns true if the end of the program was reached
+ */
+bool debugger_report_stop(Debugger *debug, sivm_stop stop)
+{
+    switch (stop)
+    {
+        case SIVM_BREAKPOINT:
+        case SIVM_RETURN:
+        case SIVM_BUDGET:
+        case SIVM_BLOCKED:
+            logm(LOG_INFO, "Stopped at PC %d", debug->sivm.pc);
+            debugger_print_instruction(debug);
+            return false;
+        case SIVM_HALT:
+            debugger_print_instruction(debug);
+            logm(LOG_STEP, "End of program reached");
+            return true;
+        case SIVM_FAULT:
+        default:
+            logm(LOG_ERROR, "%s", debug->sivm.fault_message);
+            logm(LOG_ERROR, "Execution stopped on an invalid instruction");
+            if (log_ring_level >= 0)
+                log_ring_dump();
+            return true;
+    }
 }
 
 void debugger_start(Debugger *debug)
@@ -138,6 +223,8 @@ void debugger_start(Debugger *debug)
     bool step_by_step = true;
     bool execute = false;
     bool finish = false;
+    uint64_t budget = SIVM_NO_BUDGET;
+    int until = -1;
     do
     {
         char *line = readline ("> ");
@@ -151,15 +238,60 @@ void debugger_start(Debugger *debug)
         switch (find_command(cmd))
         {
             case STEP:
-                execute = true;
-                step_by_step = true;
+                {
+                    char *num = strtok(0, " ");
+                    execute = true;
+                    budget = (num ? strtoull(num, NULL, 10) : 1);
+                    step_by_step = (budget == 1);
+                    if (!budget)
+                    {
+                        printf("Usage: %s\n", commands[STEP].help);
+                        execute = false;
+                    }
+                }
 				break;
             case RUN:
                 execute = true;
                 step_by_step = false;
+                budget = SIVM_NO_BUDGET;
+				break;
+            case UNTIL:
+                {
+                    char *target = strtok(0, " ");
+                    REG pc;
+                    execute = false;
+                    if (!target)
+                        printf("Usage: %s\n", commands[UNTIL].help);
+                    else if (isdigit(target[0]))
+                        until = atoi(target);
+                    else if (lbllist_get(debug->presult.labels_head, target, strlen(target) + 1, &pc))
+                        until = pc;
+                    else
+                        printf("Unknown label `%s'\n", target);
+
+                    if (until >= 0)
+                    {
+                        execute = true;
+                        step_by_step = false;
+                        budget = SIVM_NO_BUDGET;
+                        sivm_set_breakpoint(&debug->sivm, until, true);
+                    }
+                }
+				break;
+            case FINISH:
+                execute = false;
+                if (!debug->sivm.depth)
+                    printf("Not inside a CALL\n");
+                else
+                {
+                    execute = true;
+                    step_by_step = false;
+                    budget = SIVM_NO_BUDGET;
+                    debug->sivm.stop_depth = debug->sivm.depth - 1;
+                }
 				break;
 			case INSTR:
-				logm(LOG_INFO, sivm_get_instruction_string(&debug->sivm));
+				debugger_print_instruction(debug);
                 step_by_step = false;
                 execute = false;
 				break;
@@ -168,11 +300,21 @@ void debugger_start(Debugger *debug)
                 execute = false;
                 break;
             case RESTART:
+                sivm_free(&debug->sivm);
                 debugger_new(debug, debug->filename, debug->is_source);
+                debugger_sync_breakpoints(debug, &breakpoints);
                 end_found = false;
                 step_by_step = true;
                 execute = false;
                 break;
+			case FUSIONS:
+				fusion_report(&debug->sivm);
+                execute = false;
+				break;
+			case FRAMES:
+				sivm_print_frames(&debug->sivm);
+                execute = false;
+				break;
 			case PROGRAM:
 				printf(disassemble(debug->presult.memsize, debug->presult.mem));
 				printf("(Total size: %d words)\n", (int) debug->presult.memsize);
@@ -181,16 +323,30 @@ void debugger_start(Debugger *debug)
 				break;
 			case INFO:
 				if (ANSI_OUTPUT) {
-					printf("\e[36mMemory size:\e[0m\n\t%d\n", MEMSIZE);
+					printf("\e[36mMemory size:\e[0m\n\t%u%s\n", debug->sivm.memsize, (debug->sivm.outside ? " (power of two, bounds checked by masking)" : ""));
 					printf("\e[36mNumber of registers:\e[0m\n\t%d\n", NREGS);
 					printf("\e[36mParameter registers (not updated on CALL and RET):\e[0m\n\tR%d-R%d\n", PARAM_REGS_START, PARAM_REGS_END);
-					printf("\e[36mStack is going through\e[0m %s adresses\n", (SP_INCR > 0 ? "ascending" : "descending"));
+					printf("\e[36mStack starts at\e[0m %u\n", debug->config.sp_start);
+					printf("\e[36mStack is going through\e[0m %s adresses\n", (debug->sivm.sp_incr > 0 ? "ascending" : "descending"));
+					if (debug->sivm.nbanks)
+						printf("\e[36mBanks:\e[0m\n\t%u of %u words at adress %u, bank %u selected\n", debug->sivm.nbanks, debug->sivm.bank_size, debug->sivm.memsize, debug->sivm.bank);
 				} else {
-					printf("Memory size:\n\t%d\n", MEMSIZE);
+					printf("Memory size:\n\t%u%s\n", debug->sivm.memsize, (debug->sivm.outside ? " (power of two, bounds checked by masking)" : ""));
 					printf("Number of registers:\n\t%d\n", NREGS);
 					printf("Parameter registers (not updated on CALL and RET):\n\tR%d-R%d\n", PARAM_REGS_START, PARAM_REGS_END);
-					printf("Stack is going through %s adresses\n", (SP_INCR > 0 ? "ascending" : "descending"));
+					printf("Stack starts at %u\n", debug->config.sp_start);
+					printf("Stack is going through %s adresses\n", (debug->sivm.sp_incr > 0 ? "ascending" : "descending"));
+					if (debug->sivm.nbanks)
+						printf("Banks:\n\t%u of %u words at adress %u, bank %u selected\n", debug->sivm.nbanks, debug->sivm.bank_size, debug->sivm.memsize, debug->sivm.bank);
 				}
+				if (debug->sivm.frames)
+					printf((ANSI_OUTPUT ? "\e[36mFrame stack:\e[0m\n\t%u frame(s), at most %u\n" : "Frame stack:\n\t%u frame(s), at most %u\n"), debug->sivm.nframes, debug->sivm.max_frames);
+				if (debug->sivm.jit)
+					printf((ANSI_OUTPUT ? "\e[36mJIT:\e[0m\n\t%llu blocks compiled, %llu native executions\n" : "JIT:\n\t%llu blocks compiled, %llu native executions\n"),
+						(unsigned long long) debug->sivm.jit->compiled, (unsigned long long) debug->sivm.jit->executed);
+				else
+					printf((ANSI_OUTPUT ? "\e[36mJIT:\e[0m\n\tdisabled\n" : "JIT:\n\tdisabled\n"));
+				printf((ANSI_OUTPUT ? "\e[36mProgram verified at load time:\e[0m\n\t%s\n" : "Program verified at load time:\n\t%s\n"), (debug->sivm.verified ? "yes" : "no"));
             case DISPLAY:
                 {
                     execute = false;
@@ -210,7 +366,7 @@ void debugger_start(Debugger *debug)
 					if (! strcmp(type, "mem"))
 					{
 						if (! sivm_print_memory(&debug->sivm, atoi(num)))
-							logm(LOG_WARNING, "Unreachable value. Size of memory for this VM is %d.", MEMSIZE);
+							logm(LOG_WARNING, "Unreachable value. Size of memory for this VM is %u.", debug->sivm.memsize);
 					}
 					else if (! strcmp(type, "reg"))
 					{
@@ -257,6 +413,7 @@ void debugger_start(Debugger *debug)
                             printf("breakpoint already exists\n");
                         else
                             printf("added breakpoint at line %d\n", nb);
+                        debugger_sync_breakpoints(debug, &breakpoints);
                     }
                     else if (!strcmp(type, "rm"))
                     {
@@ -271,6 +428,7 @@ void debugger_start(Debugger *debug)
                             printf("no breakpoint\n");
                         else
                             printf("remove breakpoint n°%d\n", nb);
+                        debugger_sync_breakpoints(debug, &breakpoints);
                     }
                     else
                         printf("Usage: %s\n", commands[BREAKPOINT].help);
@@ -285,18 +443,30 @@ void debugger_start(Debugger *debug)
         }
         add_history(line);
 
-        while (execute)
+        if (execute)
         {
             if (end_found)
-            {
                 logm(LOG_STEP, "End of program reached");
-                break;
+            else if (step_by_step)
+            {
+                debugger_print_instruction(debug);
+                end_found = !sivm_step(&debug->sivm);
+                if (debug->sivm.fault)
+                {
+                    logm(LOG_ERROR, "%s", debug->sivm.fault_message);
+                    if (log_ring_level >= 0)
+                        log_ring_dump();
+                }
             }
+            else
+                end_found = debugger_report_stop(debug, sivm_run(&debug->sivm, budget));
 
-			logm(LOG_INFO, sivm_get_instruction_string(&debug->sivm));
-            end_found = !sivm_step(&debug->sivm);
-
-            if (step_by_step || breakpoint_list_has(&breakpoints, debug->sivm.pc)) break;
+            if (until >= 0)
+            {
+                debugger_sync_breakpoints(debug, &breakpoints);
+                until = -1;
+            }
+            debug->sivm.stop_depth = -1;
         }
     }
     while (!finish);
@@ -16,6 +16,8 @@ typedef struct
     char *filename;         /*!< filename of the binary program */
     ParserResult presult;   /*!< parsing result */
     bool is_source;         /*!< filename is a source or a binary file */
+    bool jit;               /*!< compile hot code to native code, has to be set before debugger_new */
+    sivm_config config;     /*!< memory geometry of the virtual machine, has to be set before debugger_new */
 } Debugger;
 
 /**
@@ -0,0 +1,95 @@
+#include "engine.h"
+#include "instructions.h"
+#include "fusion.h"
+#include "jit.h"
+#include "flags.h"
+#include "hooks.h"
+#include "channel.h"
+
+/**@name	Threaded execution engine
+ *sivm_run executes predecoded instructions straight from the SIVM's cache, jumping from one instruction body to the next through a table of label adresses (GCC's "labels as values").
+ *PC, SP, SR and the lazy flags state are kept in locals, and only written back to the SIVM when leaving the engine.
+ *Blocks entered often enough are compiled to native code when the SIVM has a JIT (see jit.h), and executed by op_native.
+ *Anything out of the ordinary (instruction that isn't predecoded, out of bounds access, infinite loop...) is handed to sivm_step, so that all checks and diagnostics stay the same.
+ *The loop is built twice from engine.def: SIVMs with hooks run the build reporting their events, the others the one without any trace of them.
+ */
+//@{
+
+/**Tells whether CALL saves the given register, and RET restores it.
+ *@see	instructions.c#instr_call
+ */
+#define SAVED_REG(i) ((i) < PARAM_REGS_START || (i) > PARAM_REGS_END)
+
+/**Number of registers saved on the stack by a CALL.*/
+static int saved_registers_count()
+{
+	int count = 0;
+	for (int i = 0; i < NREGS; i++)
+		if (SAVED_REG(i))
+			count++;
+	return count;
+}
+
+/**Reads the source operand of a predecoded instruction that doesn't need any run-time check.
+ *@see	fusion.c#static_source
+ */
+static inline REG static_source_value(SIVM *sivm, decoded *d)
+{
+	switch (d->srcMode) {
+		case REGISTER:	return sivm->reg[d->source];
+		case IMMEDIATE:	return d->srcWord;
+		default:		return sivm->mem[d->srcWord].brut;
+	}
+}
+
+/**Tells whether the given number of words can be pushed from the given stack pointer without any invalid access.
+ *@see	instructions.c#instr_push
+ */
+static inline bool stack_can_push(SIVM *sivm, REG sp, int count)
+{
+	for (int i = 0; i <= count; i++, sp += sivm->sp_incr)
+		if (! sivm_in_memory(sivm, sp))
+			return false;
+	return true;
+}
+
+/**Tells whether the given number of words can be popped from the given stack pointer without any invalid access.
+ *@see	instructions.c#instr_pop
+ */
+static inline bool stack_can_pop(SIVM *sivm, REG sp, int count)
+{
+	for (int i = 0; i < count; i++)
+		if (! sivm_in_memory(sivm, sp -= sivm->sp_incr))
+			return false;
+	return true;
+}
+
+/**Build of the engine for SIVMs without hooks.*/
+#define ENGINE_RUN		run
+#define ENGINE_HOOKS	0
+#include "engine.def"
+#undef ENGINE_RUN
+#undef ENGINE_HOOKS
+
+/**Build of the engine reporting execution events to the hooks.*/
+#define ENGINE_RUN		run_hooked
+#define ENGINE_HOOKS	1
+#include "engine.def"
+#undef ENGINE_RUN
+#undef ENGINE_HOOKS
+
+/**Chooses the build of the engine, so that SIVMs without hooks don't pay anything for them.
+ *Events are delivered before returning.
+ */
+sivm_stop sivm_run(SIVM *sivm, uint64_t budget)
+{
+	if (! sivm->hooks)
+		return run(sivm, budget);
+	
+	sivm->hooks->running = true;
+	sivm_stop stop = run_hooked(sivm, budget);
+	sivm->hooks->running = false;
+	sivm_flush_events(sivm);
+	return stop;
+}
+//@}
@@ -0,0 +1,30 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdint.h>
+
+#include "sivm.h"
+
+/**Budget to give to sivm_run for it to stop only on HALT, faults or breakpoints.*/
+#define SIVM_NO_BUDGET UINT64_MAX
+
+/**Reasons for sivm_run to give control back.*/
+typedef enum
+{
+	SIVM_HALT,			/*!< a HALT instruction was reached, PC is left on it */
+	SIVM_FAULT,			/*!< an instruction could not be executed */
+	SIVM_BUDGET,		/*!< the given number of instructions was executed */
+	SIVM_BREAKPOINT,	/*!< PC reached an instruction with a breakpoint */
+	SIVM_RETURN,		/*!< a RET brought the call depth back to the SIVM's stop_depth */
+	SIVM_BLOCKED		/*!< a SEND or RECV would wait on its channel, PC is left on it (see channel.h) */
+} sivm_stop;
+
+/**Runs the given SIVM until it halts, faults, reaches a breakpoint, returns to its stop_depth, blocks on a channel or executes budget instructions.
+ *@param	sivm	the VM to run
+ *@param	budget	maximum number of instructions to execute, SIVM_NO_BUDGET for no limit
+ *@returns	the reason why the VM stopped
+ *@see	sivm_set_breakpoint
+ */
+sivm_stop sivm_run(SIVM *sivm, uint64_t budget);
+
+#endif /*ENGINE_H*/
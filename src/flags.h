@@ -0,0 +1,89 @@
+#ifndef FLAGS_H
+#define FLAGS_H
+
+#include <stdbool.h>
+
+#include "sivm.h"
+#include "instructions.h"
+
+/**@name	Condition flags
+ *Flags are computed lazily: flag-setting instructions (MOV, ADD, SUB, CMP, AND, OR, SHL, SHR, MUL, DIV, MOD) only keep their result in SR, along with their source operand and kind.
+ *The flags are materialised from these three values only when a conditional jump or the debugger reads them.
+ *These helpers are inlined in the execution engine, hence their definition in this header.
+ *@see	sivm.h#sivm
+ *@see	instructions.def#CONDITIONAL_JUMPS
+ */
+//@{
+#define FLAG_Z 0x1	/*!< zero: the result is 0 */
+#define FLAG_N 0x2	/*!< negative: the result's most significant bit is set */
+#define FLAG_C 0x4	/*!< carry out of an ADD, or borrow of a SUB */
+#define FLAG_V 0x8	/*!< signed overflow of an ADD or a SUB */
+
+/**Kinds of flag-setting instructions, telling how C and V are computed.*/
+typedef enum
+{
+	FLAGS_LOGIC = 0,	/*!< MOV, AND, OR, SHL, SHR, MUL, DIV, MOD: C and V are cleared */
+	FLAGS_ADD,
+	FLAGS_SUB			/*!< SUB and CMP */
+} flags_op;
+
+/**Materialises the flags of a flag-setting instruction.
+ *The destination's value before the instruction is computed back from the result and the source operand.
+ *@param	result	the instruction's result, as kept in SR
+ *@param	operand	the instruction's source operand
+ *@param	op		the kind of the instruction, see flags_op
+ *@returns	the flags, as a combination of FLAG_Z, FLAG_N, FLAG_C and FLAG_V
+ */
+static inline REG flags_compute(REG result, REG operand, uint8_t op)
+{
+	REG flags = (result ? 0 : FLAG_Z) | (result & 0x8000 ? FLAG_N : 0);
+	REG before;
+	
+	switch (op) {
+		case FLAGS_ADD:
+			before = result - operand;
+			if (result < before)
+				flags |= FLAG_C;
+			if ((before ^ result) & (operand ^ result) & 0x8000)
+				flags |= FLAG_V;
+			break;
+		case FLAGS_SUB:
+			before = result + operand;
+			if (before < operand)
+				flags |= FLAG_C;
+			if ((before ^ operand) & (before ^ result) & 0x8000)
+				flags |= FLAG_V;
+			break;
+	}
+	return flags;
+}
+
+/**Tells whether the given opcode is a conditional jump.*/
+static inline bool flags_conditional(unsigned codeop)
+{
+	switch (codeop) {
+#define CONDITIONAL_CASE(name, condition) case name:
+		CONDITIONAL_JUMPS(CONDITIONAL_CASE)
+#undef CONDITIONAL_CASE
+			return true;
+		default:
+			return false;
+	}
+}
+
+/**Tells whether the conditional jump with the given opcode is taken with the given flags.
+ *@returns	false if the opcode isn't a conditional jump
+ */
+static inline bool flags_condition(unsigned codeop, REG flags)
+{
+	switch (codeop) {
+#define CONDITION_CASE(name, condition) case name: return condition;
+		CONDITIONAL_JUMPS(CONDITION_CASE)
+#undef CONDITION_CASE
+		default:
+			return false;
+	}
+}
+//@}
+
+#endif /*FLAGS_H*/
@@ -0,0 +1,614 @@
+#define _DEFAULT_SOURCE	/*clock_gettime, sched_yield, _SC_NPROCESSORS_ONLN*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "fleet.h"
+#include "engine.h"
+#include "lockstep.h"
+#include "scheduler.h"
+#include "util.h"
+
+/**@name	Jobs files
+ *@see	fleet.h
+ */
+//@{
+/**Parses a word given in a jobs file, from -32768 to 65535.
+ *@returns	false if the text isn't such a number
+ */
+static bool parse_word(const char *text, REG *value)
+{
+	char *end;
+	long number = strtol(text, &end, 0);
+	*value = (REG) number;
+	return text[0] != '\0' && *end == '\0' && number >= -32768 && number <= 65535;
+}
+
+/**Makes the image of the given program of the given fleet, for its jobs to map it rather than loading it (see image.h).
+ *Programs have no image when SIVMs of the fleet are too small for it to pay off, or when it can't be made.
+ */
+static void make_image(sivm_fleet *fleet, unsigned int program)
+{
+	SIVM model;
+	fleet->images[program] = (sivm_image) { .fd = -1 };
+	if (! IMAGE_PAYS(fleet->config.memsize) || ! sivm_new(&model, &fleet->config))
+		return;
+	sivm_load(&model, fleet->programs[program].memsize, fleet->programs[program].mem);
+	image_new(&fleet->images[program], &model);
+	sivm_free(&model);
+}
+
+/**Finds the program of the given source file in the given fleet, assembling it if it isn't there yet.
+ *@returns	the index of the program, or -1 if it couldn't be assembled or doesn't fit in memory
+ */
+static long find_program(sivm_fleet *fleet, char *path)
+{
+	for (unsigned int i = 0; i < fleet->nprograms; i++)
+		if (! strcmp(fleet->paths[i], path))
+			return i;
+
+	char **paths = realloc(fleet->paths, (fleet->nprograms + 1) * sizeof(char *));
+	if (paths)
+		fleet->paths = paths;
+	ParserResult *programs = realloc(fleet->programs, (fleet->nprograms + 1) * sizeof(ParserResult));
+	if (programs)
+		fleet->programs = programs;
+	sivm_image *images = realloc(fleet->images, (fleet->nprograms + 1) * sizeof(sivm_image));
+	if (images)
+		fleet->images = images;
+	if (! paths || ! programs || ! images || ! (fleet->paths[fleet->nprograms] = malloc(strlen(path) + 1))) {
+		logm(LOG_ERROR, "Not enough memory for the programs of the fleet");
+		return -1;
+	}
+
+	ParserResult *program = &fleet->programs[fleet->nprograms];
+	*program = (ParserResult) { .high = NULL };
+	if (! sivm_parse_file(program, path)) {
+		free(fleet->paths[fleet->nprograms]);
+		logm(LOG_ERROR, "Unable to load / assemble file `%s'", path);
+		return -1;
+	}
+	if (program->memsize > fleet->config.memsize) {
+		free(fleet->paths[fleet->nprograms]);
+		sivm_parse_free(program);
+		logm(LOG_ERROR, "Program `%s' is too big (%d words, memsize being %u)", path, program->memsize, fleet->config.memsize);
+		return -1;
+	}
+	strcpy(fleet->paths[fleet->nprograms], path);
+	make_image(fleet, fleet->nprograms);
+	return fleet->nprograms++;
+}
+
+/**Parses a job of a jobs file, already split in tokens by strtok.
+ *@returns	false if the job is illegal, in which case its pokes are already freed
+ */
+static bool parse_job(sivm_fleet *fleet, fleet_job *job, char *token)
+{
+	long program = find_program(fleet, token);
+	if (program < 0)
+		return false;
+	job->program = program;
+	job->budget = SIVM_NO_BUDGET;
+
+	while ((token = strtok(NULL, " \t\r\n"))) {
+		char *value = strchr(token, '=');
+		unsigned int reg;
+		REG addr;
+		char *end, extra;
+
+		if (value)
+			*value++ = '\0';
+		if (! value || *value == '\0')
+			;
+		else if (! strcmp("budget", token)) {
+			job->budget = strtoull(value, &end, 0);
+			if (value[0] != '-' && *end == '\0')
+				continue;
+		}
+		else if ((token[0] == 'R' || token[0] == 'r') && sscanf(token + 1, "%u%c", &reg, &extra) == 1 && reg < NREGS) {
+			if (parse_word(value, &job->reg[reg]))
+				continue;
+		}
+		else if (token[0] == '[' && token[strlen(token) - 1] == ']') {
+			char *close = token + strlen(token) - 1;
+			*close = '\0';
+			fleet_poke *pokes = realloc(job->pokes, (job->npokes + 1) * sizeof(fleet_poke));
+			if (! pokes) {
+				logm(LOG_ERROR, "Not enough memory for the jobs of the fleet");
+				break;
+			}
+			job->pokes = pokes;
+			if (parse_word(token + 1, &addr) && addr < fleet->config.memsize && parse_word(value, &job->pokes[job->npokes].value)) {
+				job->pokes[job->npokes++].addr = addr;
+				continue;
+			}
+			*close = ']';
+		}
+		logm(LOG_ERROR, "Illegal setting `%s' of the job at line %u (see --fleet)", token, job->line);
+		break;
+	}
+	if (token) {
+		free(job->pokes);
+		return false;
+	}
+	return true;
+}
+
+/**Loads the jobs of the given file in a new fleet.
+ *Each line holds a job: the source file of its program, then any of budget=N, Rn=VALUE and [ADDR]=VALUE, separated by spaces.
+ *Registers and words of memory not given are 0, and there is no budget unless it is given. Empty lines and lines starting with # are skipped.
+ *@param	config	memory geometry of the SIVMs of the jobs
+ *@returns	false if the file can't be read or holds an illegal job, in which case the fleet must not be used
+ */
+bool fleet_load(sivm_fleet *fleet, char *file, const sivm_config *config)
+{
+	char line[FLEET_LINE_LENGTH];
+	unsigned int capacity = 0;
+	bool ok = true;
+
+	*fleet = (sivm_fleet) { .config = *config };
+	FILE *f = fopen(file, "r");
+	if (! f) {
+		logm(LOG_ERROR, "Can't open file `%s'", file);
+		return false;
+	}
+
+	for (unsigned int number = 1; ok && fgets(line, FLEET_LINE_LENGTH, f); number++) {
+		if (! strchr(line, '\n') && ! feof(f)) {
+			logm(LOG_ERROR, "Line %u of `%s' is too long (at most %d characters)", number, file, FLEET_LINE_LENGTH - 2);
+			ok = false;
+			break;
+		}
+		char *token = strtok(line, " \t\r\n");
+		if (! token || token[0] == '#')
+			continue;
+
+		if (fleet->njobs == capacity) {
+			capacity = (capacity ? 2 * capacity : 64);
+			fleet_job *jobs = realloc(fleet->jobs, capacity * sizeof(fleet_job));
+			if (! jobs) {
+				logm(LOG_ERROR, "Not enough memory for the jobs of the fleet");
+				ok = false;
+				break;
+			}
+			fleet->jobs = jobs;
+		}
+		fleet_job *job = &fleet->jobs[fleet->njobs];
+		*job = (fleet_job) { .line = number };
+		if (parse_job(fleet, job, token))
+			fleet->njobs++;
+		else
+			ok = false;
+	}
+	fclose(f);
+
+	if (ok && ! fleet->njobs)
+		logm(LOG_ERROR, "No job in `%s'", file);
+	if (! ok || ! fleet->njobs) {
+		fleet_free(fleet);
+		return false;
+	}
+	return true;
+}
+
+/**Frees the jobs and programs of the given fleet.*/
+void fleet_free(sivm_fleet *fleet)
+{
+	for (unsigned int i = 0; i < fleet->njobs; i++)
+		free(fleet->jobs[i].pokes);
+	for (unsigned int i = 0; i < fleet->nprograms; i++) {
+		free(fleet->paths[i]);
+		sivm_parse_free(&fleet->programs[i]);
+		image_free(&fleet->images[i]);
+	}
+	free(fleet->jobs);
+	free(fleet->paths);
+	free(fleet->programs);
+	free(fleet->images);
+	*fleet = (sivm_fleet) { .config = fleet->config };
+}
+//@}
+
+
+/**@name	Work stealing*/
+//@{
+/**Jobs of the same program run as the lanes of a lockstep group, see lockstep.h.*/
+typedef struct
+{
+	unsigned int jobs[LOCKSTEP_LANES];	/*!< job of each lane */
+	unsigned int count;					/*!< number of jobs */
+	bool started;						/*!< whether the lockstep group was made */
+	lockstep lockstep;
+} team;
+
+/**Queue of jobs of a thread.
+ *Only its thread pushes jobs, at the bottom, and every thread takes them from the top, its own one included, with a compare-and-swap: jobs going back to the queue after a slice wait behind the others.
+ *Counters only grow, and a job or team is in a single queue at once, so that a queue of as many slots as there are jobs and teams never overwrites a slot before it is taken.
+ */
+typedef struct
+{
+	uint64_t top;			/*!< number of jobs taken */
+	uint64_t bottom;		/*!< number of jobs pushed */
+	unsigned int mask;		/*!< number of slots - 1, a power of two - 1 */
+	unsigned int *slots;	/*!< jobs, as indexes in the fleet, followed by the teams of the crew */
+} queue;
+
+typedef struct worker worker;
+
+/**Threads running a fleet.*/
+typedef struct
+{
+	sivm_fleet *fleet;
+	worker *workers;
+	unsigned int nworkers;
+	team *teams;			/*!< teams of jobs run in lockstep, taken from the queues as the items after the jobs */
+	unsigned int nteams;
+	unsigned int remaining;	/*!< number of jobs not over yet, the threads stopping once it reaches 0 */
+} crew;
+
+/**Thread of a crew.*/
+struct worker
+{
+	queue queue;
+	crew *crew;
+	unsigned int index;	/*!< index of the worker in its crew, from which it looks for jobs to steal */
+	pthread_t thread;
+};
+
+/**Pushes a job at the bottom of the given queue, which must be the one of the calling thread.*/
+static void push(queue *queue, unsigned int job)
+{
+	uint64_t bottom = queue->bottom;
+	__atomic_store_n(&queue->slots[bottom & queue->mask], job, __ATOMIC_RELAXED);
+	__atomic_store_n(&queue->bottom, bottom + 1, __ATOMIC_RELEASE);
+}
+
+/**Takes the job at the top of the given queue.
+ *@returns	the index of the job, -1 if the queue is empty
+ */
+static long take(queue *queue)
+{
+	uint64_t top = __atomic_load_n(&queue->top, __ATOMIC_ACQUIRE);
+	while (top < __atomic_load_n(&queue->bottom, __ATOMIC_ACQUIRE)) {
+		unsigned int job = __atomic_load_n(&queue->slots[top & queue->mask], __ATOMIC_RELAXED);
+		if (__atomic_compare_exchange_n(&queue->top, &top, top + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			return job;
+	}
+	return -1;
+}
+
+/**Loads the program, registers and memory of the given job in the given SIVM, which must have just been made or reset.
+ *The program is mapped from its image if it has one.
+ */
+static void load(sivm_fleet *fleet, fleet_job *job, SIVM *sivm)
+{
+	ParserResult *program = &fleet->programs[job->program];
+	if (! image_map(sivm, &fleet->images[job->program]))
+		sivm_load(sivm, program->memsize, program->mem); //fleet_load checked its size
+	for (unsigned int i = 0; i < job->npokes; i++) {
+		sivm->mem[job->pokes[i].addr].brut = job->pokes[i].value;
+		sivm_invalidate(sivm, job->pokes[i].addr);
+	}
+	memcpy(sivm->reg, job->reg, sizeof(job->reg));
+	job->sivm = sivm;
+}
+
+/**Gives the given job an SIVM, with its program, registers and memory.
+ *@param	spare	SIVM of a job that is over, reset rather than allocating a new one ; taken if there is one
+ *@returns	false if there is no memory left for the SIVM
+ */
+static bool start(sivm_fleet *fleet, fleet_job *job, SIVM **spare)
+{
+	SIVM *sivm = *spare;
+	*spare = NULL;
+	if (sivm)
+		sivm_reset(sivm, fleet->config.sp_start);
+	else if (! (sivm = malloc(sizeof(SIVM))) || ! sivm_new(sivm, &fleet->config)) {
+		free(sivm);
+		return false;
+	}
+	load(fleet, job, sivm);
+	return true;
+}
+
+/**Records the results of the given job, which is over, from its SIVM.*/
+static void record(fleet_job *job, sivm_stop stop)
+{
+	fleet_result *result = &job->result;
+	SIVM *sivm = job->sivm;
+	result->status = (stop == SIVM_HALT ? FLEET_HALTED : (stop == SIVM_FAULT ? FLEET_FAULT : FLEET_BUDGET));
+	result->retired = sivm->retired;
+	result->pc = sivm->pc;
+	result->sp = sivm->sp;
+	result->sr = sivm_flags(sivm);
+	memcpy(result->reg, sivm->reg, sizeof(sivm->reg));
+	strcpy(result->message, (stop == SIVM_FAULT ? sivm->fault_message : ""));
+}
+
+/**Records the results of the given job, which is over, and keeps its SIVM as the spare one of the thread.
+ *@param	spare	see start
+ */
+static void finish(fleet_job *job, sivm_stop stop, SIVM **spare)
+{
+	SIVM *sivm = job->sivm;
+	record(job, stop);
+	job->sivm = NULL;
+	if (*spare) {
+		sivm_free(sivm);
+		free(sivm);
+	}
+	else
+		*spare = sivm;
+}
+
+/**Records that the given job could not be started.*/
+static void fail(sivm_fleet *fleet, fleet_job *job)
+{
+	job->result.status = FLEET_ERROR;
+	snprintf(job->result.message, FAULT_MESSAGE_LENGTH, "Not enough memory for an SIVM of %u words", fleet->config.memsize);
+}
+
+/**Runs a slice of the given job, starting it first if it hasn't been yet.
+ *@param	spare	see start
+ *@returns	true if the job is over
+ */
+static bool run_slice(sivm_fleet *fleet, fleet_job *job, SIVM **spare)
+{
+	if (! job->sivm && ! start(fleet, job, spare)) {
+		fail(fleet, job);
+		return true;
+	}
+
+	SIVM *sivm = job->sivm;
+	uint64_t left = job->budget - sivm->retired;
+	sivm_stop stop = sivm_run(sivm, (left < FLEET_SLICE ? left : FLEET_SLICE));
+	if (stop == SIVM_BUDGET && sivm->retired < job->budget)
+		return false;
+	finish(job, stop, spare);
+	return true;
+}
+
+/**Runs a slice of the given team in lockstep, starting its jobs first if they haven't been yet.
+ *Jobs ejected from the group go on alone, pushed to the given queue, as the jobs of a team that can't be made into a group; the team goes back to the queue while some of its jobs are still running in it.
+ *@param	index	item of the team in the queues
+ *@param	spare	see start
+ *@returns	the number of jobs of the team that are over
+ */
+static unsigned int run_team(sivm_fleet *fleet, team *team, unsigned int index, queue *queue, SIVM **spare)
+{
+	unsigned int over = 0;
+	if (! team->started) {
+		SIVM *sivms[LOCKSTEP_LANES];
+		unsigned int lanes = 0;
+		for (unsigned int i = 0; i < team->count; i++) {
+			fleet_job *job = &fleet->jobs[team->jobs[i]];
+			if (start(fleet, job, spare)) {
+				team->jobs[lanes] = team->jobs[i];
+				sivms[lanes++] = job->sivm;
+			}
+			else {
+				fail(fleet, job);
+				over++;
+			}
+		}
+		team->count = lanes;
+		team->started = true;
+		if (lanes < LOCKSTEP_MIN_LANES || ! lockstep_new(&team->lockstep, sivms, lanes)) {
+			for (unsigned int i = 0; i < lanes; i++)
+				push(queue, team->jobs[i]);
+			return over;
+		}
+		for (unsigned int i = 0; i < lanes; i++)
+			team->lockstep.limit[i] = fleet->jobs[team->jobs[i]].budget;
+	}
+
+	uint32_t stopped = lockstep_run(&team->lockstep, FLEET_SLICE);
+	for (unsigned int lane = 0; lane < team->count; lane++)
+		if (stopped & 1u << lane) {
+			if (team->lockstep.state[lane] == LANE_EJECTED)
+				push(queue, team->jobs[lane]);
+			else {
+				finish(&fleet->jobs[team->jobs[lane]], (team->lockstep.state[lane] == LANE_HALTED ? SIVM_HALT : SIVM_BUDGET), spare);
+				over++;
+			}
+		}
+
+	if (team->lockstep.running)
+		push(queue, index);
+	else
+		lockstep_free(&team->lockstep);
+	return over;
+}
+
+/**Runs slices of the jobs and teams of the given worker's queue, or of the ones it steals, until all jobs of its crew are over.*/
+static void* work(void *data)
+{
+	worker *self = data;
+	crew *crew = self->crew;
+	sivm_fleet *fleet = crew->fleet;
+	SIVM *spare = NULL;
+
+	while (__atomic_load_n(&crew->remaining, __ATOMIC_ACQUIRE)) {
+		long item = take(&self->queue);
+		for (unsigned int i = 1; item < 0 && i < crew->nworkers; i++)
+			item = take(&crew->workers[(self->index + i) % crew->nworkers].queue);
+
+		unsigned int over = 0;
+		if (item < 0)
+			sched_yield(); //the remaining jobs are being run by other threads
+		else if (item >= fleet->njobs)
+			over = run_team(fleet, &crew->teams[item - fleet->njobs], item, &self->queue, &spare);
+		else if (run_slice(fleet, &fleet->jobs[item], &spare))
+			over = 1;
+		else
+			push(&self->queue, item);
+		if (over)
+			__atomic_sub_fetch(&crew->remaining, over, __ATOMIC_RELEASE);
+	}
+
+	if (spare) {
+		sivm_free(spare);
+		free(spare);
+	}
+	return NULL;
+}
+
+/**Gathers the jobs of the given crew's fleet in teams of up to LOCKSTEP_LANES jobs of the same program, in the order of the jobs file.
+ *@returns	false if there is no memory left for the teams
+ */
+static bool make_teams(crew *crew)
+{
+	sivm_fleet *fleet = crew->fleet;
+	unsigned int *open = calloc(fleet->nprograms, sizeof(unsigned int)); //team being filled for each program, + 1
+	if (! open || ! (crew->teams = calloc(fleet->njobs, sizeof(team)))) {
+		free(open);
+		return false;
+	}
+
+	for (unsigned int i = 0; i < fleet->njobs; i++) {
+		unsigned int *current = &open[fleet->jobs[i].program];
+		if (! *current)
+			*current = ++crew->nteams;
+		team *team = &crew->teams[*current - 1];
+		team->jobs[team->count++] = i;
+		if (team->count == LOCKSTEP_LANES)
+			*current = 0;
+	}
+	free(open);
+	return true;
+}
+
+/**Runs all jobs of the given fleet to their end, recording their results.
+ *Jobs are dealt to the queues of the threads in turn, the calling thread being one of them.
+ *@param	threads	number of threads, at least 1
+ *@param	lanes	whether to run jobs of the same program in lockstep groups (see lockstep.h), which is only done without a frame stack
+ *@returns	false if there is no memory left for the queues of the threads
+ *@see	fleet_print
+ */
+bool fleet_run(sivm_fleet *fleet, unsigned int threads, bool lanes)
+{
+	crew crew = { fleet, calloc(threads, sizeof(worker)), threads, NULL, 0, fleet->njobs };
+	unsigned int slots = 1;
+	bool ok = (crew.workers != NULL);
+	struct timespec begin, end;
+
+	lanes = lanes && ! fleet->config.frames;
+	if (ok && lanes && (ok = make_teams(&crew)))
+		logm(LOG_SUMMARY, "%u teams of up to %u jobs in lockstep, with %s vectors", crew.nteams, LOCKSTEP_LANES, lockstep_select());
+	while (slots < fleet->njobs + crew.nteams)
+		slots <<= 1;
+	for (unsigned int i = 0; ok && i < threads; i++) {
+		crew.workers[i] = (worker) { .queue = { .mask = slots - 1 }, .crew = &crew, .index = i };
+		ok = (crew.workers[i].queue.slots = malloc(slots * sizeof(unsigned int))) != NULL;
+	}
+	if (! ok) {
+		logm(LOG_ERROR, "Not enough memory for the queues of %u threads", threads);
+		for (unsigned int i = 0; crew.workers && i < threads; i++)
+			free(crew.workers[i].queue.slots);
+		free(crew.workers);
+		free(crew.teams);
+		return false;
+	}
+	if (lanes)
+		for (unsigned int i = 0; i < crew.nteams; i++)
+			push(&crew.workers[i % threads].queue, fleet->njobs + i);
+	else
+		for (unsigned int i = 0; i < fleet->njobs; i++)
+			push(&crew.workers[i % threads].queue, i);
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	unsigned int started = 1;
+	for (; started < threads; started++)
+		if (pthread_create(&crew.workers[started].thread, NULL, work, &crew.workers[started])) {
+			logm(LOG_WARNING, "Unable to start more than %u threads, the others' jobs being stolen", started);
+			break;
+		}
+	work(&crew.workers[0]);
+	for (unsigned int i = 1; i < started; i++)
+		pthread_join(crew.workers[i].thread, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	uint64_t retired = 0;
+	for (unsigned int i = 0; i < fleet->njobs; i++)
+		retired += fleet->jobs[i].result.retired;
+	logm(LOG_SUMMARY, "%u jobs, %llu instructions in %.3f s on %u threads", fleet->njobs, (unsigned long long) retired,
+		 (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9, started);
+
+	for (unsigned int i = 0; i < threads; i++)
+		free(crew.workers[i].queue.slots);
+	free(crew.workers);
+	free(crew.teams);
+	return true;
+}
+
+/**Runs all jobs of the given fleet to their end on the calling thread, as the tasks of a cooperative scheduler, recording their results.
+ *The SIVMs of all jobs are made at once, in a single array that each round of the scheduler goes through in order.
+ *@param	quantum	fuel given to a job for a turn, see scheduler_new
+ *@returns	false if there is no memory left for the SIVMs of the jobs
+ *@see	fleet_print
+ */
+bool fleet_swarm(sivm_fleet *fleet, unsigned int quantum)
+{
+	SIVM *sivms = calloc(fleet->njobs, sizeof(SIVM));
+	sivm_scheduler scheduler;
+	unsigned int made = 0;
+	bool ok = (sivms != NULL);
+	struct timespec begin, end;
+
+	scheduler_new(&scheduler, quantum);
+	while (ok && made < fleet->njobs && (ok = sivm_new(&sivms[made], &fleet->config))) {
+		load(fleet, &fleet->jobs[made], &sivms[made]);
+		ok = scheduler_add(&scheduler, &sivms[made], fleet->jobs[made].budget) >= 0;
+		made++;
+	}
+
+	if (! ok)
+		logm(LOG_ERROR, "Not enough memory for the SIVMs of %u jobs", fleet->njobs);
+	else {
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		scheduler_run(&scheduler, UINT64_MAX);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		logm(LOG_SUMMARY, "%u jobs, %llu instructions in %.3f s on 1 thread, in %llu rounds of up to %u instructions", fleet->njobs,
+			 (unsigned long long) scheduler.used, (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9,
+			 (unsigned long long) scheduler.rounds, scheduler.quantum);
+
+		for (unsigned int i = 0; i < fleet->njobs; i++) {
+			record(&fleet->jobs[i], scheduler.tasks[i].stop);
+			fleet->jobs[i].result.turns = scheduler.tasks[i].turns;
+		}
+	}
+
+	for (unsigned int i = 0; i < made; i++) {
+		sivm_free(&sivms[i]);
+		fleet->jobs[i].sivm = NULL;
+	}
+	free(sivms);
+	scheduler_free(&scheduler);
+	return ok;
+}
+
+/**Prints the results of the jobs of the given fleet, one line each in the order of the jobs file.
+ *Lines hold, separated by tabs: the line of the job in the jobs file, its status, the number of instructions it executed, its registers, its turns and CPU share if asked for, and the message of its fault if any.
+ *@param	shares	whether to print the number of turns of each job and its share of the instructions of all jobs, for fleet_swarm
+ */
+void fleet_print(const sivm_fleet *fleet, bool shares)
+{
+	static const char *statuses[] = { "pending", "halted", "budget", "fault", "error" };
+	uint64_t total = 0;
+
+	for (unsigned int i = 0; i < fleet->njobs; i++)
+		total += fleet->jobs[i].result.retired;
+	for (unsigned int i = 0; i < fleet->njobs; i++) {
+		const fleet_result *result = &fleet->jobs[i].result;
+		printf("%u\t%s\t%llu\tPC=%u SR=%u SP=%u", fleet->jobs[i].line, statuses[result->status], (unsigned long long) result->retired,
+			   result->pc, result->sr, result->sp);
+		for (unsigned int reg = 0; reg < NREGS; reg++)
+			printf(" R%u=%u", reg, result->reg[reg]);
+		if (shares)
+			printf("\tturns=%llu cpu=%.3f%%", (unsigned long long) result->turns, (total ? 100.0 * result->retired / total : 0));
+		printf((result->message[0] ? "\t%s\n" : "\n"), result->message);
+	}
+}
+//@}
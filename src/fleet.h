@@ -0,0 +1,90 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sivm.h"
+#include "parser.h"
+#include "image.h"
+
+/**@name	Fleets
+ *Many independent jobs, each a program with its initial registers and memory, run on a pool of threads.
+ *Each thread takes jobs from its own queue, and steals them from the queues of the others once it's empty.
+ *Jobs run by slices of FLEET_SLICE instructions, going back to the queue of their thread in between, so that long jobs don't hold a thread while shorter ones wait.
+ *Each job has its own SIVM while it runs, and its results are only written by the thread that ends it: nothing is locked.
+ *Jobs of the same program can also run by teams, as the lanes of a lockstep group (see lockstep.h), a team being taken by a single thread at once.
+ *Jobs can also all run on the calling thread, multiplexed by a cooperative scheduler (see scheduler.h).
+ *@see	fleet.c#fleet_run
+ */
+//@{
+/**Number of instructions a job executes before going back to a queue.*/
+#define FLEET_SLICE 100000
+/**Maximum number of threads running a fleet.*/
+#define FLEET_MAX_THREADS 1024
+/**Maximum length of a line of a jobs file, newline included.*/
+#define FLEET_LINE_LENGTH 1024
+
+/**Outcomes of a job.*/
+typedef enum
+{
+	FLEET_PENDING = 0,	/*!< the job isn't over yet */
+	FLEET_HALTED,		/*!< a HALT instruction was reached */
+	FLEET_BUDGET,		/*!< the budget of the job was executed */
+	FLEET_FAULT,		/*!< an instruction could not be executed, see the message */
+	FLEET_ERROR			/*!< the job could not be started, see the message */
+} fleet_status;
+
+/**Word of memory set over the program of a job before it starts.*/
+typedef struct
+{
+	REG addr;
+	REG value;
+} fleet_poke;
+
+/**Results of a job, the state of its SIVM when it stopped.*/
+typedef struct
+{
+	fleet_status status;
+	uint64_t retired;	/*!< number of instructions executed */
+	REG pc;
+	REG sp;
+	REG sr;				/*!< flags, as sivm_flags computes them */
+	REG reg[NREGS];
+	uint64_t turns;		/*!< number of quanta the job was given, see fleet_swarm */
+	char message[FAULT_MESSAGE_LENGTH];	/*!< message of the fault or of the error, empty otherwise */
+} fleet_result;
+
+/**Job of a fleet.*/
+typedef struct
+{
+	unsigned int line;		/*!< line of the job in its jobs file */
+	unsigned int program;	/*!< index of its program in the fleet */
+	uint64_t budget;		/*!< maximum number of instructions to execute, SIVM_NO_BUDGET for none */
+	REG reg[NREGS];			/*!< initial registers */
+	fleet_poke *pokes;		/*!< words of memory set over the program */
+	unsigned int npokes;	/*!< number of pokes */
+	SIVM *sivm;				/*!< SIVM of the job while it runs, NULL before and after */
+	fleet_result result;	/*!< set once the job is over */
+} fleet_job;
+
+/**Jobs, and the programs they run, each program being assembled once.*/
+typedef struct
+{
+	sivm_config config;		/*!< memory geometry of the SIVMs of all jobs */
+	char **paths;			/*!< source file of each program */
+	ParserResult *programs;	/*!< assembled programs */
+	sivm_image *images;		/*!< image of each program, mapped by its jobs, without a file if they load the program themselves (see image.h) */
+	unsigned int nprograms;	/*!< number of programs */
+	fleet_job *jobs;		/*!< jobs, in the order of the jobs file */
+	unsigned int njobs;		/*!< number of jobs */
+} sivm_fleet;
+
+bool fleet_load(sivm_fleet *fleet, char *file, const sivm_config *config);
+bool fleet_run(sivm_fleet *fleet, unsigned int threads, bool lanes);
+bool fleet_swarm(sivm_fleet *fleet, unsigned int quantum);
+void fleet_print(const sivm_fleet *fleet, bool shares);
+void fleet_free(sivm_fleet *fleet);
+//@}
+
+#endif /*FLEET_H*/
@@ -0,0 +1,94 @@
+#include "fusion.h"
+#include "instructions.h"
+#include "util.h"
+
+/**@name	Superinstructions
+ *Sequences of up to 3 instructions that sivm_run executes as a single fused body, to save the dispatch between them.
+ *Only the first instruction of a sequence is marked: jumping in the middle of it executes the remaining instructions one by one.
+ *Writing to any word of a sequence, or putting a breakpoint in it, invalidates its first instruction, which will be fused again only if the sequence still matches.
+ */
+//@{
+
+const char *fusion_names[FUSION_COUNT] = {
+	[FUSION_NONE]		= "none",
+	[FUSION_SUB_JEQ]	= "SUB + JEQ",
+	[FUSION_AND_JEQ]	= "AND + JEQ",
+	[FUSION_LOAD_ADD]	= "LOAD + ADD",
+	[FUSION_MOV_SHL_OR]	= "MOV + SHL + OR"
+};
+
+/**Tells whether the source operand of the given predecoded instruction can be read without any run-time check.*/
+static bool static_source(decoded *d)
+{
+	return d->srcMode != INDIRECT;
+}
+
+/**Tells whether the given predecoded instruction is a JEQ to a constant target that sivm_run can jump to without any check.
+ *@see	instructions.c#instr_jmp
+ */
+static bool static_jeq(SIVM *sivm, decoded *d, REG addr)
+{
+	REG last = addr + d->length - 1;
+	return d->codeop == JEQ && d->srcMode == IMMEDIATE
+		&& sivm_in_memory(sivm, d->srcWord) && d->srcWord != last && d->srcWord != last - 1;
+}
+
+fusion sivm_fuse(SIVM *sivm, REG addr)
+{
+	decoded *seq[3];
+	REG at[3];
+	int count = 0;
+	int span = 0;
+	fusion found = FUSION_NONE;
+	
+	//collect the predecoded instructions following the given adress
+	for (unsigned int pc = addr; count < 3 && sivm_in_memory(sivm, pc); pc += seq[count++]->length) {
+		decoded *d = &sivm->code[pc];
+		if (d->status == DECODE_PENDING)
+			sivm_decode(sivm, pc);
+		if (d->status != DECODE_OK || (count > 0 && d->breakpoint))
+			break;
+		seq[count] = d;
+		at[count] = pc;
+	}
+	if (count < 2)
+		return FUSION_NONE;
+	
+	if (count == 3
+		&& seq[0]->codeop == MOV && static_source(seq[0])
+		&& seq[1]->codeop == SHL && static_source(seq[1])
+		&& seq[2]->codeop == OR && static_source(seq[2])) {
+		found = FUSION_MOV_SHL_OR;
+		span = seq[0]->length + seq[1]->length + seq[2]->length;
+	} else if (seq[0]->codeop == SUB && static_source(seq[0]) && static_jeq(sivm, seq[1], at[1])) {
+		found = FUSION_SUB_JEQ;
+	} else if (seq[0]->codeop == AND && static_source(seq[0]) && static_jeq(sivm, seq[1], at[1])) {
+		found = FUSION_AND_JEQ;
+	} else if (seq[0]->codeop == LOAD && static_source(seq[0])
+			   && seq[1]->codeop == ADD && static_source(seq[1])) {
+		found = FUSION_LOAD_ADD;
+	}
+	
+	if (found == FUSION_NONE)
+		return FUSION_NONE;
+	if (! span)
+		span = seq[0]->length + seq[1]->length;
+	
+	seq[0]->handler = OPCODES_COUNT + found; //after all opcodes, see engine.c#sivm_run
+	seq[0]->span = span;
+	return found;
+}
+
+void fusion_report(SIVM *sivm)
+{
+	unsigned int sites[FUSION_COUNT] = {0};
+	
+	for (unsigned int i = 0; i < sivm->memsize; i++)
+		if (sivm->code[i].status == DECODE_OK && sivm->code[i].handler >= OPCODES_COUNT)
+			sites[sivm->code[i].handler - OPCODES_COUNT]++;
+	
+	for (unsigned int i = FUSION_NONE + 1; i < FUSION_COUNT; i++)
+		printf((ANSI_OUTPUT ? "\e[36m%-16s\e[0m %u site(s), executed %llu time(s)\n" : "%-16s %u site(s), executed %llu time(s)\n"),
+			   fusion_names[i], sites[i], (unsigned long long) sivm->fused[i]);
+}
+//@}
@@ -0,0 +1,21 @@
+#ifndef FUSION_H
+#define FUSION_H
+
+#include "sivm.h"
+
+/**Names of the superinstructions, indexed by the fusion enum.*/
+extern const char *fusion_names[FUSION_COUNT];
+
+/**Looks for a superinstruction starting at the given adress, and marks its predecoded instruction accordingly.
+ *@param	sivm	the VM whose predecoded instructions cache to update
+ *@param	addr	adress of the first instruction of the sequence
+ *@returns	the superinstruction found, FUSION_NONE if none
+ */
+fusion sivm_fuse(SIVM *sivm, REG addr);
+
+/**Prints which superinstructions are in the given SIVM's memory, and how many times each was executed.
+ *@param	sivm	the VM to report on
+ */
+void fusion_report(SIVM *sivm);
+
+#endif /*FUSION_H*/
@@ -0,0 +1,169 @@
+#define _DEFAULT_SOURCE	/*clock_gettime*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "harts.h"
+#include "scheduler.h"
+#include "parser.h"
+#include "util.h"
+
+/**@name	Harts
+ *@see	harts.h
+ */
+//@{
+/**Makes the given number of harts, running the program of the given source file on a single memory.
+ *@param	budget	maximum number of instructions executed by each hart, SIVM_NO_BUDGET for none
+ *@param	config	memory geometry of the memory, without banks, in which SP is the start of the stack of the first hart
+ *@returns	false if the program can't be assembled or doesn't fit in memory, or the stacks of the harts don't, in which case the harts must not be used
+ *@see	harts_free
+ */
+bool harts_new(sivm_harts *harts, char *file, unsigned int nharts, uint64_t budget, const sivm_config *config)
+{
+	ParserResult program = { .high = NULL };
+	long last = (long) config->sp_start + ((long) nharts * HARTS_STACK - 1) * config->sp_incr; //last word of the last stack
+
+	*harts = (sivm_harts) { .harts = NULL };
+	if (nharts == 0 || nharts > HARTS_MAX) {
+		logm(LOG_ERROR, "Illegal number of harts: %u (maximum is %d)", nharts, HARTS_MAX);
+		return false;
+	}
+	if (config->banks) {
+		logm(LOG_ERROR, "Harts can't share banks");
+		return false;
+	}
+	if (last < 0 || last >= config->memsize) {
+		logm(LOG_ERROR, "The stacks of %u harts (%d words each, from %u) don't fit in memory", nharts, HARTS_STACK, config->sp_start);
+		return false;
+	}
+	if (! sivm_parse_file(&program, file)) {
+		logm(LOG_ERROR, "Unable to load / assemble file `%s'", file);
+		return false;
+	}
+	if (program.memsize > config->memsize) {
+		logm(LOG_ERROR, "Program `%s' is too big (%d words, memsize being %u)", file, program.memsize, config->memsize);
+		sivm_parse_free(&program);
+		return false;
+	}
+	if (! (harts->harts = calloc(nharts, sizeof(sivm_hart)))) {
+		logm(LOG_ERROR, "Not enough memory for %u harts", nharts);
+		sivm_parse_free(&program);
+		return false;
+	}
+
+	for (unsigned int i = 0; i < nharts; i++) {
+		sivm_hart *hart = &harts->harts[i];
+		sivm_config own = *config;
+		own.sp_start = config->sp_start + (long) i * HARTS_STACK * config->sp_incr;
+		if (! sivm_new(&hart->sivm, &own)) {
+			sivm_parse_free(&program);
+			harts_free(harts);
+			return false;
+		}
+		harts->nharts++;
+		if (i == 0)
+			sivm_load(&hart->sivm, program.memsize, program.mem);
+		else
+			sivm_share(&hart->sivm, &harts->harts[0].sivm);
+		hart->sivm.reg[0] = i;
+		hart->budget = budget;
+		hart->stop = SIVM_BUDGET;
+	}
+	sivm_parse_free(&program);
+	return true;
+}
+
+/**Frees the given harts, the first one and its memory last.*/
+void harts_free(sivm_harts *harts)
+{
+	for (unsigned int i = harts->nharts; i-- > 0; )
+		sivm_free(&harts->harts[i].sivm);
+	free(harts->harts);
+	*harts = (sivm_harts) { .harts = NULL };
+}
+
+/**Runs the given hart on the calling thread, until it stops.*/
+static void* hart_work(void *data)
+{
+	sivm_hart *hart = data;
+	hart->stop = sivm_run(&hart->sivm, hart->budget);
+	return NULL;
+}
+
+/**Runs all the given harts until they stop, either taking turns on the calling thread or in parallel.
+ *Harts taking turns are the tasks of a scheduler, each round giving a quantum to each hart in order: runs are deterministic.
+ *Harts running in parallel each have a thread, the first one running on the calling thread ; harts that can't get a thread take turns on the calling thread with the first one, so that all of them still make progress.
+ *@param	parallel	whether to run each hart on its own thread
+ *@param	quantum		number of instructions a hart executes in a turn, HARTS_QUANTUM if 0 when harts take turns, SCHEDULER_QUANTUM if 0 when they run in parallel
+ *@returns	false if there is no memory left to schedule the harts
+ *@see	harts_print
+ */
+bool harts_run(sivm_harts *harts, bool parallel, unsigned int quantum)
+{
+	sivm_scheduler scheduler;
+	unsigned int started = 1, *tasks = malloc(harts->nharts * sizeof(unsigned int)); //task of each hart taking turns
+	bool ok = true;
+	struct timespec begin, end;
+
+	if (! tasks) {
+		logm(LOG_ERROR, "Not enough memory to schedule %u harts", harts->nharts);
+		return false;
+	}
+	scheduler_new(&scheduler, (quantum ? quantum : (parallel ? SCHEDULER_QUANTUM : HARTS_QUANTUM)));
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	if (parallel)
+		for (; started < harts->nharts; started++)
+			if (pthread_create(&harts->harts[started].thread, NULL, hart_work, &harts->harts[started])) {
+				logm(LOG_WARNING, "Unable to start more than %u threads, the other harts taking turns with the first one", started);
+				break;
+			}
+	for (unsigned int i = 0; ok && i < harts->nharts; i++)
+		if (! parallel || i == 0 || i >= started) {
+			int task = scheduler_add(&scheduler, &harts->harts[i].sivm, harts->harts[i].budget);
+			ok = (task >= 0);
+			tasks[i] = task;
+		}
+	if (ok)
+		scheduler_run(&scheduler, UINT64_MAX);
+	else
+		logm(LOG_ERROR, "Not enough memory to schedule %u harts", harts->nharts);
+	for (unsigned int i = 1; parallel && i < started; i++)
+		pthread_join(harts->harts[i].thread, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	uint64_t retired = 0;
+	for (unsigned int i = 0; ok && i < harts->nharts; i++) {
+		sivm_hart *hart = &harts->harts[i];
+		if (! parallel || i == 0 || i >= started) {
+			hart->stop = scheduler.tasks[tasks[i]].stop;
+			hart->turns = (parallel ? 0 : scheduler.tasks[tasks[i]].turns);
+		}
+		retired += hart->sivm.retired;
+	}
+	if (ok)
+		logm(LOG_SUMMARY, "%u harts, %llu instructions in %.3f s, %s", harts->nharts, (unsigned long long) retired,
+			 (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9, (parallel ? "in parallel" : "taking turns"));
+
+	free(tasks);
+	scheduler_free(&scheduler);
+	return ok;
+}
+
+/**Prints the state of each of the given harts once they stopped, one line each.
+ *Lines hold, separated by tabs: the number of the hart, its status, the number of instructions it executed, its registers, the number of turns it was given if it took turns, and the message of its fault if any.
+ */
+void harts_print(const sivm_harts *harts)
+{
+	for (unsigned int i = 0; i < harts->nharts; i++) {
+		sivm_hart *hart = &harts->harts[i];
+		SIVM *sivm = &hart->sivm;
+		printf("%u\t%s\t%llu\tPC=%u SR=%u SP=%u", i, (hart->stop == SIVM_HALT ? "halted" : (hart->stop == SIVM_FAULT ? "fault" : "budget")),
+			   (unsigned long long) sivm->retired, sivm->pc, sivm_flags(sivm), sivm->sp);
+		for (unsigned int reg = 0; reg < NREGS; reg++)
+			printf(" R%u=%u", reg, sivm->reg[reg]);
+		if (hart->turns)
+			printf("\tturns=%llu", (unsigned long long) hart->turns);
+		printf((hart->stop == SIVM_FAULT ? "\t%s\n" : "\n"), sivm->fault_message);
+	}
+}
+//@}
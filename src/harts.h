@@ -0,0 +1,50 @@
+#ifndef HARTS_H
+#define HARTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "sivm.h"
+#include "engine.h"
+
+/**@name	Harts
+ *Many harts running one program on a single memory: each hart is an SIVM with its own PC, SP, SR, registers and frames, all harts but the first one using the memory of the first (see sivm_share).
+ *Each hart starts at PC_START with its number in R0, and its own stack of HARTS_STACK words, the stack of each hart starting where the one of the previous hart ends.
+ *Harts synchronize with the atomic instructions CAS and FADD, and FENCE (see instructions.h#ATOMIC_INSTRUCTION): other accesses of a hart may be seen in any order by the others when they run in parallel.
+ *Each hart keeps its own predecoded instructions, so that code written by a hart isn't seen by another one that already decoded it.
+ *Harts either take turns on the calling thread, as the tasks of a cooperative scheduler (see scheduler.h), which is deterministic, or run in parallel, each one on its own thread.
+ *@see	harts.c#harts_run
+ */
+//@{
+/**Maximum number of harts.*/
+#define HARTS_MAX 64
+/**Number of words of the stack of each hart.*/
+#define HARTS_STACK 32
+/**Number of instructions a hart executes in a turn when harts take turns and no quantum is given: one, as if they shared one processor.*/
+#define HARTS_QUANTUM 1
+
+/**Hart.*/
+typedef struct
+{
+	SIVM sivm;
+	uint64_t budget;	/*!< maximum number of instructions to execute, SIVM_NO_BUDGET for none */
+	sivm_stop stop;		/*!< why sivm_run last returned, see sivm_run */
+	uint64_t turns;		/*!< number of quanta the hart was given when harts take turns, 0 when they ran in parallel */
+	pthread_t thread;	/*!< thread of the hart when harts run in parallel */
+} sivm_hart;
+
+/**Harts sharing a memory.*/
+typedef struct
+{
+	sivm_hart *harts;	/*!< harts, the first one owning the memory */
+	unsigned int nharts;
+} sivm_harts;
+
+bool harts_new(sivm_harts *harts, char *file, unsigned int nharts, uint64_t budget, const sivm_config *config);
+bool harts_run(sivm_harts *harts, bool parallel, unsigned int quantum);
+void harts_print(const sivm_harts *harts);
+void harts_free(sivm_harts *harts);
+//@}
+
+#endif /*HARTS_H*/
@@ -0,0 +1,82 @@
+#include <stdlib.h>
+
+#include "hooks.h"
+#include "util.h"
+
+/**@name	Execution events
+ *@see	hooks.h
+ */
+//@{
+
+/**Registers the hook of a kind of events in the given SIVM, replacing the previous one.
+ *The SIVM gets a buffer of events with its first hook, and loses it with its last one, so that it runs without reporting anything again.
+ *Pending events are delivered first. Hooks must not be changed from a hook.
+ *@param	hook	the function to call with the events, NULL to remove the hook of this kind
+ *@param	data	passed through to hook
+ *@returns	false if there is no memory left for the buffer of events
+ */
+bool sivm_set_hook(SIVM *sivm, sivm_event_kind kind, sivm_hook hook, void *data)
+{
+	if (! sivm->hooks) {
+		if (! hook)
+			return true;
+		sivm->hooks = calloc(1, sizeof(struct sivm_hooks));
+		if (! sivm->hooks) {
+			logm(LOG_ERROR, "Not enough memory for the hooks");
+			return false;
+		}
+	}
+
+	sivm_flush_events(sivm);
+	sivm->hooks->hook[kind] = hook;
+	sivm->hooks->data[kind] = data;
+	if (hook)
+		sivm->hooks->kinds |= 1 << kind;
+	else
+		sivm->hooks->kinds &= ~(1 << kind);
+
+	if (! sivm->hooks->kinds)
+		sivm_free_hooks(sivm);
+	return true;
+}
+
+/**Buffers an event for the hook of its kind, if there is one, and delivers the buffer once it is full.
+ *The SIVM must have hooks.
+ *@see	SIVM_EVENT
+ */
+void sivm_record_event(SIVM *sivm, sivm_event_kind kind, REG pc, REG addr, REG value)
+{
+	struct sivm_hooks *hooks = sivm->hooks;
+	if (! (hooks->kinds & (1 << kind)))
+		return;
+	hooks->events[hooks->count++] = (sivm_event) { kind, pc, addr, value };
+	if (hooks->count == HOOKS_BATCH)
+		sivm_flush_events(sivm);
+}
+
+/**Delivers the buffered events of the given SIVM, each run of consecutive events of the same kind in a single call to its hook.
+ *sivm_run delivers them before returning, and sivm_step when it isn't called by sivm_run.
+ */
+void sivm_flush_events(SIVM *sivm)
+{
+	struct sivm_hooks *hooks = sivm->hooks;
+	if (! hooks)
+		return;
+
+	unsigned int count = hooks->count;
+	for (unsigned int start = 0, end; start < count; start = end) {
+		uint8_t kind = hooks->events[start].kind;
+		for (end = start + 1; end < count && hooks->events[end].kind == kind; end++)
+			;
+		hooks->hook[kind](sivm, &hooks->events[start], end - start, hooks->data[kind]);
+	}
+	hooks->count = 0;
+}
+
+/**Removes all hooks of the given SIVM, without delivering pending events.*/
+void sivm_free_hooks(SIVM *sivm)
+{
+	free(sivm->hooks);
+	sivm->hooks = NULL;
+}
+//@}
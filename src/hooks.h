@@ -0,0 +1,75 @@
+#ifndef HOOKS_H
+#define HOOKS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sivm.h"
+
+/**@name	Execution events
+ *Tools (profilers, coverage, taint tracking...) follow the execution of an SIVM by registering hooks on the events it reports.
+ *Events are buffered and delivered in batches, in the order they happened: a hook gets all the consecutive events of its kind at once.
+ *Without any hook, sivm_run executes a build of the engine that doesn't report anything, and the interpreter only tests whether the SIVM has hooks.
+ *@see	engine.c#sivm_run
+ */
+//@{
+/**Number of events buffered before they are delivered.*/
+#define HOOKS_BATCH 256
+
+/**Kinds of events.*/
+typedef enum
+{
+	SIVM_EVENT_RETIRE = 0,	/*!< an instruction was executed */
+	SIVM_EVENT_READ,		/*!< a word of memory or of the bank window was read: addr and value */
+	SIVM_EVENT_WRITE,		/*!< a word of memory or of the bank window was written: addr and the value written */
+	SIVM_EVENT_CALL,		/*!< a CALL jumped to addr, value being the return adress pushed */
+	SIVM_EVENT_RET,			/*!< a RET returned, addr being the return adress popped */
+	SIVM_EVENT_BRANCH,		/*!< a jump (JMP, or a conditional jump whose condition held) went to addr */
+	SIVM_EVENT_FAULT,		/*!< the instruction raised a fault that wasn't recovered from, value being the kind (see sivm_fault) and addr the faulty value if any */
+	SIVM_EVENTS_COUNT
+} sivm_event_kind;
+
+/**Event reported to hooks.*/
+typedef struct
+{
+	uint8_t kind;	/*!< one of sivm_event_kind */
+	REG pc;			/*!< adress of the instruction that caused the event */
+	REG addr;		/*!< see sivm_event_kind */
+	REG value;		/*!< see sivm_event_kind */
+} sivm_event;
+
+/**Signature of hooks.
+ *The SIVM may have gone further than the events when they are delivered, which is why they carry the values they are about.
+ *@param	events	consecutive events of the kind the hook was registered for
+ *@param	count	number of events, at least 1
+ *@param	data	the data given along with the hook
+ */
+typedef void (*sivm_hook)(SIVM *sivm, const sivm_event *events, unsigned int count, void *data);
+
+/**Hooks of an SIVM, and the events waiting to be delivered to them.*/
+struct sivm_hooks
+{
+	sivm_hook hook[SIVM_EVENTS_COUNT];	/*!< hook of each kind of events, NULL if there is none */
+	void *data[SIVM_EVENTS_COUNT];		/*!< data given to each hook */
+	unsigned int kinds;					/*!< bitfield of the kinds of events that have a hook */
+	REG at;								/*!< adress of the instruction executed by sivm_step */
+	bool running;						/*!< sivm_run is executing, and delivers the events when it returns */
+	unsigned int count;					/*!< number of events in the buffer */
+	sivm_event events[HOOKS_BATCH];
+};
+
+/**Records an event of the instruction executed by sivm_step, if the SIVM has hooks.
+ *@see	sivm_record_event
+ */
+#define SIVM_EVENT(sivm, kind, addr, value) do { \
+		if ((sivm)->hooks) \
+			sivm_record_event((sivm), (kind), (sivm)->hooks->at, (addr), (value)); \
+	} while (0)
+
+bool sivm_set_hook(SIVM *sivm, sivm_event_kind kind, sivm_hook hook, void *data);
+void sivm_record_event(SIVM *sivm, sivm_event_kind kind, REG pc, REG addr, REG value);
+void sivm_flush_events(SIVM *sivm);
+void sivm_free_hooks(SIVM *sivm);
+//@}
+
+#endif /*HOOKS_H*/
@@ -0,0 +1,100 @@
+#define _GNU_SOURCE	/*memfd_create, ftruncate, _SC_PAGESIZE*/
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "image.h"
+#include "jit.h"
+#include "util.h"
+
+/**@name	Program images
+ *@see	image.h
+ */
+//@{
+/**Rounds the given size up to a number of pages.*/
+static size_t pages(size_t size)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	return (size + page - 1) / page * page;
+}
+
+/**Makes an image of the memory and predecoded instructions of the given SIVM, which must have no JIT.
+ *The image is taken once and for all: later writes of the SIVM aren't part of it.
+ *@returns	false if the image can't be made, in which case SIVMs copy the program instead
+ *@see	image_free
+ */
+bool image_new(sivm_image *image, const SIVM *model)
+{
+	*image = (sivm_image) { .fd = -1, .memsize = model->memsize, .verified = model->verified };
+	image->words = pages(model->memsize * sizeof(cmd_word));
+	image->size = image->words + pages(model->memsize * sizeof(decoded));
+
+	char *file = MAP_FAILED;
+	if ((image->fd = memfd_create("sivm-image", MFD_CLOEXEC)) < 0
+		|| ftruncate(image->fd, image->size)
+		|| (file = mmap(NULL, image->size, PROT_READ | PROT_WRITE, MAP_SHARED, image->fd, 0)) == MAP_FAILED) {
+		logm(LOG_WARNING, "Unable to make an image of %zu bytes, programs are copied", image->size);
+		image_free(image);
+		return false;
+	}
+	memcpy(file, model->mem, model->memsize * sizeof(cmd_word));
+	memcpy(file + image->words, model->code, model->memsize * sizeof(decoded));
+	munmap(file, image->size);
+	return true;
+}
+
+/**Frees the given image, which the SIVMs mapping it keep using until they're freed or reset.*/
+void image_free(sivm_image *image)
+{
+	if (image->fd >= 0)
+		close(image->fd);
+	image->fd = -1;
+}
+
+/**Maps the given image as the memory and predecoded instructions of the given SIVM, which must have the same number of words and not be a hart (see sivm_share).
+ *The SIVM gets the program of the image as sivm_load would have loaded it, its other state being left as is ; its previous memory is dropped, and the JIT is disabled.
+ *@returns	false if the image can't be mapped, in which case the SIVM is left as it was
+ */
+bool image_map(SIVM *sivm, const sivm_image *image)
+{
+	if (image->fd < 0 || image->memsize != sivm->memsize || sivm->shared)
+		return false;
+	char *file = mmap(NULL, image->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, image->fd, 0);
+	if (file == MAP_FAILED) {
+		logm(LOG_WARNING, "Unable to map an image of %zu bytes", image->size);
+		return false;
+	}
+
+	jit_disable(sivm);
+	if (sivm->mapped)
+		image_unmap(sivm);
+	else {
+		free(sivm->mem);
+		free(sivm->code);
+	}
+	sivm->mem = (cmd_word *) file;
+	sivm->code = (decoded *) (file + image->words);
+	sivm->mapped = image->size;
+	sivm->verified = image->verified;
+	return true;
+}
+
+/**Clears the memory and predecoded instructions of the given SIVM, which maps an image, dropping the pages it copied.
+ *Both are mapped again as pages of zeros, which don't take any memory until they're written to.
+ *@returns	false if they can't be mapped again, in which case the SIVM still maps the image
+ */
+bool image_clear(SIVM *sivm)
+{
+	return mmap(sivm->mem, sivm->mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED;
+}
+
+/**Unmaps the image mapped by the given SIVM, which is left without memory nor predecoded instructions.*/
+void image_unmap(SIVM *sivm)
+{
+	munmap(sivm->mem, sivm->mapped);
+	sivm->mem = NULL;
+	sivm->code = NULL;
+	sivm->mapped = 0;
+}
+//@}
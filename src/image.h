@@ -0,0 +1,38 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "sivm.h"
+
+/**@name	Program images
+ *Program loaded once and shared by many SIVMs: an image holds the memory and the predecoded instructions of an SIVM that loaded a program, in a file that only lives in memory.
+ *SIVMs running an image map it privately instead of copying it: they all read the same physical pages, and an SIVM only gets its own copy of a page the first time it writes to it (copy-on-write). Words and predecoded instructions start on pages of their own, so that a write to data copies a page of words and the page of the instructions decoded from them, leaving the rest of the program shared.
+ *Mapping an image spares the copy of the whole memory and the decoding, fusion and verification of the program (see sivm_load) ; for small memories, which fit in a few pages, the pages copied on the first writes cost more than that, so that images are only made when IMAGE_PAYS.
+ *@see	image.c
+ */
+//@{
+/**Smallest size of the words and predecoded instructions of an SIVM, in bytes, for which mapping an image pays off.*/
+#define IMAGE_MIN_SIZE (64 * 1024)
+/**Tells whether SIVMs of the given number of words are better off mapping images than copying programs.*/
+#define IMAGE_PAYS(memsize) ((size_t) (memsize) * (sizeof(cmd_word) + sizeof(decoded)) >= IMAGE_MIN_SIZE)
+
+/**Image of a program.*/
+typedef struct sivm_image
+{
+	int fd;					/*!< file holding the image, -1 if there is none */
+	unsigned int memsize;	/*!< number of words of the SIVMs the image is for */
+	size_t words;			/*!< offset of the predecoded instructions in the file: size of the words, rounded up to pages */
+	size_t size;			/*!< size of the file */
+	bool verified;			/*!< whether the program passed sivm_verify */
+} sivm_image;
+
+bool image_new(sivm_image *image, const SIVM *model);
+bool image_map(SIVM *sivm, const sivm_image *image);
+bool image_clear(SIVM *sivm);
+void image_unmap(SIVM *sivm);
+void image_free(sivm_image *image);
+//@}
+
+#endif /*IMAGE_H*/
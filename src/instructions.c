@@ -1,10 +1,23 @@
 #include "instructions.h"
+#include "flags.h"
+#include "hooks.h"
+#include "channel.h"
 
 #include "util.h"
 
 /**@name	Instructions*/
 //@{
 
+/**Keeps what the flags of a flag-setting instruction will be computed from.
+ *@see	flags.h#flags_compute
+ */
+static inline void set_flags(SIVM *sivm, REG result, REG operand, flags_op op)
+{
+	sivm->sr = result;
+	sivm->flag_src = operand;
+	sivm->flag_op = op;
+}
+
 /**Emulates the LOAD command in the given SIVM.
  *@return	true if the command was successful.
  */
@@ -29,7 +42,7 @@ bool instr_store(SIVM *sivm, REG *dest, cmd_word source)
 bool instr_mov(SIVM *sivm, REG *dest, cmd_word source)
 {
 	*dest = source.brut;
-	sivm->sr = *dest;
+	set_flags(sivm, *dest, source.brut, FLAGS_LOGIC);
     return true;
 }
 
@@ -39,7 +52,7 @@ bool instr_mov(SIVM *sivm, REG *dest, cmd_word source)
 bool instr_add(SIVM *sivm, REG *dest, cmd_word source)
 {
 	*dest += source.brut;
-	sivm->sr = *dest;
+	set_flags(sivm, *dest, source.brut, FLAGS_ADD);
     return true;
 }
 
@@ -49,7 +62,7 @@ bool instr_add(SIVM *sivm, REG *dest, cmd_word source)
 bool instr_sub(SIVM *sivm, REG *dest, cmd_word source)
 {
 	*dest -= source.brut;
-	sivm->sr = *dest;
+	set_flags(sivm, *dest, source.brut, FLAGS_SUB);
     return true;
 }
 
@@ -59,7 +72,7 @@ bool instr_sub(SIVM *sivm, REG *dest, cmd_word source)
 bool instr_and(SIVM *sivm, REG *dest, cmd_word source)
 {
 	*dest &= source.brut;
-	sivm->sr = *dest;
+	set_flags(sivm, *dest, source.brut, FLAGS_LOGIC);
     return true;
 }
 
@@ -69,7 +82,7 @@ bool instr_and(SIVM *sivm, REG *dest, cmd_word source)
 bool instr_or(SIVM *sivm, REG *dest, cmd_word source)
 {
 	*dest |= source.brut;
-	sivm->sr = *dest;
+	set_flags(sivm, *dest, source.brut, FLAGS_LOGIC);
     return true;
 }
 
@@ -79,7 +92,7 @@ bool instr_or(SIVM *sivm, REG *dest, cmd_word source)
 bool instr_dec(SIVM *sivm, REG *dest, cmd_word source)
 {
 	--(*dest);
-	sivm->sr = *dest;
+	set_flags(sivm, *dest, 1, FLAGS_SUB);
     return true;
 }
 
@@ -89,7 +102,7 @@ bool instr_dec(SIVM *sivm, REG *dest, cmd_word source)
 bool instr_shl(SIVM *sivm, REG *dest, cmd_word source)
 {
 	*dest <<= source.brut;
-	sivm->sr = *dest;
+	set_flags(sivm, *dest, source.brut, FLAGS_LOGIC);
     return true;
 }
 
@@ -99,19 +112,74 @@ bool instr_shl(SIVM *sivm, REG *dest, cmd_word source)
 bool instr_shr(SIVM *sivm, REG *dest, cmd_word source)
 {
 	*dest >>= source.brut;
-	sivm->sr = *dest;
+	set_flags(sivm, *dest, source.brut, FLAGS_LOGIC);
     return true;
 }
 
 /**Emulates the CMP command in the given SIVM.
+ *Sets the flags as SUB would, without modifying dest.
  *@return	true if the command was successful.
  */
 bool instr_cmp(SIVM *sivm, REG *dest, cmd_word source)
 {
-	sivm->sr = (*dest - source.brut);
+	set_flags(sivm, *dest - source.brut, source.brut, FLAGS_SUB);
+    return true;
+}
+
+/**Emulates the MUL command in the given SIVM.
+ *The product is truncated to the size of a register.
+ *@return	true if the command was successful.
+ */
+bool instr_mul(SIVM *sivm, REG *dest, cmd_word source)
+{
+	*dest = (unsigned) *dest * source.brut;
+	set_flags(sivm, *dest, source.brut, FLAGS_LOGIC);
     return true;
 }
 
+/**Emulates the DIV command in the given SIVM.
+ *Operands are unsigned.
+ *@return	true if the command was successful, false on a division by zero.
+ */
+bool instr_div(SIVM *sivm, REG *dest, cmd_word source)
+{
+	if (! source.brut) {
+		sivm_raise(sivm, SIVM_FAULT_DIVISION, NULL, "Division by zero");
+		return false;
+	}
+	*dest /= source.brut;
+	set_flags(sivm, *dest, source.brut, FLAGS_LOGIC);
+    return true;
+}
+
+/**Emulates the MOD command in the given SIVM.
+ *@see	instr_div
+ *@return	true if the command was successful, false on a division by zero.
+ */
+bool instr_mod(SIVM *sivm, REG *dest, cmd_word source)
+{
+	if (! source.brut) {
+		sivm_raise(sivm, SIVM_FAULT_DIVISION, NULL, "Division by zero");
+		return false;
+	}
+	*dest %= source.brut;
+	set_flags(sivm, *dest, source.brut, FLAGS_LOGIC);
+    return true;
+}
+
+/**Moves PC to the given target, checking it first.
+ *@see	instr_jmp
+ */
+static bool jump(SIVM *sivm, cmd_word source)
+{
+	if (source.brut == sivm->pc || source.brut == sivm->pc - 1) //Immediate or register jump destinations
+		if (! sivm_raise(sivm, SIVM_FAULT_LOOP, &source.brut, "Infinite loop (jumping to %d recursively)", source.brut))
+			return false;
+	if (!checkMemoryAccess(sivm, &source.brut)) return false;
+	sivm->pc = source.brut - 1; //because of post-incrementation
+	return true;
+}
+
 /**Emulates the JMP command in the given SIVM.
  *This instruction takes only one parameter above the targeted SIVM, source, but keeps the dest argument for type compatibility.
  *<strong>WARNING</strong> the argument to use is <strong>source</strong> and not dest.
@@ -123,32 +191,47 @@ bool instr_cmp(SIVM *sivm, REG *dest, cmd_word source)
  */
 bool instr_jmp(SIVM *sivm, REG *dest, cmd_word source)
 {
-	if (!checkMemoryAccess(&source.brut)) return false;
-	if (source.brut == sivm->pc || source.brut == sivm->pc - 1) //Immediate or register jump destinations
-		superRecover(&source.brut, "Infinite loop (jumping to %d recursively)", source.brut);
-	sivm->pc = source.brut - 1; //because of post-incrementation
+	if (! jump(sivm, source))
+		return false;
+	SIVM_EVENT(sivm, SIVM_EVENT_BRANCH, sivm->pc + 1, 0);
     return true;
 }
 
-/**Emulates the JEQ command in the given SIVM.
+/**Emulates the conditional jumps (JEQ, JNE, JLT...) in the given SIVM.
+ *Each one jumps like JMP if its condition on the flags holds.
  *@see	instr_jmp
+ *@see	instructions.def#CONDITIONAL_JUMPS
  */
-bool instr_jeq(SIVM *sivm, REG *dest, cmd_word source)
-{
-	if (sivm->sr == 0)
-		return instr_jmp(sivm, dest, source);
-    return true;
-}
+#define CONDITIONAL_JUMP(function, name) \
+	bool function(SIVM *sivm, REG *dest, cmd_word source) \
+	{ \
+		if (flags_condition(name, sivm_flags(sivm))) \
+			return instr_jmp(sivm, dest, source); \
+		return true; \
+	}
+CONDITIONAL_JUMP(instr_jeq, JEQ)
+CONDITIONAL_JUMP(instr_jne, JNE)
+CONDITIONAL_JUMP(instr_jlt, JLT)
+CONDITIONAL_JUMP(instr_jge, JGE)
+CONDITIONAL_JUMP(instr_jle, JLE)
+CONDITIONAL_JUMP(instr_jgt, JGT)
+CONDITIONAL_JUMP(instr_jc, JC)
+CONDITIONAL_JUMP(instr_jnc, JNC)
+CONDITIONAL_JUMP(instr_jo, JO)
+CONDITIONAL_JUMP(instr_jno, JNO)
+#undef CONDITIONAL_JUMP
 
 /**Emulates the PUSH command in the given SIVM.
  *@return	true if the command was successful.
  */
 bool instr_push(SIVM *sivm, REG *dest, cmd_word source)
 {
-	REG newSp = sivm->sp + SP_INCR;
-	if ((! checkMemoryAccess(&sivm->sp)) || (! checkMemoryAccess(&newSp)))
+	REG newSp = sivm->sp + sivm->sp_incr;
+	if ((! checkMemoryAccess(sivm, &sivm->sp)) || (! checkMemoryAccess(sivm, &newSp)))
 		 return false;
 	sivm->mem[sivm->sp] = source;
+	sivm_invalidate(sivm, sivm->sp);
+	SIVM_EVENT(sivm, SIVM_EVENT_WRITE, sivm->sp, source.brut);
 	sivm->sp = newSp;
 	return true;
 }
@@ -158,43 +241,313 @@ bool instr_push(SIVM *sivm, REG *dest, cmd_word source)
  */
 bool instr_pop(SIVM *sivm, REG *dest, cmd_word source)
 {
-	REG newSp = sivm->sp - SP_INCR;
-	if (! checkMemoryAccess(&newSp))
+	REG newSp = sivm->sp - sivm->sp_incr;
+	if (! checkMemoryAccess(sivm, &newSp))
 		 return false;
 	*dest = sivm->mem[newSp].brut;
+	SIVM_EVENT(sivm, SIVM_EVENT_READ, newSp, sivm->mem[newSp].brut);
 	sivm->sp = newSp;
 	return true;
 }
 
+/**Tells whether the given number of words from the given adress are all in the memory of the given SIVM.*/
+static bool block_in_memory(SIVM *sivm, REG addr, REG count)
+{
+	return (unsigned int) addr + count <= sivm->memsize;
+}
+
+/**Decodes the operands of a block instruction, and validates the adresses it accesses.
+ *Bounds are checked once for the whole block, instead of once per word.
+ *@param	dest	pointer to the destination register, holding the destination adress
+ *@param	source	the inline word of the instruction
+ *@param	value	set to the value of the source register
+ *@param	count	set to the value of the count register
+ *@param	sourceBlock	whether the source register holds the adress of a block too
+ *@returns	false if the operands are invalid or the blocks are not in memory
+ *@see	instructions.h#BLOCK_OPERANDS
+ */
+static bool block_operands(SIVM *sivm, REG *dest, cmd_word source, REG *value, REG *count, bool sourceBlock)
+{
+	if (! BLOCK_OPERANDS_VALID(source.brut)) {
+		sivm_raise(sivm, SIVM_FAULT_INSTRUCTION, NULL, "Invalid block instruction operands: %d", source.brut);
+		return false;
+	}
+	*value = sivm->reg[BLOCK_SOURCE(source.brut)];
+	*count = sivm->reg[BLOCK_COUNT(source.brut)];
+	if (! block_in_memory(sivm, *dest, *count) || (sourceBlock && ! block_in_memory(sivm, *value, *count))) {
+		sivm_raise(sivm, SIVM_FAULT_MEMORY, NULL, "Invalid memory access: block of %u words at %u (memsize is %u)", *count, (block_in_memory(sivm, *dest, *count) ? *value : *dest), sivm->memsize);
+		return false;
+	}
+	return true;
+}
+
+/**Invalidates the predecoded instructions over the given block of memory, after it was written to, and reports the writes to the hooks.*/
+static void block_invalidate(SIVM *sivm, REG addr, REG count)
+{
+	for (REG i = 0; i < count; i++)
+		sivm_invalidate(sivm, addr + i);
+	if (sivm->hooks)
+		for (REG i = 0; i < count; i++)
+			SIVM_EVENT(sivm, SIVM_EVENT_WRITE, addr + i, sivm->mem[addr + i].brut);
+}
+
+/**Reports the reads of the given block of memory to the hooks.*/
+static void block_read(SIVM *sivm, REG addr, REG count)
+{
+	if (sivm->hooks)
+		for (REG i = 0; i < count; i++)
+			SIVM_EVENT(sivm, SIVM_EVENT_READ, addr + i, sivm->mem[addr + i].brut);
+}
+
+/**Emulates the MEMCPY command in the given SIVM.
+ *Copies count words from the source adress to the destination adress, blocks may overlap.
+ *@see	block_operands
+ *@return	true if the command was successful.
+ */
+bool instr_memcpy(SIVM *sivm, REG *dest, cmd_word source)
+{
+	REG from, count;
+	if (! block_operands(sivm, dest, source, &from, &count, true))
+		return false;
+	block_read(sivm, from, count);
+	memmove(&sivm->mem[*dest], &sivm->mem[from], count * sizeof(cmd_word));
+	block_invalidate(sivm, *dest, count);
+	return true;
+}
+
+/**Emulates the MEMSET command in the given SIVM.
+ *Sets count words from the destination adress to the value of the source register.
+ *@see	block_operands
+ *@return	true if the command was successful.
+ */
+bool instr_memset(SIVM *sivm, REG *dest, cmd_word source)
+{
+	REG value, count;
+	if (! block_operands(sivm, dest, source, &value, &count, false))
+		return false;
+	if ((value & 0xFF) == value >> 8)
+		memset(&sivm->mem[*dest], value & 0xFF, count * sizeof(cmd_word));
+	else
+		for (REG i = 0; i < count; i++)
+			sivm->mem[*dest + i].brut = value;
+	block_invalidate(sivm, *dest, count);
+	return true;
+}
+
+/**Emulates the MEMCMP command in the given SIVM.
+ *Compares count words from the destination and source adresses, and sets the flags as CMP would on the first words that differ, or as equal if none does.
+ *@see	block_operands
+ *@return	true if the command was successful.
+ */
+bool instr_memcmp(SIVM *sivm, REG *dest, cmd_word source)
+{
+	REG from, count, i;
+	if (! block_operands(sivm, dest, source, &from, &count, true))
+		return false;
+	i = count;
+	if (memcmp(&sivm->mem[*dest], &sivm->mem[from], count * sizeof(cmd_word)))
+		for (i = 0; sivm->mem[*dest + i].brut == sivm->mem[from + i].brut; i++)
+			;
+	block_read(sivm, *dest, (i < count ? i + 1 : count));
+	block_read(sivm, from, (i < count ? i + 1 : count));
+	if (i < count)
+		set_flags(sivm, sivm->mem[*dest + i].brut - sivm->mem[from + i].brut, sivm->mem[from + i].brut, FLAGS_SUB);
+	else
+		set_flags(sivm, 0, 0, FLAGS_SUB);
+	return true;
+}
+
+/**Emulates the BANK command in the given SIVM.
+ *Maps the bank whose number is the source in the bank window, right after the memory.
+ *@see	sivm_select_bank
+ *@return	true if the command was successful, false if there is no such bank.
+ */
+bool instr_bank(SIVM *sivm, REG *dest, cmd_word source)
+{
+	return sivm_select_bank(sivm, source.brut);
+}
+
+/**Decodes the operands of an atomic instruction, and validates the adress it accesses.
+ *@param	dest	pointer to the destination register, holding the adress
+ *@param	source	the inline word of the instruction
+ *@param	addr	set to the adress, which has to be in memory: atomic instructions don't reach the bank window
+ *@param	first	set to the first register packed in the inline word
+ *@param	second	set to the second register packed in the inline word
+ *@returns	false if the operands are invalid or the adress is not in memory
+ *@see	instructions.h#ATOMIC_INSTRUCTION
+ */
+static bool atomic_operands(SIVM *sivm, REG *dest, cmd_word source, REG *addr, REG **first, REG **second)
+{
+	*first = *second = &sivm->sink.brut; //trapped operands point to the sink, as in sivm_data
+	if (! BLOCK_OPERANDS_VALID(source.brut)) {
+		sivm_raise(sivm, SIVM_FAULT_INSTRUCTION, NULL, "Invalid atomic instruction operands: %d", source.brut);
+		return false;
+	}
+	*addr = *dest;
+	if (! checkMemoryAccess(sivm, addr))
+		return false;
+	*first = &sivm->reg[BLOCK_SOURCE(source.brut)];
+	*second = &sivm->reg[BLOCK_COUNT(source.brut)];
+	return true;
+}
+
+/**Emulates the CAS command in the given SIVM.
+ *CAS Ra, Re, Rn writes Rn to the word at adress Ra if it holds Re, and puts the value the word held in Re.
+ *Flags are set as CMP would on the value the word held and Re, so that JEQ follows a successful swap.
+ *@see	atomic_operands
+ *@return	true if the command was successful.
+ */
+bool instr_cas(SIVM *sivm, REG *dest, cmd_word source)
+{
+	REG addr, *expected, *value, old;
+	if (! atomic_operands(sivm, dest, source, &addr, &expected, &value))
+		return false;
+	old = *expected;
+	bool swapped = __atomic_compare_exchange_n(&sivm->mem[addr].brut, &old, *value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	set_flags(sivm, old - *expected, *expected, FLAGS_SUB);
+	SIVM_EVENT(sivm, SIVM_EVENT_READ, addr, old);
+	if (swapped) {
+		sivm_invalidate(sivm, addr);
+		SIVM_EVENT(sivm, SIVM_EVENT_WRITE, addr, *value);
+	}
+	*expected = old;
+	return true;
+}
+
+/**Emulates the FADD command in the given SIVM.
+ *FADD Ra, Rv, Rd adds Rv to the word at adress Ra, and puts the value the word held in Rd.
+ *Flags are set as ADD would on the new value of the word.
+ *@see	atomic_operands
+ *@return	true if the command was successful.
+ */
+bool instr_fadd(SIVM *sivm, REG *dest, cmd_word source)
+{
+	REG addr, *value, *result, old, added;
+	if (! atomic_operands(sivm, dest, source, &addr, &value, &result))
+		return false;
+	added = *value;
+	old = __atomic_fetch_add(&sivm->mem[addr].brut, added, __ATOMIC_SEQ_CST);
+	set_flags(sivm, old + added, added, FLAGS_ADD);
+	sivm_invalidate(sivm, addr);
+	SIVM_EVENT(sivm, SIVM_EVENT_READ, addr, old);
+	SIVM_EVENT(sivm, SIVM_EVENT_WRITE, addr, (REG) (old + added));
+	*result = old;
+	return true;
+}
+
+/**Emulates the FENCE command in the given SIVM.
+ *Memory accesses of the SIVM before the fence are seen by other harts before the ones after it.
+ *@return	true.
+ */
+bool instr_fence(SIVM *sivm, REG *dest, cmd_word source)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	return true;
+}
+
+/**Emulates the SEND command in the given SIVM.
+ *The word is written to the output channel, or dropped if the consumer of the channel is over.
+ *sivm_run doesn't execute a SEND on a full channel, so that the channel is only found full when the SIVM is stepped some other way.
+ *@see	channel.h
+ *@return	true if the command was successful.
+ */
+bool instr_send(SIVM *sivm, REG *dest, cmd_word source)
+{
+	sivm_channel *channel = sivm->output;
+	if (! channel) {
+		sivm_raise(sivm, SIVM_FAULT_CHANNEL, NULL, "No output channel");
+		return false;
+	}
+	if (channel_closed(&channel->consumer))
+		return true;
+	if (! channel_can_send(channel)) {
+		sivm_raise(sivm, SIVM_FAULT_CHANNEL, NULL, "Output channel full");
+		return false;
+	}
+	channel_send(channel, source.brut);
+	return true;
+}
+
+/**Emulates the RECV command in the given SIVM.
+ *The word read from the input channel sets the flags as MOV would ; once the producer of the channel is over and all of its words were read, the register is left as it is and the carry flag is set, so that JC leaves a receiving loop.
+ *sivm_run doesn't execute a RECV on an empty channel whose producer isn't over, so that the channel is only found empty when the SIVM is stepped some other way.
+ *@see	channel.h
+ *@return	true if the command was successful.
+ */
+bool instr_recv(SIVM *sivm, REG *dest, cmd_word source)
+{
+	sivm_channel *channel = sivm->input;
+	if (! channel) {
+		sivm_raise(sivm, SIVM_FAULT_CHANNEL, NULL, "No input channel");
+		return false;
+	}
+	bool over = channel_closed(&channel->producer); //before looking for words, for none to be sent in between
+	if (channel_can_recv(channel)) {
+		*dest = channel_recv(channel);
+		set_flags(sivm, *dest, *dest, FLAGS_LOGIC);
+	}
+	else if (over)
+		set_flags(sivm, (REG) -1, 1, FLAGS_SUB); //as CMP of 0 with 1
+	else {
+		sivm_raise(sivm, SIVM_FAULT_CHANNEL, NULL, "Input channel empty");
+		return false;
+	}
+	return true;
+}
+
 /**Emulates the CALL command in the given SIVM.
+ *With a shadow frame stack, the registers are saved in a new frame instead of being pushed.
+ *@see	sivm.h#sivm_frame
  *@see	instr_push
  *@see	instr_jmp
  */
 bool instr_call(SIVM *sivm, REG *dest, cmd_word source)
 {
+	REG from = sivm->pc;
+	if (sivm->frames && sivm->nframes == sivm->max_frames) {
+		sivm_raise(sivm, SIVM_FAULT_FRAMES, NULL, "Frame stack overflow (maximum depth is %u)", sivm->max_frames);
+		return false;
+	}
+	
 	if (! instr_push(sivm, dest, (cmd_word) sivm->pc))
 		return false;
 	
-	for (int i = 0; i < NREGS; i++)
-		if (i < PARAM_REGS_START || i > PARAM_REGS_END) //ignore reserved registers
-			if (! instr_push(sivm, dest, (cmd_word) sivm->reg[i]))
-				return false;
+	if (! sivm->frames)
+		for (int i = 0; i < NREGS; i++)
+			if (i < PARAM_REGS_START || i > PARAM_REGS_END) //ignore reserved registers
+				if (! instr_push(sivm, dest, (cmd_word) sivm->reg[i]))
+					return false;
 	
-	return instr_jmp(sivm, dest, source);
+	if (! jump(sivm, source))
+		return false;
+	if (sivm->frames)
+		sivm_push_frame(sivm, from, sivm->pc + 1);
+	SIVM_EVENT(sivm, SIVM_EVENT_CALL, sivm->pc + 1, from);
+	sivm->depth++;
+	return true;
 }
 
 /**Emulates the RET command in the given SIVM.
+ *@see	instr_call
  *@see	instr_pop
  *@see	instr_jmp
  */
 bool instr_ret(SIVM *sivm, REG *dest, cmd_word source)
 {
-	for (int i = NREGS - 1; i >= 0; i--)
-		if (i < PARAM_REGS_START || i > PARAM_REGS_END) //ignore reserved registers
-			if (! instr_pop(sivm, &sivm->reg[i], source))
-				return false;
+	if (! sivm->frames)
+		for (int i = NREGS - 1; i >= 0; i--)
+			if (i < PARAM_REGS_START || i > PARAM_REGS_END) //ignore reserved registers
+				if (! instr_pop(sivm, &sivm->reg[i], source))
+					return false;
 	
-	return instr_pop(sivm, &sivm->pc, source);
+	if (! instr_pop(sivm, &sivm->pc, source))
+		return false;
+	SIVM_EVENT(sivm, SIVM_EVENT_RET, sivm->pc, 0);
+	if (sivm->frames)
+		sivm_pop_frame(sivm);
+	if (sivm->depth > 0)
+		sivm->depth--;
+	return true;
 }
 
 /**Emulates the HALT command in the given SIVM.
@@ -210,41 +563,139 @@ bool instr_halt(SIVM *sivm, REG *dest, cmd_word source)
  *This array has keys taken from the "instructions" enum, and its values describe the corresponding instructions, as an array containing :
  *<ol>
  *	<li>a pointer to the function emulating the instruction to execute</li>
+ *	<li>whether the instruction takes a destination, and a source parameter</li>
  *	<li>a bitfield describing which adressing modes are legal for this instruction</li>
+ *	<li>the name of the instruction</li>
  *</ol>
  *The bitfield element is created from bit-to-bit OR operations between all the f_modes enum elements. An instruction whose nargs == 0 should have its bitfield set to 0x0 to get standard behavior from checkModes.
- *@see	instructions.h#enum instructions
- *@see	instructions.h#enum f_modes
+ *@see	instructions.def#INSTRUCTION_SET
  *@see	getInstruction
  */
 const Instr instructions[] = {
-	[LOAD]	= {instr_load,	true,	true,	FM_REGDIR | FM_REGIMM | FM_REGIND,				"LOAD"},
-	[STORE]	= {instr_store,	true,	true,	FM_DIRIMM | FM_DIRREG | FM_INDIMM | FM_INDREG,	"STORE"},
-	[MOV]	= {instr_mov,	true,	true,	FM_REGREG | FM_REGIMM,							"MOV"},
-			
-	[ADD]	= {instr_add,	true,	true,	FM_REGREG | FM_REGIMM | FM_REGDIR | FM_REGIND,	"ADD"},
-	[SUB]	= {instr_sub,	true,	true,	FM_REGREG | FM_REGIMM | FM_REGDIR | FM_REGIND,	"SUB"},
-	[AND]	= {instr_and,	true,	true,	FM_REGREG | FM_REGIMM | FM_REGDIR | FM_REGIND,	"AND"},
-	[OR]	= {instr_or,	true,	true,	FM_REGREG | FM_REGIMM | FM_REGDIR | FM_REGIND,	"OR"},
-	[SHL]	= {instr_shl,	true,	true,	FM_REGREG | FM_REGIMM | FM_REGDIR | FM_REGIND,	"SHL"},
-	[SHR]	= {instr_shr,	true,	true,	FM_REGREG | FM_REGIMM | FM_REGDIR | FM_REGIND,	"SHR"},
-//	[CMP]	= {instr_cmp,	true,	true,	FM_REGREG | FM_REGIMM | FM_REGDIR | FM_REGIND | DIRIMM | DIRREG | INDIMM | INDREG,	"CMP"}, //we had no more room for extra instructions
-			
-	[JMP]	= {instr_jmp,	false,	true,	FM_REGREG | FM_REGIMM | FM_REGDIR | FM_REGIND,	"JMP"},
-	[JEQ]	= {instr_jeq,	false,	true,	FM_REGREG | FM_REGIMM | FM_REGDIR | FM_REGIND,	"JEQ"},
-			
-	[PUSH]	= {instr_push,	false,	true,	FM_REGREG | FM_REGIMM | FM_REGDIR | FM_REGIND,	"PUSH"},
-	[POP]	= {instr_pop,	true,	false,	FM_REGREG,	"POP"},
-			
-	[CALL]	= {instr_call,	false,	true,	FM_REGREG | FM_REGIMM | FM_REGDIR | FM_REGIND,	"CALL"},
-	[RET]	= {instr_ret,	false,	false,	0x0,	"RET"},
-
-	[HALT]	= {instr_halt,	false,	false,	0x0,	"HALT"},
+#define INSTRUCTION_ENTRY(name, opcode, function, destination, source, modes) [name] = {function, destination, source, modes, #name},
+	INSTRUCTION_SET(INSTRUCTION_ENTRY)
+#undef INSTRUCTION_ENTRY
 };
 
 //@}
 
 
+/**@name	Specialized handlers
+ *One handler is generated for each instruction and adressing mode, named after them (ADD_REGIMM, STORE_INDREG...).
+ *The fetch of its operands is inlined, and only has the checks required by the adressing mode.
+ *Handlers are found through the handlers array, indexed by the opcode and adressing mode bits of a command word.
+ *@see	sivm.c#sivm_decode
+ */
+//@{
+
+/**@name	Operand fetch for each operand kind*/
+//@{
+static inline cmd_word fetch_REGISTER(SIVM *sivm, decoded *d)
+{
+	return (cmd_word) sivm->reg[d->source];
+}
+
+static inline cmd_word fetch_IMMEDIATE(SIVM *sivm, decoded *d)
+{
+	return (cmd_word) d->srcWord;
+}
+
+static inline cmd_word fetch_DIRECT(SIVM *sivm, decoded *d)
+{
+	return sivm->mem[d->srcWord];
+}
+
+static inline cmd_word fetch_INDIRECT(SIVM *sivm, decoded *d)
+{
+	return *sivm_data(sivm, &sivm->reg[d->source]);
+}
+
+static inline REG* locate_REGISTER(SIVM *sivm, decoded *d)
+{
+	return &sivm->reg[d->dest];
+}
+
+static inline REG* locate_DIRECT(SIVM *sivm, decoded *d)
+{
+	return &sivm->mem[d->destWord].brut;
+}
+
+static inline REG* locate_INDIRECT(SIVM *sivm, decoded *d)
+{
+	return &sivm_data(sivm, &sivm->reg[d->dest])->brut;
+}
+
+/*Adresses of the memory operands, for the events reported to the hooks.*/
+static inline REG source_adress(SIVM *sivm, decoded *d)
+{
+	return (d->srcMode == DIRECT ? d->srcWord : sivm->reg[d->source]);
+}
+
+static inline REG dest_adress(SIVM *sivm, decoded *d)
+{
+	return (d->destMode == DIRECT ? d->destWord : sivm->reg[d->dest]);
+}
+
+/*Writes to a register or to the bank window can't modify code, writes to memory have to invalidate the predecoded instructions.*/
+static inline void written_REGISTER(SIVM *sivm, REG *dest)
+{
+}
+
+static inline void written_DIRECT(SIVM *sivm, REG *dest)
+{
+	sivm_invalidate(sivm, (cmd_word *) dest - sivm->mem);
+}
+
+static inline void written_INDIRECT(SIVM *sivm, REG *dest)
+{
+	cmd_word *word = (cmd_word *) dest;
+	if (word >= sivm->mem && word < sivm->mem + sivm->memsize)
+		sivm_invalidate(sivm, word - sivm->mem);
+}
+//@}
+
+/*Same as sivm_exec, for a given instruction and adressing mode.
+ *PC has to be on the first word of the instruction, and is left on its last word.
+ *Only indirect operands may raise a fault, which is checked before executing the instruction.
+ *Memory operands are reported to the hooks, if there are any.*/
+#define HANDLER(mode, value, destKind, srcKind, name, function) \
+	static bool name##_##mode(SIVM *sivm, decoded *d) \
+	{ \
+		cmd_word source = fetch_##srcKind(sivm, d); \
+		REG *dest = locate_##destKind(sivm, d); \
+		if ((srcKind == INDIRECT || destKind == INDIRECT) && sivm->fault) \
+			return false; \
+		if ((srcKind == DIRECT || srcKind == INDIRECT) && sivm->hooks) \
+			sivm_record_event(sivm, SIVM_EVENT_READ, sivm->hooks->at, source_adress(sivm, d), source.brut); \
+		sivm->pc += d->length - 1; \
+		if (! function(sivm, dest, source)) \
+			return sivm_raise(sivm, SIVM_FAULT_INSTRUCTION, NULL, "Instruction unsuccessful (command: %d)", sivm->mem[sivm->pc - d->length + 1].brut); \
+		written_##destKind(sivm, dest); \
+		if ((destKind == DIRECT || destKind == INDIRECT) && sivm->hooks) \
+			sivm_record_event(sivm, SIVM_EVENT_WRITE, sivm->hooks->at, dest_adress(sivm, d), *dest); \
+		return true; \
+	}
+#define INSTRUCTION_HANDLERS(name, opcode, function, destination, source, modes) ADRESSING_MODES(HANDLER, name, function)
+INSTRUCTION_SET(INSTRUCTION_HANDLERS)
+#undef INSTRUCTION_HANDLERS
+#undef HANDLER
+
+/**Tells whether an adressing mode is legal in the given bitfield, with the same rules as checkModes for instructions with arity 0.*/
+#define LEGAL_MODE(modes, value) ((modes) ? ((modes) & (1 << (value))) : (value) == REGREG)
+
+/**Handlers of all legal combinations of instructions and adressing modes, NULL for illegal ones.
+ *@see	HANDLER_INDEX
+ */
+static const instr_handler handlers[HANDLERS_COUNT] = {
+#define HANDLER_ENTRY(mode, value, destKind, srcKind, name, modes) [HANDLER_INDEX(name, value)] = (LEGAL_MODE(modes, value) ? name##_##mode : NULL),
+#define INSTRUCTION_HANDLER_ENTRIES(name, opcode, function, destination, source, modes) ADRESSING_MODES(HANDLER_ENTRY, name, modes)
+	INSTRUCTION_SET(INSTRUCTION_HANDLER_ENTRIES)
+#undef INSTRUCTION_HANDLER_ENTRIES
+#undef HANDLER_ENTRY
+};
+//@}
+
+
 /**Tests a word for adressing modes legality.
  *The whole instruction word is tested, in order to determine whether the adressing modes used in it are legal for the instruction it contains.
  *@return	true if the adressing modes are legal, false in the opposite case or if the command word takes no argument.
@@ -260,5 +711,17 @@ bool checkModes(const cmd_word m)
  */
 Instr getInstruction(const cmd_word m)
 {
+	static const Instr unknown = {NULL, false, false, 0x0, "???"};
+	
+	if (m.codage.codeop >= sizeof(instructions) / sizeof(instructions[0]))
+		return unknown;
 	return instructions[m.codage.codeop];
 }
+
+/**Returns the handler specialized for the instruction and adressing mode of the given word.
+ *@returns	NULL if the instruction is unknown or its adressing mode is illegal
+ */
+instr_handler getHandler(const cmd_word m)
+{
+	return handlers[HANDLER_INDEX(m.codage.codeop, m.codage.mode)];
+}
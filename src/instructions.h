@@ -4,49 +4,32 @@
 #include <stdbool.h>
 #include "sivm.h"
 #include "util.h"
+#include "instructions.def"
 
 /**Lists all available instructions.
  *The value of the enum elements are the opcodes for the given instruction.
- *Some values are given according to the A.A. courses documents, others are given arbitrarily.
+ *@see	instructions.def#INSTRUCTION_SET
  */
 enum instructions
 {
-    LOAD =	0x8, //ref: TD2 A.A.
-    STORE =	0x9, //ref: TD2 A.A.
-    ADD =	0x0, //ref: TD2 A.A.
-    SUB =	0x1, //ref: TD2 A.A.
-    JMP =	0x2, //no ref from now on
-    JEQ =	0x3,
-    CALL =	0x4,
-    RET =	0x5,
-    PUSH =	0x6,
-    POP =	0x7,
-	MOV =	0xA,
-	AND =	0xB,
-	OR =	0xC,
-	SHL =	0xD,
-	SHR =	0xE,
-    HALT =	0xF
+#define INSTRUCTION_OPCODE(name, opcode, function, destination, source, modes) name = opcode,
+	INSTRUCTION_SET(INSTRUCTION_OPCODE)
+#undef INSTRUCTION_OPCODE
 };
 
 /**@name	Adressing modes*/
 //@{
 /**Lists all available adressing modes.
- *The reference for the values is the document "Description de PROCSI" that was given to us in the A.A. courses.
  *We don't use single-type adressing modes only because it's impossible to achieve storing 5x5 possible combinations in 4 bits.
  *The single-type adressing modes (REGISTER, IMMEDIATE, DIRECT, INDIRECT) are not for public use.
+ *@see	instructions.def#ADRESSING_MODES
  *@see	sivm.c#sivm_exec
  */
 typedef enum
 {
-	REGREG = 0x0, // 0b0000
-	REGIMM = 0x4, // 0b0100
-	REGDIR = 0x8, // 0b1000
-	REGIND = 0xC, // 0b1100
-	DIRIMM = 0x5, // 0b0100
-	DIRREG = 0x1, // 0b0001
-	INDIMM = 0x6, // 0b0110
-	INDREG = 0x2, // 0b0010
+#define ADRESSING_MODE_VALUE(name, value, destination, source, a, b) name = value,
+	ADRESSING_MODES(ADRESSING_MODE_VALUE, , )
+#undef ADRESSING_MODE_VALUE
 	REGISTER,
 	IMMEDIATE,
 	DIRECT,
@@ -59,28 +42,54 @@ typedef enum
  */
 typedef enum
 {
-	FM_REGREG = 1 << REGREG,
-	FM_REGIMM = 1 << REGIMM,
-	FM_REGDIR = 1 << REGDIR,
-	FM_REGIND = 1 << REGIND,
-	FM_DIRIMM = 1 << DIRIMM,
-	FM_DIRREG = 1 << DIRREG,
-	FM_INDIMM = 1 << INDIMM,
-	FM_INDREG = 1 << INDREG
+#define ADRESSING_MODE_FLAG(name, value, destination, source, a, b) FM_##name = 1 << name,
+	ADRESSING_MODES(ADRESSING_MODE_FLAG, , )
+#undef ADRESSING_MODE_FLAG
 } f_mode;
 //@}
 
 
 typedef struct {
-    bool (*function)(SIVM *sivm, REG *dest, cmd_word source);
+    instr_function function;
 	bool destination;
 	bool source;
     f_mode modes;
 	char* name;
 } Instr;
 
+/**@name	Block instructions
+ *MEMCPY, MEMSET and MEMCMP take three registers: the destination adress, the source (adress or value), and the number of words.
+ *They are encoded with the REGIMM mode: the destination register is in the command word, and the source and count registers are packed in the inline word.
+ */
+//@{
+#define BLOCK_INSTRUCTION(codeop)		((codeop) == MEMCPY || (codeop) == MEMSET || (codeop) == MEMCMP)
+/**Inline word of a block instruction.*/
+#define BLOCK_OPERANDS(source, count)	((source) | (count) << 3)
+#define BLOCK_SOURCE(word)				((word) & 0x7)
+#define BLOCK_COUNT(word)				((word) >> 3 & 0x7)
+/**Tells whether the inline word of a block instruction only holds its two registers.*/
+#define BLOCK_OPERANDS_VALID(word)		((word) < 1 << 6)
+//@}
+
+/**@name	Atomic instructions
+ *CAS and FADD take three registers, encoded as the ones of block instructions: the adress of a word of memory in the command word, and two registers packed in the inline word (see BLOCK_OPERANDS).
+ *They read and write their word at once, even when other harts access it from other threads (see harts.h).
+ */
+//@{
+#define ATOMIC_INSTRUCTION(codeop)		((codeop) == CAS || (codeop) == FADD)
+/**Tells whether an instruction takes three registers, packed as BLOCK_OPERANDS.*/
+#define PACKED_INSTRUCTION(codeop)		(BLOCK_INSTRUCTION(codeop) || ATOMIC_INSTRUCTION(codeop))
+//@}
+
 bool checkModes(const cmd_word m);
 
 Instr getInstruction(const cmd_word m);
 
+/**Index of the handler of a command word, made of its opcode and adressing mode bits.*/
+#define HANDLER_INDEX(opcode, mode) ((opcode) | (mode) << 6)
+/**Number of handlers, one for each value of the opcode and adressing mode bits of a command word.*/
+#define HANDLERS_COUNT (1 << 10)
+
+instr_handler getHandler(const cmd_word m);
+
 #endif
@@ -0,0 +1,717 @@
+#define _DEFAULT_SOURCE	/*MAP_ANONYMOUS*/
+
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "jit.h"
+#include "instructions.h"
+#include "util.h"
+#include "flags.h"
+
+/**@name	Native code generation
+ *Hot blocks of predecoded instructions are translated into x86-64 code, with guest registers held in host registers:
+ *R0-R7 in r8d-r15d, SR in esi, SP in ebx, the SIVM's adress in rdi. PC is only known at the exits of a block.
+ *The adress and size of the SIVM's memory are constants of the native code, and bounds checks are left out when the memory spans the whole adress space.
+ *Host registers always hold zero-extended 16 bits values, so that arithmetic can be done with 16 bits operations and memory can be indexed directly.
+ *A block ends on a JMP, on any write to memory (so that the caches can be invalidated before going on), or before an instruction it can't compile (CALL, RET, HALT, dynamic jumps...).
+ *Flag-setting instructions keep their result in esi, and store their source operand and kind straight into the SIVM (see flags.h).
+ *JEQ and JNE only leave the block when taken, other conditional jumps end the block. Jumps back to the start of the block loop in native code as long as the budget given by sivm_run allows a whole pass, ebp counting the instructions executed by previous passes.
+ *Whenever a run-time check fails (out of bounds access), the block gives control back to the interpreter on the faulty instruction, so that all diagnostics stay the same.
+ */
+//@{
+#if defined(__x86_64__)
+
+/**Value returned by native code, in rax:rdx.*/
+typedef struct
+{
+	uint32_t pc;		/*!< adress of the next instruction to execute */
+	uint32_t retired;	/*!< number of instructions executed by the block */
+	uint64_t written;	/*!< adress written by the block, NO_WRITE if none */
+} jit_exit;
+
+#define NO_WRITE UINT64_MAX
+
+typedef jit_exit (*jit_native)(SIVM *sivm, uint64_t budget);
+
+/**Maximum budget given to a block, so that the number of instructions it executes fits in jit_exit.retired.*/
+#define MAX_BUDGET (UINT32_MAX / 2)
+
+/**x86-64 registers numbers.*/
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+#define HOST_REG(i)	(R8 + (i))
+#define HOST_SR		RSI
+#define HOST_SP		RBX
+#define HOST_VM		RDI
+/**SIB index meaning "no index".*/
+#define NO_INDEX	RSP
+
+/**Condition codes for Jcc.*/
+enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7 };
+
+/**ModR/M /digit extensions of group opcodes.*/
+enum { EXT_ADD = 0, EXT_OR = 1, EXT_AND = 4, EXT_SUB = 5, EXT_SHL = 4, EXT_SHR = 5, EXT_CMP = 7, EXT_DIV = 6 };
+
+#define OFFSET_REG(i)	(offsetof(SIVM, reg) + (i) * sizeof(REG))
+
+/**Code buffer being written to.*/
+typedef struct
+{
+	uint8_t *p;
+	uint8_t *end;
+	bool overflow;
+	SIVM *sivm;		/*!< VM the code is compiled for */
+} emitter;
+
+static void emit8(emitter *e, uint8_t byte)
+{
+	if (e->p < e->end)
+		*e->p++ = byte;
+	else
+		e->overflow = true;
+}
+
+static void emit32(emitter *e, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+		emit8(e, value >> (8 * i));
+}
+
+static void emit64(emitter *e, uint64_t value)
+{
+	emit32(e, value);
+	emit32(e, value >> 32);
+}
+
+/**Emits a REX prefix, if any is needed.*/
+static void emit_rex(emitter *e, bool wide, int reg, int index, int base)
+{
+	uint8_t rex = 0x40 | (wide << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3);
+	if (rex != 0x40)
+		emit8(e, rex);
+}
+
+static void emit_modrm(emitter *e, int mod, int reg, int rm)
+{
+	emit8(e, (mod << 6) | ((reg & 7) << 3) | (rm & 7));
+}
+
+/**Emits an instruction with a register-register ModR/M operand.*/
+static void emit_rr(emitter *e, bool word, uint8_t opcode, int reg, int rm)
+{
+	if (word)
+		emit8(e, 0x66);
+	emit_rex(e, false, reg, 0, rm);
+	emit8(e, opcode);
+	emit_modrm(e, 3, reg, rm);
+}
+
+/**Same as emit_rr, with 64 bits operands.*/
+static void emit_rr64(emitter *e, uint8_t opcode, int reg, int rm)
+{
+	emit_rex(e, true, reg, 0, rm);
+	emit8(e, opcode);
+	emit_modrm(e, 3, reg, rm);
+}
+
+/**Emits an instruction with a [rdi + disp32] memory operand, ie. a field of the SIVM.*/
+static void emit_rm_vm(emitter *e, bool word, const uint8_t *opcode, int length, int reg, uint32_t disp)
+{
+	if (word)
+		emit8(e, 0x66);
+	emit_rex(e, false, reg, 0, HOST_VM);
+	for (int i = 0; i < length; i++)
+		emit8(e, opcode[i]);
+	emit_modrm(e, 2, reg, HOST_VM);
+	emit32(e, disp);
+}
+
+/**mov base, imm64: the adress of the SIVM's memory word at the given adress.*/
+static void emit_mem_adress(emitter *e, int base, REG addr)
+{
+	emit_rex(e, true, 0, 0, base);
+	emit8(e, 0xB8 + (base & 7));
+	emit64(e, (uint64_t) (uintptr_t) &e->sivm->mem[addr]);
+}
+
+/**Emits an instruction with a [base + index * 4] memory operand, ie. the SIVM's memory word whose adress is in index, base being set by emit_mem_adress.
+ *base can't be rbp, r12 or r13, index can be NO_INDEX.
+ */
+static void emit_rm_mem(emitter *e, bool word, const uint8_t *opcode, int length, int reg, int index, int base)
+{
+	if (word)
+		emit8(e, 0x66);
+	emit_rex(e, false, reg, index, base);
+	for (int i = 0; i < length; i++)
+		emit8(e, opcode[i]);
+	emit_modrm(e, 0, reg, 4);
+	emit8(e, (2 << 6) | ((index & 7) << 3) | (base & 7));
+}
+
+static const uint8_t MOVZX16[] = { 0x0F, 0xB7 };
+static const uint8_t MOV_STORE[] = { 0x89 };
+
+/**movzx dest, word [rdi + disp]*/
+static void emit_load_vm(emitter *e, int dest, uint32_t disp)
+{
+	emit_rm_vm(e, false, MOVZX16, 2, dest, disp);
+}
+
+/**mov word [rdi + disp], src*/
+static void emit_store_vm(emitter *e, uint32_t disp, int src)
+{
+	emit_rm_vm(e, true, MOV_STORE, 1, src, disp);
+}
+
+/**mov byte [rdi + disp], imm8*/
+static void emit_store_vm_imm8(emitter *e, uint32_t disp, uint8_t value)
+{
+	emit_rex(e, false, 0, 0, HOST_VM);
+	emit8(e, 0xC6);
+	emit_modrm(e, 2, 0, HOST_VM);
+	emit32(e, disp);
+	emit8(e, value);
+}
+
+/**mov dest, src (32 bits)*/
+static void emit_mov(emitter *e, int dest, int src)
+{
+	emit_rr(e, false, 0x89, src, dest);
+}
+
+/**mov dest, imm32*/
+static void emit_mov_imm(emitter *e, int dest, uint32_t value)
+{
+	emit_rex(e, false, 0, 0, dest);
+	emit8(e, 0xB8 + (dest & 7));
+	emit32(e, value);
+}
+
+/**movzx dest, dest16: truncates a register to 16 bits*/
+static void emit_truncate(emitter *e, int reg)
+{
+	emit_rex(e, false, reg, 0, reg);
+	emit8(e, 0x0F);
+	emit8(e, 0xB7);
+	emit_modrm(e, 3, reg, reg);
+}
+
+/**Group 1 operation with a 32 bits immediate (add, or, and, sub, cmp), 64 bits wide if asked to.*/
+static void emit_alu_imm_w(emitter *e, bool wide, int ext, int reg, uint32_t value)
+{
+	emit_rex(e, wide, 0, 0, reg);
+	emit8(e, 0x81);
+	emit_modrm(e, 3, ext, reg);
+	emit32(e, value);
+}
+
+static void emit_alu_imm(emitter *e, int ext, int reg, uint32_t value)
+{
+	emit_alu_imm_w(e, false, ext, reg, value);
+}
+
+/**Jcc rel32, to be patched.
+ *@returns	adress of the displacement to patch
+ */
+static uint8_t* emit_jcc(emitter *e, int cc)
+{
+	emit8(e, 0x0F);
+	emit8(e, 0x80 | cc);
+	uint8_t *patch = e->p;
+	emit32(e, 0);
+	return patch;
+}
+
+/**jmp rel32 to the given position.*/
+static void emit_jmp(emitter *e, uint8_t *target)
+{
+	emit8(e, 0xE9);
+	emit32(e, (uint32_t) (target - (e->p + 4)));
+}
+
+/**Makes the given Jcc jump to the current position.*/
+static void patch_jcc(emitter *e, uint8_t *patch)
+{
+	if (e->overflow)
+		return;
+	int32_t rel = e->p - (patch + 4);
+	memcpy(patch, &rel, sizeof(rel));
+}
+
+static const int saved_host_regs[] = { RBX, RBP, R12, R13, R14, R15 };
+#define SAVED_HOST_REGS (sizeof(saved_host_regs) / sizeof(saved_host_regs[0]))
+
+/**Saves callee-saved registers, keeps the budget on the stack and loads the guest state.*/
+static void emit_prologue(emitter *e)
+{
+	for (unsigned i = 0; i < SAVED_HOST_REGS; i++) {
+		emit_rex(e, false, 0, 0, saved_host_regs[i]);
+		emit8(e, 0x50 + (saved_host_regs[i] & 7));
+	}
+	emit8(e, 0x50 + RSI); //push rsi: budget is at [rsp]
+	emit_rr(e, false, 0x31, RBP, RBP); //xor ebp, ebp
+	for (int i = 0; i < NREGS; i++)
+		emit_load_vm(e, HOST_REG(i), OFFSET_REG(i));
+	emit_load_vm(e, HOST_SR, offsetof(SIVM, sr));
+	emit_load_vm(e, HOST_SP, offsetof(SIVM, sp));
+}
+
+/**Writes the guest state back and returns to the engine.
+ *@param	pc		adress of the next instruction to execute
+ *@param	retired	number of instructions of the current pass executed when leaving through this exit
+ *@param	written	if true, edx holds the adress written to by the last instruction
+ */
+static void emit_exit(emitter *e, REG pc, uint32_t retired, bool written)
+{
+	for (int i = 0; i < NREGS; i++)
+		emit_store_vm(e, OFFSET_REG(i), HOST_REG(i));
+	emit_store_vm(e, offsetof(SIVM, sr), HOST_SR);
+	emit_store_vm(e, offsetof(SIVM, sp), HOST_SP);
+	if (! written) { //mov rdx, -1
+		emit8(e, 0x48);
+		emit8(e, 0xC7);
+		emit_modrm(e, 3, 0, RDX);
+		emit32(e, (uint32_t) -1);
+	}
+	emit8(e, 0x48); //mov rax, imm64
+	emit8(e, 0xB8);
+	emit64(e, ((uint64_t) retired << 32) | pc);
+	emit_rr64(e, 0x89, RBP, RCX); //rax += rbp << 32
+	emit8(e, 0x48);
+	emit8(e, 0xC1);
+	emit_modrm(e, 3, EXT_SHL, RCX);
+	emit8(e, 32);
+	emit_rr64(e, 0x01, RCX, RAX);
+	emit8(e, 0x58 + RCX); //pop the budget
+	for (int i = SAVED_HOST_REGS - 1; i >= 0; i--) {
+		emit_rex(e, false, 0, 0, saved_host_regs[i]);
+		emit8(e, 0x58 + (saved_host_regs[i] & 7));
+	}
+	emit8(e, 0xC3);
+}
+
+/**Leaves the block on the instruction at pc if the given register isn't a valid memory adress.
+ *@see	sivm.h#sivm_in_memory
+ */
+static void emit_bounds_check(emitter *e, int reg, REG pc, uint32_t retired)
+{
+	uint8_t *ok;
+	if (e->sivm->outside) {
+		if (! (e->sivm->outside & UINT16_MAX)) //whole adress space
+			return;
+		emit_rex(e, false, 0, 0, reg); //test reg, imm32
+		emit8(e, 0xF7);
+		emit_modrm(e, 3, 0, reg);
+		emit32(e, e->sivm->outside);
+		ok = emit_jcc(e, CC_E);
+	} else {
+		emit_alu_imm(e, EXT_CMP, reg, e->sivm->memsize);
+		ok = emit_jcc(e, CC_B);
+	}
+	emit_exit(e, pc, retired, false);
+	patch_jcc(e, ok);
+}
+
+/**Computes the value of the source operand of an instruction.
+ *@returns	the host register holding the value
+ */
+static int emit_source(emitter *e, decoded *d, REG pc, uint32_t retired)
+{
+	switch (d->srcMode) {
+		case REGISTER:
+			return HOST_REG(d->source);
+		case IMMEDIATE:
+			emit_mov_imm(e, RAX, d->srcWord);
+			return RAX;
+		case DIRECT:
+			emit_mem_adress(e, RAX, d->srcWord);
+			emit_rm_mem(e, false, MOVZX16, 2, RAX, NO_INDEX, RAX);
+			return RAX;
+		default:
+			emit_bounds_check(e, HOST_REG(d->source), pc, retired);
+			emit_mem_adress(e, RAX, 0);
+			emit_rm_mem(e, false, MOVZX16, 2, RAX, HOST_REG(d->source), RAX);
+			return RAX;
+	}
+}
+
+/**Computes the new stack pointer in ecx, leaving the block if it isn't a valid memory adress.*/
+static void emit_stack_move(emitter *e, int increment, REG pc, uint32_t retired)
+{
+	emit_mov(e, RCX, HOST_SP);
+	emit_alu_imm(e, EXT_ADD, RCX, (uint32_t) increment);
+	emit_truncate(e, RCX);
+	emit_bounds_check(e, RCX, pc, retired);
+}
+
+/**Keeps the source operand and kind of a flag-setting instruction, before it is executed (the source may be its destination).
+ *@see	flags.h#flags_compute
+ */
+static void emit_set_flags(emitter *e, int src, flags_op op)
+{
+	emit_store_vm(e, offsetof(SIVM, flag_src), src);
+	emit_store_vm_imm8(e, offsetof(SIVM, flag_op), op);
+}
+
+/**Tells whether the given JMP, JEQ or JNE can be compiled, ie. whether its target is static and valid.
+ *@see	engine.c#CHECK_JUMP
+ */
+static bool static_jump(SIVM *sivm, decoded *d, REG pc)
+{
+	REG last = pc + d->length - 1;
+	return d->srcMode == IMMEDIATE
+		&& sivm_in_memory(sivm, d->srcWord)
+		&& d->srcWord != last
+		&& d->srcWord != (REG) (last - 1);
+}
+
+/**Leaves the block for the given jump target, or loops if it is the start of the block and the budget allows another whole pass.
+ *@param	head	adress of the first instruction of the block
+ *@param	body	native code of the first instruction of the block, NULL if the block can't loop
+ */
+static void emit_jump(emitter *e, REG target, uint32_t retired, REG head, uint8_t *body)
+{
+	target = (target ? target : 1); //see increment_PC
+	if (! body || target != head) {
+		emit_exit(e, target, retired, false);
+		return;
+	}
+	emit_alu_imm_w(e, true, EXT_ADD, RBP, retired);
+	emit_rr64(e, 0x89, RBP, RCX);
+	emit_alu_imm_w(e, true, EXT_ADD, RCX, JIT_MAX_BLOCK);
+	emit8(e, 0x48); //cmp rcx, [rsp]
+	emit8(e, 0x3B);
+	emit8(e, 0x0C);
+	emit8(e, 0x24);
+	uint8_t *out = emit_jcc(e, CC_A);
+	emit_jmp(e, body);
+	patch_jcc(e, out);
+	emit_exit(e, target, 0, false);
+}
+
+/**Compiles a single instruction.
+ *@param	retired	number of instructions of the current pass before this one
+ *@param	head	adress of the first instruction of the block
+ *@param	body	native code of the first instruction of the block, NULL if the block can't loop
+ *@param	open	set to false if the instruction ends the block
+ *@returns	false if the instruction can't be compiled
+ */
+static bool emit_instruction(emitter *e, decoded *d, REG pc, uint32_t retired, REG head, uint8_t *body, bool *open)
+{
+	REG next = pc + d->length;
+	int dest = HOST_REG(d->dest);
+	int src;
+	uint8_t opcode;
+	flags_op flags;
+
+	switch (d->codeop) {
+		case LOAD:
+			src = emit_source(e, d, pc, retired);
+			emit_mov(e, dest, src);
+			return true;
+		case MOV:
+			src = emit_source(e, d, pc, retired);
+			emit_set_flags(e, src, FLAGS_LOGIC);
+			emit_mov(e, dest, src);
+			emit_mov(e, HOST_SR, dest);
+			return true;
+		case ADD:	opcode = 0x01; flags = FLAGS_ADD; goto alu;
+		case SUB:	opcode = 0x29; flags = FLAGS_SUB; goto alu;
+		case AND:	opcode = 0x21; flags = FLAGS_LOGIC; goto alu;
+		case OR:	opcode = 0x09; flags = FLAGS_LOGIC;
+		alu:
+			src = emit_source(e, d, pc, retired);
+			emit_set_flags(e, src, flags);
+			emit_rr(e, true, opcode, src, dest);
+			emit_mov(e, HOST_SR, dest);
+			return true;
+		case SHL:
+		case SHR:
+			/*32 bits shifts, truncated: same result as the C integer promotion in instr_shl and instr_shr*/
+			src = emit_source(e, d, pc, retired);
+			emit_set_flags(e, src, FLAGS_LOGIC);
+			emit_mov(e, RCX, src);
+			emit_rex(e, false, 0, 0, dest);
+			emit8(e, 0xD3);
+			emit_modrm(e, 3, (d->codeop == SHL ? EXT_SHL : EXT_SHR), dest);
+			emit_truncate(e, dest);
+			emit_mov(e, HOST_SR, dest);
+			return true;
+		case CMP:
+			src = emit_source(e, d, pc, retired);
+			emit_set_flags(e, src, FLAGS_SUB);
+			emit_mov(e, HOST_SR, dest);
+			emit_rr(e, true, 0x29, src, HOST_SR); //sub si, src
+			return true;
+		case MUL:
+			src = emit_source(e, d, pc, retired);
+			emit_set_flags(e, src, FLAGS_LOGIC);
+			emit_rex(e, false, dest, 0, src); //imul dest, src
+			emit8(e, 0x0F);
+			emit8(e, 0xAF);
+			emit_modrm(e, 3, dest, src);
+			emit_truncate(e, dest);
+			emit_mov(e, HOST_SR, dest);
+			return true;
+		case DIV:
+		case MOD:
+			/*divisions by zero are left to the interpreter*/
+			src = emit_source(e, d, pc, retired);
+			emit_mov(e, RCX, src);
+			emit_rr(e, false, 0x85, RCX, RCX); //test ecx, ecx
+			uint8_t *nonZero = emit_jcc(e, CC_NE);
+			emit_exit(e, pc, retired, false);
+			patch_jcc(e, nonZero);
+			emit_set_flags(e, RCX, FLAGS_LOGIC);
+			emit_mov(e, RAX, dest);
+			emit_rr(e, false, 0x31, RDX, RDX); //xor edx, edx
+			emit8(e, 0xF7); //div ecx
+			emit_modrm(e, 3, EXT_DIV, RCX);
+			emit_mov(e, dest, (d->codeop == DIV ? RAX : RDX));
+			emit_mov(e, HOST_SR, dest);
+			return true;
+		case STORE:
+			src = emit_source(e, d, pc, retired);
+			emit_mov(e, RAX, src);
+			if (d->destMode == DIRECT) {
+				emit_mem_adress(e, RDX, d->destWord);
+				emit_rm_mem(e, true, MOV_STORE, 1, RAX, NO_INDEX, RDX);
+				emit_mov_imm(e, RDX, d->destWord);
+			} else {
+				emit_bounds_check(e, dest, pc, retired);
+				emit_mem_adress(e, RDX, 0);
+				emit_rm_mem(e, true, MOV_STORE, 1, RAX, dest, RDX);
+				emit_mov(e, RDX, dest);
+			}
+			emit_exit(e, next, retired + 1, true);
+			*open = false;
+			return true;
+		case PUSH:
+			src = emit_source(e, d, pc, retired);
+			emit_mov(e, RAX, src);
+			emit_bounds_check(e, HOST_SP, pc, retired);
+			emit_stack_move(e, e->sivm->sp_incr, pc, retired);
+			emit_mem_adress(e, RDX, 0);
+			emit_rm_mem(e, true, MOV_STORE, 1, RAX, HOST_SP, RDX);
+			emit_mov(e, RDX, HOST_SP);
+			emit_mov(e, HOST_SP, RCX);
+			emit_exit(e, next, retired + 1, true);
+			*open = false;
+			return true;
+		case POP:
+			emit_stack_move(e, -e->sivm->sp_incr, pc, retired);
+			emit_mem_adress(e, RAX, 0);
+			emit_rm_mem(e, false, MOVZX16, 2, dest, RCX, RAX);
+			emit_mov(e, HOST_SP, RCX);
+			return true;
+		case JMP:
+			if (! static_jump(e->sivm, d, pc))
+				return false;
+			emit_jump(e, d->srcWord, retired + 1, head, body);
+			*open = false;
+			return true;
+		case JEQ:
+		case JNE:
+			if (! static_jump(e->sivm, d, pc))
+				return false;
+			emit_rr(e, false, 0x85, HOST_SR, HOST_SR); //test esi, esi: Z is set if the result in SR is 0
+			uint8_t *notTaken = emit_jcc(e, (d->codeop == JEQ ? CC_NE : CC_E));
+			emit_jump(e, d->srcWord, retired + 1, head, body);
+			patch_jcc(e, notTaken);
+			return true;
+		default:
+			return false;
+	}
+}
+
+/**Throws away the compiled block starting at the given adress.*/
+static void jit_drop(SIVM *sivm, REG head)
+{
+	jit *j = sivm->jit;
+	j->blocks[head].code = NULL;
+	j->heat[head] = 0;
+	if (sivm->code[head].handler == HANDLER_NATIVE)
+		sivm->code[head].status = DECODE_PENDING;
+}
+
+/**Recomputes which words are part of a compiled block.*/
+static void jit_update_coverage(SIVM *sivm)
+{
+	jit *j = sivm->jit;
+	memset(j->covered, false, sivm->memsize * sizeof(bool));
+	for (unsigned int head = 0; head < sivm->memsize; head++)
+		if (j->blocks[head].code)
+			for (unsigned int i = head; i < head + j->blocks[head].span && i < sivm->memsize; i++)
+				j->covered[i] = true;
+}
+
+/**Throws away all compiled blocks, to make room for new ones.*/
+static void jit_flush(SIVM *sivm)
+{
+	for (unsigned int head = 0; head < sivm->memsize; head++)
+		if (sivm->jit->blocks[head].code)
+			jit_drop(sivm, head);
+	sivm->jit->used = 0;
+	jit_update_coverage(sivm);
+}
+
+bool jit_enable(SIVM *sivm)
+{
+	if (sivm->jit)
+		return true;
+	jit *j = calloc(1, sizeof(jit));
+	if (j) {
+		j->heat = calloc(sivm->memsize, sizeof(uint16_t));
+		j->blocks = calloc(sivm->memsize, sizeof(jit_block));
+		j->covered = calloc(sivm->memsize, sizeof(bool));
+	}
+	if (! j || ! j->heat || ! j->blocks || ! j->covered) {
+		logm(LOG_ERROR, "Not enough memory for the JIT");
+		if (j) {
+			free(j->heat);
+			free(j->blocks);
+			free(j->covered);
+		}
+		free(j);
+		return false;
+	}
+	j->code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (j->code == MAP_FAILED) {
+		logm(LOG_ERROR, "Unable to allocate memory for native code, JIT disabled");
+		free(j->heat);
+		free(j->blocks);
+		free(j->covered);
+		free(j);
+		return false;
+	}
+	sivm->jit = j;
+	return true;
+}
+
+void jit_disable(SIVM *sivm)
+{
+	if (! sivm->jit)
+		return;
+	for (unsigned int head = 0; head < sivm->memsize; head++)
+		if (sivm->jit->blocks[head].code)
+			jit_drop(sivm, head);
+	munmap(sivm->jit->code, JIT_CODE_SIZE);
+	free(sivm->jit->heat);
+	free(sivm->jit->blocks);
+	free(sivm->jit->covered);
+	free(sivm->jit);
+	sivm->jit = NULL;
+}
+
+bool jit_compile(SIVM *sivm, REG addr)
+{
+	jit *j = sivm->jit;
+	if (! sivm_in_memory(sivm, addr))
+		return false;
+	if (sivm->code[addr].status == DECODE_PENDING)
+		sivm_decode(sivm, addr);
+	if (sivm->code[addr].status != DECODE_OK) {
+		j->heat[addr] = 0;
+		return false;
+	}
+
+	if (mprotect(j->code, JIT_CODE_SIZE, PROT_READ | PROT_WRITE))
+		return false;
+
+	for (int attempt = 0; attempt < 2; attempt++) {
+		emitter e = { j->code + j->used, j->code + JIT_CODE_SIZE, false, sivm };
+		uint8_t *start = e.p;
+		REG pc = addr;
+		uint32_t retired = 0;
+		bool open = true;
+
+		emit_prologue(&e);
+		uint8_t *body = (sivm->code[addr].breakpoint ? NULL : e.p);
+		while (open && retired < JIT_MAX_BLOCK && sivm_in_memory(sivm, pc)) {
+			decoded *d = &sivm->code[pc];
+			if (d->status == DECODE_PENDING)
+				sivm_decode(sivm, pc);
+			if (d->status != DECODE_OK || (retired && d->breakpoint))
+				break;
+			if (! emit_instruction(&e, d, pc, retired, addr, body, &open))
+				break;
+			retired++;
+			pc += d->length;
+		}
+		if (open)
+			emit_exit(&e, pc, retired, false);
+
+		if (e.overflow) { //code buffer is full: start again from an empty one
+			jit_flush(sivm);
+			continue;
+		}
+		if (retired == 0)
+			break;
+
+		j->used += ((e.p - start) + 15) & ~15;
+		j->blocks[addr] = (jit_block) { start, pc - addr, retired };
+		j->compiled++;
+		jit_update_coverage(sivm);
+		sivm->code[addr].handler = HANDLER_NATIVE;
+		mprotect(j->code, JIT_CODE_SIZE, PROT_READ | PROT_EXEC);
+		return true;
+	}
+
+	j->heat[addr] = 0;
+	mprotect(j->code, JIT_CODE_SIZE, PROT_READ | PROT_EXEC);
+	return false;
+}
+
+bool jit_execute(SIVM *sivm, uint64_t budget)
+{
+	jit *j = sivm->jit;
+	jit_exit exit = ((jit_native) j->blocks[sivm->pc].code)(sivm, (budget > MAX_BUDGET ? MAX_BUDGET : budget));
+
+	j->executed++;
+	sivm->pc = exit.pc;
+	sivm->retired += exit.retired;
+	if (exit.written != NO_WRITE)
+		sivm_invalidate(sivm, exit.written);
+	return exit.retired > 0;
+}
+
+void jit_invalidate(SIVM *sivm, REG addr)
+{
+	jit *j = sivm->jit;
+	if (! sivm_in_memory(sivm, addr) || ! j->covered[addr])
+		return;
+	//blocks span at most JIT_MAX_BLOCK instructions
+	for (int head = addr; head >= 0 && head > addr - JIT_MAX_BLOCK * MAX_INSTR_LENGTH; head--)
+		if (j->blocks[head].code && addr < head + j->blocks[head].span)
+			jit_drop(sivm, head);
+	jit_update_coverage(sivm);
+}
+
+#else /*__x86_64__*/
+
+bool jit_enable(SIVM *sivm)
+{
+	logm(LOG_WARNING, "The JIT is only available on x86-64 hosts");
+	return false;
+}
+
+void jit_disable(SIVM *sivm)
+{
+}
+
+bool jit_compile(SIVM *sivm, REG addr)
+{
+	return false;
+}
+
+bool jit_execute(SIVM *sivm, uint64_t budget)
+{
+	return false;
+}
+
+void jit_invalidate(SIVM *sivm, REG addr)
+{
+}
+
+#endif /*__x86_64__*/
+//@}
@@ -0,0 +1,72 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sivm.h"
+
+/**@name	JIT parameters*/
+//@{
+/**Number of entries in a block after which it is compiled to native code.*/
+#define JIT_THRESHOLD 50
+/**Maximum number of instructions in a compiled block.*/
+#define JIT_MAX_BLOCK 32
+/**Size of the executable memory holding native code, in bytes.
+ *All blocks are thrown away when it is full.
+ */
+#define JIT_CODE_SIZE (256 * 1024)
+/**Entry of sivm_run's dispatch table for instructions starting a compiled block.*/
+#define HANDLER_NATIVE (OPCODES_COUNT + FUSION_COUNT)
+//@}
+
+/**Native code for a block of instructions.*/
+typedef struct
+{
+	void *code;			/*!< entry point of the native code, NULL if the block isn't compiled */
+	uint16_t span;		/*!< number of words of the block */
+	uint16_t count;		/*!< maximum number of instructions the block can execute */
+} jit_block;
+
+/**Native code cache of an SIVM.
+ *@see	jit_enable
+ */
+typedef struct jit jit;
+struct jit
+{
+	uint8_t *code;				/*!< executable memory */
+	size_t used;				/*!< bytes of code already emitted */
+	uint16_t *heat;				/*!< number of entries of the block starting at each adress, one entry per word of memory */
+	jit_block *blocks;			/*!< compiled block starting at each adress, one entry per word of memory */
+	bool *covered;				/*!< whether each word is part of a compiled block */
+	uint64_t compiled;			/*!< number of blocks compiled */
+	uint64_t executed;			/*!< number of executions of native blocks */
+};
+
+/**Enables the JIT for the given SIVM.
+ *Blocks of instructions entered more than JIT_THRESHOLD times by sivm_run are then compiled to native code.
+ *@returns	false if the JIT is not available on this host (x86-64 only)
+ */
+bool jit_enable(SIVM *sivm);
+
+/**Disables the JIT for the given SIVM, and frees its native code.*/
+void jit_disable(SIVM *sivm);
+
+/**Compiles the block of instructions starting at the given adress.
+ *@returns	false if no instruction of the block can be compiled
+ */
+bool jit_compile(SIVM *sivm, REG addr);
+
+/**Executes the compiled block starting at PC.
+ *PC, SP, SR, registers and retired instructions count are updated, and words written by the block are invalidated.
+ *@param	budget	maximum number of instructions to execute, at least the block's count
+ *@returns	false if the block gave control back before executing any instruction, in which case the interpreter has to execute it
+ */
+bool jit_execute(SIVM *sivm, uint64_t budget);
+
+/**Throws away the compiled blocks containing the given adress.
+ *@see	sivm_invalidate
+ */
+void jit_invalidate(SIVM *sivm, REG addr);
+
+#endif /*JIT_H*/
@@ -0,0 +1,658 @@
+#include <stdlib.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "lockstep.h"
+#include "instructions.h"
+#include "flags.h"
+#include "engine.h"
+#include "util.h"
+
+/**@name	Row operations
+ *Operations on rows of lanes, only changing the lanes of the given bitfield.
+ *They are built from the lockstep.def template for each instruction set, and lockstep_select picks the widest one the CPU has.
+ */
+//@{
+struct lockstep_ops
+{
+	const char *name;
+	void (*add)(REG *dst, const REG *src, uint32_t mask);	/*!< dst += src */
+	void (*sub)(REG *dst, const REG *src, uint32_t mask);	/*!< dst -= src */
+	void (*and)(REG *dst, const REG *src, uint32_t mask);	/*!< dst &= src */
+	void (*or)(REG *dst, const REG *src, uint32_t mask);	/*!< dst |= src */
+	void (*mul)(REG *dst, const REG *src, uint32_t mask);	/*!< dst *= src, truncated */
+	void (*select)(REG *dst, const REG *src, uint32_t mask);	/*!< dst = src */
+	void (*fill)(REG *dst, REG value, uint32_t mask);		/*!< dst = value */
+	void (*offset)(REG *dst, REG value, uint32_t mask);		/*!< dst += value */
+	void (*shl)(REG *dst, REG count, uint32_t mask);		/*!< dst <<= count, count being less than 16 */
+	void (*shr)(REG *dst, REG count, uint32_t mask);		/*!< dst >>= count, count being less than 16 */
+	uint32_t (*zero)(const REG *row, uint32_t mask);		/*!< returns the lanes of mask that are 0 */
+	uint32_t (*at_min)(const REG *row, uint32_t mask, REG *min);	/*!< sets min to the lowest lane of mask, and returns the lanes of mask equal to it */
+};
+
+#define LOCKSTEP_PASTE(name, isa)	name##_##isa
+#define LOCKSTEP_NAME(name, isa)	LOCKSTEP_PASTE(name, isa)
+#define LOCKSTEP_QUOTE(isa)			#isa
+#define LOCKSTEP_STRING(isa)		LOCKSTEP_QUOTE(isa)
+#define LS(name)					LOCKSTEP_NAME(name, LOCKSTEP_ISA)
+
+/*Portable build, one lane at a time.*/
+#define LOCKSTEP_ISA	generic
+#define W				1
+#define V				REG
+#define VLOAD(p)		(*(p))
+#define VSTORE(p, v)	(*(p) = (v))
+#define VSET1(x)		((REG) (x))
+#define VADD(a, b)		((REG) ((a) + (b)))
+#define VSUB(a, b)		((REG) ((a) - (b)))
+#define VAND(a, b)		((REG) ((a) & (b)))
+#define VOR(a, b)		((REG) ((a) | (b)))
+#define VMUL(a, b)		((REG) ((unsigned) (a) * (b)))
+#define VMIN(a, b)		((a) < (b) ? (a) : (b))
+#define VEQ(a, b)		((a) == (b) ? UINT16_MAX : 0)
+#define VSHL(a, n)		((REG) ((a) << (n)))
+#define VSHR(a, n)		((REG) ((a) >> (n)))
+#define VBLEND(a, b, m)	((m) ? (b) : (a))
+#define VMASK(bits, i)	((bits) >> (i) & 1)
+#define VBITS(v)		((v) != 0)
+#include "lockstep.def"
+#undef LOCKSTEP_ISA
+#undef W
+#undef V
+#undef VLOAD
+#undef VSTORE
+#undef VSET1
+#undef VADD
+#undef VSUB
+#undef VAND
+#undef VOR
+#undef VMUL
+#undef VMIN
+#undef VEQ
+#undef VSHL
+#undef VSHR
+#undef VBLEND
+#undef VMASK
+#undef VBITS
+
+#if defined(__x86_64__)
+/*Vectors of 8 lanes, built for SSE4.1 whatever the flags of the compiler, and only used if the CPU has it.*/
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#define LOCKSTEP_ISA	sse41
+#define W				8
+#define V				__m128i
+#define VLOAD(p)		_mm_loadu_si128((const __m128i *) (p))
+#define VSTORE(p, v)	_mm_storeu_si128((__m128i *) (p), (v))
+#define VSET1(x)		_mm_set1_epi16((short) (x))
+#define VADD			_mm_add_epi16
+#define VSUB			_mm_sub_epi16
+#define VAND			_mm_and_si128
+#define VOR				_mm_or_si128
+#define VMUL			_mm_mullo_epi16
+#define VMIN			_mm_min_epu16
+#define VEQ				_mm_cmpeq_epi16
+#define VSHL(a, n)		_mm_sll_epi16((a), _mm_cvtsi32_si128(n))
+#define VSHR(a, n)		_mm_srl_epi16((a), _mm_cvtsi32_si128(n))
+#define VBLEND			_mm_blendv_epi8
+#define VLANES			_mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128)
+#define VMASK(bits, i)	_mm_cmpeq_epi16(_mm_and_si128(_mm_set1_epi16((short) ((bits) >> (i))), VLANES), VLANES)
+#define VBITS(v)		_mm_movemask_epi8(_mm_packs_epi16((v), _mm_setzero_si128()))
+#include "lockstep.def"
+#undef LOCKSTEP_ISA
+#undef W
+#undef V
+#undef VLOAD
+#undef VSTORE
+#undef VSET1
+#undef VADD
+#undef VSUB
+#undef VAND
+#undef VOR
+#undef VMUL
+#undef VMIN
+#undef VEQ
+#undef VSHL
+#undef VSHR
+#undef VBLEND
+#undef VLANES
+#undef VMASK
+#undef VBITS
+#pragma GCC pop_options
+
+/*Vectors of 16 lanes, a whole row at once.*/
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define LOCKSTEP_ISA	avx2
+#define W				16
+#define V				__m256i
+#define VLOAD(p)		_mm256_loadu_si256((const __m256i *) (p))
+#define VSTORE(p, v)	_mm256_storeu_si256((__m256i *) (p), (v))
+#define VSET1(x)		_mm256_set1_epi16((short) (x))
+#define VADD			_mm256_add_epi16
+#define VSUB			_mm256_sub_epi16
+#define VAND			_mm256_and_si256
+#define VOR				_mm256_or_si256
+#define VMUL			_mm256_mullo_epi16
+#define VMIN			_mm256_min_epu16
+#define VEQ				_mm256_cmpeq_epi16
+#define VSHL(a, n)		_mm256_sll_epi16((a), _mm_cvtsi32_si128(n))
+#define VSHR(a, n)		_mm256_srl_epi16((a), _mm_cvtsi32_si128(n))
+#define VBLEND			_mm256_blendv_epi8
+#define VLANES			_mm256_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, (short) 32768)
+#define VMASK(bits, i)	_mm256_cmpeq_epi16(_mm256_and_si256(_mm256_set1_epi16((short) ((bits) >> (i))), VLANES), VLANES)
+#define VBITS(v)		_mm_movemask_epi8(_mm_packs_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256((v), 1)))
+#include "lockstep.def"
+#undef LOCKSTEP_ISA
+#undef W
+#undef V
+#undef VLOAD
+#undef VSTORE
+#undef VSET1
+#undef VADD
+#undef VSUB
+#undef VAND
+#undef VOR
+#undef VMUL
+#undef VMIN
+#undef VEQ
+#undef VSHL
+#undef VSHR
+#undef VBLEND
+#undef VLANES
+#undef VMASK
+#undef VBITS
+#pragma GCC pop_options
+#endif /*__x86_64__*/
+
+/**Row operations of the widest instruction set of the CPU, NULL until lockstep_select is called.*/
+static const lockstep_ops *selected = NULL;
+
+/**Picks the row operations of the widest instruction set the CPU has, for the groups made from then on.
+ *Has to be called before groups are made from several threads.
+ *@returns	the name of the instruction set
+ */
+const char* lockstep_select(void)
+{
+	selected = &ops_generic;
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		selected = &ops_avx2;
+	else if (__builtin_cpu_supports("sse4.1"))
+		selected = &ops_sse41;
+#endif
+	return selected->name;
+}
+//@}
+
+
+/**@name	Groups*/
+//@{
+/*Row of the lanes of the word at the given adress.*/
+#define ROW(group, addr)	(&(group)->mem[(addr) * LOCKSTEP_LANES])
+
+/*Same as sivm_in_memory, for the geometry of a group.*/
+#define IN_MEMORY(group, addr)	((group)->outside ? ! ((addr) & (group)->outside) : (addr) < (group)->memsize)
+
+/*Iterates over the lanes of a bitfield, from the lowest one.*/
+#define FOR_LANES(lane, bits)	for (uint32_t left_ = (bits), lane = 0; left_ && (lane = __builtin_ctz(left_), true); left_ &= left_ - 1)
+
+/**Makes a group of the given SIVMs, loaded with the same program.
+ *They must have the same memory geometry, and no frame stack, hooks, JIT nor stop depth: their state is copied in the group, and written back to them once their lane stops.
+ *Row operations are the ones of lockstep_select, the portable ones if it wasn't called.
+ *@param	lanes	number of SIVMs, from 1 to LOCKSTEP_LANES
+ *@returns	false if the SIVMs can't run in a group, or there is no memory left for it
+ *@see	lockstep_free
+ */
+bool lockstep_new(lockstep *group, SIVM *sivms[], unsigned int lanes)
+{
+	SIVM *first = sivms[0];
+	unsigned int memsize = first->memsize;
+
+	*group = (lockstep) { .lanes = lanes, .memsize = memsize, .outside = first->outside, .sp_incr = first->sp_incr, .ops = (selected ? selected : &ops_generic) };
+	for (unsigned int lane = 0; lane < lanes; lane++)
+		if (sivms[lane]->memsize != memsize || sivms[lane]->sp_incr != first->sp_incr || sivms[lane]->frames || sivms[lane]->hooks || sivms[lane]->jit || sivms[lane]->stop_depth != -1)
+			return false;
+
+	group->mem = malloc(memsize * LOCKSTEP_LANES * sizeof(REG));
+	group->code = malloc(memsize * sizeof(decoded));
+	group->written = calloc(memsize, sizeof(bool));
+	if (! group->mem || ! group->code || ! group->written) {
+		logm(LOG_ERROR, "Not enough memory for a lockstep group of %u words", memsize);
+		lockstep_free(group);
+		return false;
+	}
+
+	memcpy(group->code, first->code, memsize * sizeof(decoded));
+	for (unsigned int lane = 0; lane < lanes; lane++) {
+		SIVM *sivm = sivms[lane];
+		group->sivm[lane] = sivm;
+		group->running |= 1u << lane;
+		group->retired[lane] = sivm->retired;
+		group->limit[lane] = SIVM_NO_BUDGET;
+		group->depth[lane] = sivm->depth;
+		group->pc[lane] = sivm->pc;
+		group->sp[lane] = sivm->sp;
+		group->sr[lane] = sivm->sr;
+		group->flag_src[lane] = sivm->flag_src;
+		group->flag_op[lane] = sivm->flag_op;
+		for (unsigned int i = 0; i < NREGS; i++)
+			group->reg[i][lane] = sivm->reg[i];
+		for (unsigned int addr = 0; addr < memsize; addr++) {
+			ROW(group, addr)[lane] = sivm->mem[addr].brut;
+			if (sivm->mem[addr].brut != first->mem[addr].brut)
+				group->written[addr] = true;
+		}
+	}
+	return true;
+}
+
+/**Frees the memory of a group, leaving the SIVMs of its lanes as they are.*/
+void lockstep_free(lockstep *group)
+{
+	free(group->mem);
+	free(group->code);
+	free(group->written);
+	group->mem = NULL;
+	group->code = NULL;
+	group->written = NULL;
+}
+
+/**Counts the instructions executed by all running lanes of a group in the retired count of each one.*/
+static void flush(lockstep *group)
+{
+	if (group->shared)
+		FOR_LANES(lane, group->running)
+			group->retired[lane] += group->shared;
+	group->shared = 0;
+}
+
+/**Stops the given lanes of a group, writing their state back to their SIVMs.
+ *Only the words that were written to in the group can differ from the SIVMs' memory.
+ *@returns	the lanes
+ */
+static uint32_t stop(lockstep *group, uint32_t lanes, lockstep_lane state)
+{
+	flush(group);
+	FOR_LANES(lane, lanes) {
+		SIVM *sivm = group->sivm[lane];
+		for (unsigned int addr = 0; addr < group->memsize; addr++)
+			if (group->written[addr] && sivm->mem[addr].brut != ROW(group, addr)[lane]) {
+				sivm->mem[addr].brut = ROW(group, addr)[lane];
+				sivm_invalidate(sivm, addr);
+			}
+		sivm->retired = group->retired[lane];
+		sivm->depth = group->depth[lane];
+		sivm->pc = group->pc[lane];
+		sivm->sp = group->sp[lane];
+		sivm->sr = group->sr[lane];
+		sivm->flag_src = group->flag_src[lane];
+		sivm->flag_op = group->flag_op[lane];
+		for (unsigned int i = 0; i < NREGS; i++)
+			sivm->reg[i] = group->reg[i][lane];
+		group->state[lane] = state;
+	}
+	group->running &= ~lanes;
+	return lanes;
+}
+//@}
+
+
+/**@name	Lockstep execution
+ *Same as sivm_run's fast paths, for the lanes of a group.
+ *@see	engine.def
+ */
+//@{
+/**Tells whether CALL saves the given register, as engine.c#SAVED_REG.*/
+#define SAVED_REG(i) ((i) < PARAM_REGS_START || (i) > PARAM_REGS_END)
+
+/**Tells whether the given number of words can be pushed by a lane from the given stack pointer, as engine.c#stack_can_push.*/
+static inline bool can_push(lockstep *group, REG sp, int count)
+{
+	for (int i = 0; i <= count; i++, sp += group->sp_incr)
+		if (! IN_MEMORY(group, sp))
+			return false;
+	return true;
+}
+
+/**Tells whether the given number of words can be popped by a lane from the given stack pointer, as engine.c#stack_can_pop.*/
+static inline bool can_pop(lockstep *group, REG sp, int count)
+{
+	for (int i = 0; i < count; i++)
+		if (! IN_MEMORY(group, sp -= group->sp_incr))
+			return false;
+	return true;
+}
+
+/**Reads the source operand of the given instruction for the given lanes.
+ *@returns	the lanes whose indirect adress is out of memory, which are left to sivm_run
+ */
+static uint32_t fetch(lockstep *group, decoded *d, uint32_t lanes, REG *row)
+{
+	uint32_t failed = 0;
+	switch (d->srcMode) {
+		case REGISTER:
+			memcpy(row, group->reg[d->source], LOCKSTEP_LANES * sizeof(REG));
+			break;
+		case IMMEDIATE:
+			group->ops->fill(row, d->srcWord, lanes);
+			break;
+		case DIRECT:
+			memcpy(row, ROW(group, d->srcWord), LOCKSTEP_LANES * sizeof(REG));
+			break;
+		default:
+			FOR_LANES(lane, lanes) {
+				REG addr = group->reg[d->source][lane];
+				if (IN_MEMORY(group, addr))
+					row[lane] = ROW(group, addr)[lane];
+				else
+					failed |= 1u << lane;
+			}
+			break;
+	}
+	return failed;
+}
+
+/**Keeps what the flags of the given lanes will be computed from, see flags.h.*/
+static inline void set_flags(lockstep *group, const REG *result, const REG *src, flags_op op, uint32_t lanes)
+{
+	group->ops->select(group->sr, result, lanes);
+	group->ops->select(group->flag_src, src, lanes);
+	group->ops->fill(group->flag_op, op, lanes);
+}
+
+/**Runs the given group for at most the given number of steps, each one executing an instruction for all running lanes on it.
+ *Lanes stop on HALT, once they reach their limit of instructions, or when they are ejected: instructions that aren't predecoded or were written to, faults, and block, bank, division, call and return instructions that can't go on as in engine.def are left to sivm_run in the lane's SIVM.
+ *All lanes are ejected once less than LOCKSTEP_MIN_LANES are running, or when they diverged too much over the last LOCKSTEP_WINDOW steps.
+ *@returns	the bitfield of the lanes that stopped, whose SIVMs are up to date, see lockstep.h#lockstep_lane
+ */
+uint32_t lockstep_run(lockstep *group, uint64_t steps)
+{
+	const lockstep_ops *ops = group->ops;
+	const int sp_incr = group->sp_incr;
+	uint32_t stopped = 0;
+	int saved = 0; //registers pushed by a CALL
+	for (int i = 0; i < NREGS; i++)
+		if (SAVED_REG(i))
+			saved++;
+	REG src[LOCKSTEP_LANES], row[LOCKSTEP_LANES];
+
+	uint32_t known = 0; //running lanes, as last counted
+	unsigned int count = 0;
+	uint64_t horizon = 0; //steps before a lane can reach its limit
+	bool together = false; //whether all running lanes are known to be on the same instruction
+	for (; steps && group->running; steps--) {
+		if (! horizon) {
+			flush(group);
+			FOR_LANES(lane, group->running)
+				if (group->retired[lane] >= group->limit[lane])
+					stopped |= stop(group, 1u << lane, LANE_BUDGET);
+			horizon = UINT64_MAX;
+			FOR_LANES(lane, group->running)
+				if (group->limit[lane] - group->retired[lane] < horizon)
+					horizon = group->limit[lane] - group->retired[lane];
+			together = false;
+			if (! group->running)
+				break;
+		}
+		if (group->running != known)
+			count = __builtin_popcount(known = group->running);
+		if (count < LOCKSTEP_MIN_LANES) {
+			stopped |= stop(group, group->running, LANE_EJECTED);
+			break;
+		}
+
+		REG pc;
+		uint32_t lanes, failed = 0, taken = 0;
+		if (together)
+			pc = group->pc[__builtin_ctz(lanes = group->running)];
+		else
+			lanes = ops->at_min(group->pc, group->running, &pc);
+		group->steps++;
+		group->executed += (lanes == group->running ? count : __builtin_popcount(lanes));
+		if (group->steps == LOCKSTEP_WINDOW) {
+			if (group->executed < group->steps * LOCKSTEP_DIVERGENCE) {
+				stopped |= stop(group, group->running, LANE_EJECTED);
+				break;
+			}
+			group->steps = group->executed = 0;
+		}
+		together = false;
+
+		decoded *d = &group->code[pc];
+		bool written = ! IN_MEMORY(group, pc) || d->status != DECODE_OK || d->breakpoint;
+		for (unsigned int i = 0; ! written && i < d->length; i++)
+			written = group->written[pc + i];
+		if (written) {
+			stopped |= stop(group, lanes, LANE_EJECTED);
+			continue;
+		}
+
+		REG last = pc + d->length - 1;
+		bool jumped = false, split = false;
+		switch (d->codeop) {
+#define ALU(operation, op) \
+			failed = fetch(group, d, lanes, src); \
+			lanes &= ~failed; \
+			ops->operation(group->reg[d->dest], src, lanes); \
+			set_flags(group, group->reg[d->dest], src, op, lanes); \
+			break;
+			case LOAD:
+				failed = fetch(group, d, lanes, src);
+				lanes &= ~failed;
+				ops->select(group->reg[d->dest], src, lanes);
+				break;
+			case STORE:
+				failed = fetch(group, d, lanes, src);
+				lanes &= ~failed;
+				if (d->destMode == DIRECT) {
+					ops->select(ROW(group, d->destWord), src, lanes);
+					group->written[d->destWord] = true;
+				}
+				else
+					FOR_LANES(lane, lanes) {
+						REG addr = group->reg[d->dest][lane];
+						if (! IN_MEMORY(group, addr))
+							failed |= 1u << lane;
+						else {
+							ROW(group, addr)[lane] = src[lane];
+							group->written[addr] = true;
+						}
+					}
+				break;
+			case MOV:	ALU(select, FLAGS_LOGIC);
+			case ADD:	ALU(add, FLAGS_ADD);
+			case SUB:	ALU(sub, FLAGS_SUB);
+			case AND:	ALU(and, FLAGS_LOGIC);
+			case OR:	ALU(or, FLAGS_LOGIC);
+			case MUL:	ALU(mul, FLAGS_LOGIC);
+#undef ALU
+			case SHL:
+			case SHR:
+				failed = fetch(group, d, lanes, src);
+				lanes &= ~failed;
+				if (d->srcMode == IMMEDIATE && d->srcWord < 16) {
+					if (d->codeop == SHL)
+						ops->shl(group->reg[d->dest], d->srcWord, lanes);
+					else
+						ops->shr(group->reg[d->dest], d->srcWord, lanes);
+				}
+				else
+					FOR_LANES(lane, lanes)
+						if (d->codeop == SHL)
+							group->reg[d->dest][lane] <<= src[lane];
+						else
+							group->reg[d->dest][lane] >>= src[lane];
+				set_flags(group, group->reg[d->dest], src, FLAGS_LOGIC, lanes);
+				break;
+			case CMP:
+				failed = fetch(group, d, lanes, src);
+				lanes &= ~failed;
+				memcpy(row, group->reg[d->dest], sizeof(row));
+				ops->sub(row, src, lanes);
+				set_flags(group, row, src, FLAGS_SUB, lanes);
+				break;
+			case DIV:
+			case MOD:
+				failed = fetch(group, d, lanes, src);
+				FOR_LANES(lane, lanes & ~failed)
+					if (! src[lane])
+						failed |= 1u << lane; //divisions by zero are left to sivm_step
+					else if (d->codeop == DIV)
+						group->reg[d->dest][lane] /= src[lane];
+					else
+						group->reg[d->dest][lane] %= src[lane];
+				lanes &= ~failed;
+				set_flags(group, group->reg[d->dest], src, FLAGS_LOGIC, lanes);
+				break;
+
+			case JMP:
+			case JEQ:
+			case JNE:
+			case JLT:
+			case JGE:
+			case JLE:
+			case JGT:
+			case JC:
+			case JNC:
+			case JO:
+			case JNO:
+				failed = fetch(group, d, lanes, src);
+				lanes &= ~failed;
+				if (d->codeop == JMP)
+					taken = lanes;
+				else if (d->codeop == JEQ)
+					taken = ops->zero(group->sr, lanes);
+				else if (d->codeop == JNE)
+					taken = lanes & ~ops->zero(group->sr, lanes);
+				else
+					FOR_LANES(lane, lanes)
+						if (flags_condition(d->codeop, flags_compute(group->sr[lane], group->flag_src[lane], group->flag_op[lane])))
+							taken |= 1u << lane;
+				if (d->srcMode == IMMEDIATE) {
+					//same target for all lanes, checked as engine.def#CHECK_JUMP
+					if (! IN_MEMORY(group, d->srcWord) || d->srcWord == last || d->srcWord == last - 1)
+						failed |= taken;
+					else
+						ops->fill(group->pc, (d->srcWord ? d->srcWord : 1), taken);
+				}
+				else
+					FOR_LANES(lane, taken) {
+						if (! IN_MEMORY(group, src[lane]) || src[lane] == last || src[lane] == last - 1)
+							failed |= 1u << lane;
+						else
+							group->pc[lane] = (src[lane] ? src[lane] : 1);
+					}
+				lanes &= ~failed;
+				taken &= lanes;
+				ops->offset(group->pc, d->length, lanes & ~taken);
+				jumped = true;
+				split = d->srcMode != IMMEDIATE || (taken && taken != lanes);
+				break;
+
+			case PUSH:
+				failed = fetch(group, d, lanes, src);
+				FOR_LANES(lane, lanes & ~failed) {
+					REG sp = group->sp[lane];
+					if (! can_push(group, sp, 1))
+						failed |= 1u << lane;
+					else {
+						ROW(group, sp)[lane] = src[lane];
+						group->written[sp] = true;
+						group->sp[lane] = sp + sp_incr;
+					}
+				}
+				lanes &= ~failed;
+				break;
+			case POP:
+				FOR_LANES(lane, lanes) {
+					REG sp = group->sp[lane];
+					if (! can_pop(group, sp, 1))
+						failed |= 1u << lane;
+					else {
+						sp -= sp_incr;
+						group->reg[d->dest][lane] = ROW(group, sp)[lane];
+						group->sp[lane] = sp;
+					}
+				}
+				lanes &= ~failed;
+				break;
+
+			case CALL:
+				failed = fetch(group, d, lanes, src);
+				FOR_LANES(lane, lanes & ~failed) {
+					REG sp = group->sp[lane], target = src[lane];
+					if (! IN_MEMORY(group, target) || target == last || target == last - 1 || ! can_push(group, sp, saved + 1)) {
+						failed |= 1u << lane;
+						continue;
+					}
+					ROW(group, sp)[lane] = last;
+					group->written[sp] = true;
+					sp += sp_incr;
+					for (int i = 0; i < NREGS; i++)
+						if (SAVED_REG(i)) {
+							ROW(group, sp)[lane] = group->reg[i][lane];
+							group->written[sp] = true;
+							sp += sp_incr;
+						}
+					group->sp[lane] = sp;
+					group->depth[lane]++;
+					group->pc[lane] = (target ? target : 1);
+				}
+				lanes &= ~failed;
+				jumped = true;
+				split = d->srcMode != IMMEDIATE;
+				break;
+			case RET:
+				FOR_LANES(lane, lanes) {
+					REG sp = group->sp[lane], target;
+					if (! can_pop(group, sp, saved + 1)) {
+						failed |= 1u << lane;
+						continue;
+					}
+					target = ROW(group, (REG) (sp - (saved + 1) * sp_incr))[lane];
+					if (target != UINT16_MAX && ! IN_MEMORY(group, target)) {
+						failed |= 1u << lane;
+						continue;
+					}
+					for (int i = NREGS - 1; i >= 0; i--)
+						if (SAVED_REG(i)) {
+							sp -= sp_incr;
+							group->reg[i][lane] = ROW(group, sp)[lane];
+						}
+					group->sp[lane] = sp - sp_incr;
+					if (group->depth[lane] > 0)
+						group->depth[lane]--;
+					group->pc[lane] = (target == UINT16_MAX ? 0 : target) + 1; //see increment_PC
+				}
+				lanes &= ~failed;
+				jumped = split = true;
+				break;
+
+			case HALT:
+				stopped |= stop(group, lanes, LANE_HALTED);
+				continue;
+			default:
+				failed = lanes;
+				lanes = 0;
+				break;
+		}
+
+		if (failed)
+			stopped |= stop(group, failed, LANE_EJECTED);
+		if (! jumped)
+			ops->offset(group->pc, d->length, lanes);
+		if (lanes == group->running)
+			group->shared++;
+		else
+			FOR_LANES(lane, lanes)
+				group->retired[lane]++;
+		horizon--;
+		together = (lanes == group->running && ! split);
+	}
+	flush(group);
+	return stopped;
+}
+//@}
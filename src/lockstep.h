@@ -0,0 +1,74 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sivm.h"
+
+/**@name	Lockstep groups
+ *SIVMs loaded with the same program, that only differ in their data, run as the lanes of a group: each instruction is executed at once for all lanes whose PC is on it.
+ *Registers and memory are stored in structure-of-arrays form, a row of LOCKSTEP_LANES words for each register and each adress, so that most instructions are a few vector operations on rows.
+ *The group always executes the instruction with the lowest PC of its running lanes: after a divergent branch, lanes that went ahead wait for the others to get there, and go on with them again.
+ *Anything out of the ordinary (faults, block instructions, banks, written code...) ejects the lanes concerned: their state is written back to their SIVM, which goes on with sivm_run, so that all checks and diagnostics stay the same.
+ *@see	lockstep.c#lockstep_run
+ */
+//@{
+/**Number of lanes of a group: 16-bit words of a 256-bit vector.*/
+#define LOCKSTEP_LANES 16
+/**Minimum number of running lanes for a group to be worth running, the remaining ones being ejected.*/
+#define LOCKSTEP_MIN_LANES 2
+/**Number of steps over which the divergence of a group is measured.*/
+#define LOCKSTEP_WINDOW 1024
+/**Groups whose steps executed less than LOCKSTEP_DIVERGENCE lanes on average over a window eject them all, sivm_run being faster then.*/
+#define LOCKSTEP_DIVERGENCE 8
+
+/**States of the lanes of a group.*/
+typedef enum
+{
+	LANE_RUNNING = 0,	/*!< the lane is run by the group */
+	LANE_HALTED,		/*!< a HALT instruction was reached, PC being left on it */
+	LANE_BUDGET,		/*!< the lane reached its limit of instructions */
+	LANE_EJECTED		/*!< the lane has to go on in its SIVM with sivm_run */
+} lockstep_lane;
+
+/**Vector operations on rows, built for each instruction set (see lockstep.c#lockstep_select).*/
+typedef struct lockstep_ops lockstep_ops;
+
+/**Lockstep group.
+ *Each lane's SIVM is left as it was given to lockstep_new while it runs in the group, and is brought up to date once the lane stops running.
+ */
+typedef struct
+{
+	unsigned int lanes;						/*!< number of lanes, at most LOCKSTEP_LANES */
+	uint32_t running;						/*!< bitfield of the running lanes */
+	SIVM *sivm[LOCKSTEP_LANES];				/*!< SIVM of each lane */
+	uint8_t state[LOCKSTEP_LANES];			/*!< state of each lane, see lockstep_lane */
+	uint64_t retired[LOCKSTEP_LANES];		/*!< number of instructions executed by each lane, see sivm.h#sivm */
+	uint64_t limit[LOCKSTEP_LANES];			/*!< number of instructions after which each lane stops, SIVM_NO_BUDGET by default */
+	uint64_t shared;						/*!< number of instructions executed by all running lanes, not counted in retired yet */
+	int depth[LOCKSTEP_LANES];				/*!< number of CALLs of each lane not returned from yet */
+	REG pc[LOCKSTEP_LANES];
+	REG sp[LOCKSTEP_LANES];
+	REG sr[LOCKSTEP_LANES];
+	REG flag_src[LOCKSTEP_LANES];
+	REG flag_op[LOCKSTEP_LANES];
+	REG reg[NREGS][LOCKSTEP_LANES];
+	REG *mem;								/*!< memory, a row of lanes for each adress */
+	decoded *code;							/*!< predecoded instructions of the first lane when the group was made */
+	bool *written;							/*!< whether the word at each adress may differ between lanes, in which case code doesn't hold for it */
+	unsigned int memsize;					/*!< see sivm.h#sivm */
+	unsigned int outside;					/*!< see sivm.h#sivm */
+	int sp_incr;							/*!< see sivm.h#sivm */
+	uint64_t steps;							/*!< number of steps of the current window, see LOCKSTEP_WINDOW */
+	uint64_t executed;						/*!< number of lanes that executed the steps of the current window */
+	const lockstep_ops *ops;				/*!< vector operations, see lockstep_select */
+} lockstep;
+
+const char* lockstep_select(void);
+bool lockstep_new(lockstep *group, SIVM *sivms[], unsigned int lanes);
+uint32_t lockstep_run(lockstep *group, uint64_t steps);
+void lockstep_free(lockstep *group);
+//@}
+
+#endif /*LOCKSTEP_H*/
@@ -15,17 +15,275 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <unistd.h>
 
 #include "debugger.h"
 #include "util.h"
 #include "cmd_word.h"
+#include "translator.h"
+#include "variant.h"
+#include "fleet.h"
+#include "scheduler.h"
+#include "sweep.h"
+#include "harts.h"
+#include "pipeline.h"
+
+/**
+ * @brief Parse the numerical value of an option
+ * @param value  the value given on the command line
+ * @param max    maximum legal value
+ * @param result set to the parsed value
+ * @returns false if the value isn't a number between 0 and max
+ */
+bool parse_option_value(char *value, unsigned long max, unsigned long *result)
+{
+    char *end;
+    *result = strtoul(value, &end, 0);
+    return value[0] != '\0' && value[0] != '-' && *end == '\0' && *result <= max;
+}
 
 int main(int argc, char *argv[])
 {
+    bool jit = false;
+    bool usage = false;
+    bool stack_start = false;
+    bool bank_size = false;
+    sivm_config config = SIVM_DEFAULT_CONFIG;
+    const sivm_variant *variant = &variants[0];
+    unsigned long value;
+
+    // global options, given before the command
+    int options = 0;
+    while (argc - options > 1 && !usage)
+    {
+        char *option = argv[1 + options];
+        if (!strcmp("--jit", option))
+        {
+            jit = true;
+            options++;
+        }
+        else if (!strcmp("--no-ansi", option))
+        {
+            log_ansi = false;
+            options++;
+        }
+        else if (!strcmp("--log-level", option) || !strcmp("--err-log-level", option) || !strcmp("--log-ring", option))
+        {
+            if (argc - options < 3 || !parse_option_value(argv[2 + options], LOG_DEBUG, &value))
+                usage = true;
+            else if (!strcmp("--log-level", option))
+                log_out_level = value;
+            else if (!strcmp("--err-log-level", option))
+                log_err_level = value;
+            else
+                log_ring_level = value;
+            options += 2;
+        }
+        else if (!strcmp("--stack-up", option))
+        {
+            config.sp_incr = 1;
+            options++;
+        }
+        else if (!strcmp("--variant", option))
+        {
+            if (argc - options < 3 || !variant_find(argv[2 + options]))
+                usage = true;
+            else
+                variant = variant_find(argv[2 + options]);
+            options += 2;
+        }
+        else if (!strcmp("--memsize", option) || !strcmp("--stack-start", option)
+                 || !strcmp("--banks", option) || !strcmp("--bank-size", option) || !strcmp("--frames", option))
+        {
+            if (argc - options < 3 || !parse_option_value(argv[2 + options], (strcmp("--memsize", option) && strcmp("--stack-start", option) ? MAX_MEMSIZE : UINT_MAX), &value))
+                usage = true;
+            else if (!strcmp("--memsize", option))
+                config.memsize = value;
+            else if (!strcmp("--banks", option))
+                config.banks = value;
+            else if (!strcmp("--frames", option))
+                config.frames = value;
+            else if (!strcmp("--bank-size", option))
+            {
+                config.bank_size = value;
+                bank_size = true;
+            }
+            else
+            {
+                config.sp_start = value;
+                stack_start = true;
+            }
+            options += 2;
+        }
+        else
+            break;
+    }
+    argv[options] = argv[0];
+    argv += options;
+    argc -= options;
+
+    // memory options are checked against the variant, whose adresses may be wider than the SIVM's
+    if (config.memsize > variant->max_memsize || (stack_start && config.sp_start >= variant->max_memsize) || (jit && variant->run))
+        usage = true;
+
+    // the stack follows the size of memory, unless its start is given
+    if (!stack_start)
+        config.sp_start = (config.sp_incr < 0 ? config.memsize - 1 : config.memsize / 2);
+    // the bank window takes all the adresses after memory, unless its size is given
+    if (!bank_size && config.memsize < MAX_MEMSIZE)
+        config.bank_size = MAX_MEMSIZE - config.memsize;
+
+    // illegal options: usage is displayed below
+    if (usage)
+        ;
+    // execute source or binary file in a variant other than the SIVM
+    else if (variant->run && ((argc == 2 && argv[1][0] != '-') || (argc == 3 && (!strncmp("--source", argv[1], 8) || !strncmp("-s", argv[1], 2)))))
+    {
+        ParserResult presult = { .high = NULL };
+        if (argc == 3)
+        {
+            if (!sivm_parse_file(&presult, argv[2]))
+                logm(LOG_FATAL_ERROR, "Unable to load / assemble file");
+        }
+        else
+            load_program(argv[1], &presult.mem, &presult.memsize);
+        if (!variant->run(&presult, &config))
+            return 1;
+    }
+    // run the jobs of a jobs file on a pool of threads
+    else if (!jit && !variant->run && argc >= 3 && !strcmp("--fleet", argv[1]))
+    {
+        sivm_fleet fleet;
+        long threads = sysconf(_SC_NPROCESSORS_ONLN);
+        bool lanes = false;
+        for (int i = 3; !usage && i < argc; i++)
+        {
+            if (!strcmp("--lockstep", argv[i]))
+                lanes = true;
+            else if (!strcmp("--threads", argv[i]) && i + 1 < argc && parse_option_value(argv[++i], FLEET_MAX_THREADS, &value) && value > 0)
+                threads = value;
+            else
+                usage = true;
+        }
+        if (!usage)
+        {
+            if (!fleet_load(&fleet, argv[2], &config))
+                return 1;
+            if (!fleet_run(&fleet, (threads > 0 ? threads : 1), lanes))
+                return 1;
+            fleet_print(&fleet, false);
+            fleet_free(&fleet);
+        }
+    }
+    // run a program for every value of one or two inputs
+    else if (!jit && !variant->run && argc >= 3 && !strcmp("--sweep", argv[1]))
+    {
+        sivm_sweep sweep;
+        long threads = sysconf(_SC_NPROCESSORS_ONLN);
+        int settings = argc - 3;
+        if (settings >= 2 && !strcmp("--threads", argv[argc - 2]))
+        {
+            usage = !parse_option_value(argv[argc - 1], FLEET_MAX_THREADS, &value) || value == 0;
+            threads = value;
+            settings -= 2;
+        }
+        if (!usage)
+        {
+            if (!sweep_new(&sweep, argv[2], argv + 3, settings, &config))
+                return 1;
+            if (!sweep_run(&sweep, (threads > 0 ? threads : 1)))
+                return 1;
+            sweep_print(&sweep);
+            sweep_free(&sweep);
+        }
+    }
+    // run a program on many harts sharing one memory
+    else if (!jit && !variant->run && argc >= 4 && !strcmp("--harts", argv[1]))
+    {
+        sivm_harts harts;
+        unsigned long nharts = 0, quantum = 0;
+        uint64_t budget = SIVM_NO_BUDGET;
+        bool parallel = false;
+        usage = !parse_option_value(argv[2], HARTS_MAX, &nharts) || nharts == 0;
+        for (int i = 4; !usage && i < argc; i++)
+        {
+            if (!strcmp("--parallel", argv[i]))
+                parallel = true;
+            else if (!strcmp("--quantum", argv[i]) && i + 1 < argc && parse_option_value(argv[++i], UINT_MAX, &value) && value > 0)
+                quantum = value;
+            else if (!strcmp("--budget", argv[i]) && i + 1 < argc && parse_option_value(argv[++i], ULONG_MAX, &value))
+                budget = value;
+            else
+                usage = true;
+        }
+        if (!usage)
+        {
+            if (!harts_new(&harts, argv[3], nharts, budget, &config))
+                return 1;
+            if (!harts_run(&harts, parallel, quantum))
+                return 1;
+            harts_print(&harts);
+            harts_free(&harts);
+        }
+    }
+    // run programs as the stages of a pipeline, connected by channels
+    else if (!jit && !variant->run && argc >= 3 && !strcmp("--pipeline", argv[1]))
+    {
+        sivm_pipeline pipeline;
+        unsigned long threads = 0, capacity = 0, quantum = 0;
+        uint64_t budget = SIVM_NO_BUDGET;
+        char *input = NULL;
+        int stages = 0;
+        while (2 + stages < argc && strncmp("--", argv[2 + stages], 2))
+            stages++;
+        usage = (stages == 0);
+        for (int i = 2 + stages; !usage && i < argc; i++)
+        {
+            if (!strcmp("--input", argv[i]) && i + 1 < argc)
+                input = argv[++i];
+            else if (!strcmp("--threads", argv[i]) && i + 1 < argc && parse_option_value(argv[++i], PIPELINE_MAX_STAGES, &value) && value > 0)
+                threads = value;
+            else if (!strcmp("--capacity", argv[i]) && i + 1 < argc && parse_option_value(argv[++i], UINT_MAX / 2, &value) && value > 0)
+                capacity = value;
+            else if (!strcmp("--quantum", argv[i]) && i + 1 < argc && parse_option_value(argv[++i], UINT_MAX, &value) && value > 0)
+                quantum = value;
+            else if (!strcmp("--budget", argv[i]) && i + 1 < argc && parse_option_value(argv[++i], ULONG_MAX, &value))
+                budget = value;
+            else
+                usage = true;
+        }
+        if (!usage)
+        {
+            if (!pipeline_new(&pipeline, argv + 2, stages, input, capacity, budget, &config))
+                return 1;
+            if (!pipeline_run(&pipeline, threads, quantum))
+                return 1;
+            pipeline_print(&pipeline);
+            pipeline_free(&pipeline);
+        }
+    }
+    // run the jobs of a jobs file on this thread, taking turns
+    else if (!jit && !variant->run && (argc == 3 || (argc == 5 && !strcmp("--quantum", argv[3]))) && !strcmp("--swarm", argv[1]))
+    {
+        sivm_fleet fleet;
+        if (argc == 5)
+            usage = !parse_option_value(argv[4], UINT_MAX, &value) || value == 0;
+        if (!usage)
+        {
+            if (!fleet_load(&fleet, argv[2], &config))
+                return 1;
+            if (!fleet_swarm(&fleet, (argc == 5 ? value : SCHEDULER_QUANTUM)))
+                return 1;
+            fleet_print(&fleet, true);
+            fleet_free(&fleet);
+        }
+    }
     // execute binary file
-    if (argc == 2 && argv[1][0] != '-')
+    else if (argc == 2 && argv[1][0] != '-')
     {
         Debugger debug;
+        debug.jit = jit;
+        debug.config = config;
         debugger_new(&debug, argv[1], false);
         debugger_start(&debug);
     }
@@ -37,20 +295,86 @@ int main(int argc, char *argv[])
             logm(LOG_FATAL_ERROR, "Unable to load / assemble file");
         save_program(argv[2], presult.mem, presult.memsize);
     }
+    // translate the source or binary file to C
+    else if (!variant->run && (argc == 4 || (argc == 5 && (!strncmp("--source", argv[3], 8) || !strncmp("-s", argv[3], 2))))
+             && (!strncmp("--translate", argv[1], 11) || !strncmp("-t", argv[1], 2)))
+    {
+        ParserResult presult;
+        if (argc == 5)
+        {
+            if (!sivm_parse_file(&presult, argv[4]))
+                logm(LOG_FATAL_ERROR, "Unable to load / assemble file");
+        }
+        else
+            load_program(argv[3], &presult.mem, &presult.memsize);
+        if (!translate_program(argv[2], presult.mem, presult.memsize, &config))
+            return 1;
+    }
     // execute source file
     else if (argc == 3 && (!strncmp("--source", argv[1], 8) || !strncmp("-s", argv[1], 2)))
     {
         Debugger debug;
+        debug.jit = jit;
+        debug.config = config;
         debugger_new(&debug, argv[2], true);
         debugger_start(&debug);
     }
     else
+        usage = true;
+
+    if (usage)
     {
         fprintf(stderr, "PROCSI emulator. Assemble, disassemble and execute PROCSI instructions.\n"
 						"Authors: Romain Giraud, Clément Léger, Matti Schneider-Ghibaudo. W00T!!\n"
 						"Usage: %s --compile, -c OUTPUT_FILE SOURCE_FILE\n"
-                        "       %s --source, -s SOURCE_FILE\n"
-                        "       %s BINARY_FILE\n", argv[0], argv[0], argv[0]);
+                        "       %s [MEMORY_OPTIONS] --translate, -t OUTPUT_C_FILE (BINARY_FILE | --source, -s SOURCE_FILE)\n"
+                        "       %s [--jit | --variant NAME] [MEMORY_OPTIONS] --source, -s SOURCE_FILE\n"
+                        "       %s [--jit | --variant NAME] [MEMORY_OPTIONS] BINARY_FILE\n"
+                        "       %s [MEMORY_OPTIONS] --fleet JOBS_FILE [--threads N] [--lockstep]\n"
+                        "       %s [MEMORY_OPTIONS] --swarm JOBS_FILE [--quantum N]\n"
+                        "       %s [MEMORY_OPTIONS] --sweep SOURCE_FILE [SETTING]... [--threads N]\n"
+                        "       %s [MEMORY_OPTIONS] --harts N SOURCE_FILE [--parallel] [--quantum N] [--budget N]\n"
+                        "       %s [MEMORY_OPTIONS] --pipeline SOURCE_FILE... [--input FILE] [--capacity N] [--threads N] [--quantum N] [--budget N]\n"
+                        "Options:\n"
+                        "  --jit              compile frequently executed code to native code (x86-64 only)\n"
+                        "  --variant NAME     run the program to HALT in the VM specialised for a width of words and a number of registers (see below) ;\n"
+                        "                     variants other than the default have no debugger, fault policy, banks, frames nor channels,\n"
+                        "                     and stop the program on its first fault\n"
+                        "  --fleet JOBS_FILE  run many jobs, one per line: SOURCE_FILE [budget=N] [Rn=VALUE]... [[ADDR]=VALUE]...\n"
+                        "                     and print their results, one line each (status, instructions, registers, fault)\n"
+                        "  --threads N        number of threads running the jobs, up to %d (default: number of processors)\n"
+                        "  --lockstep         run jobs of the same program by 16 in lockstep, with the widest vectors of the processor\n"
+                        "  --swarm JOBS_FILE  run the jobs of a jobs file on a single thread, each one in turn, and print their results\n"
+                        "                     with the number of turns of each job and its share of all instructions executed\n"
+                        "  --quantum N        number of instructions a job executes in a turn (default: %d)\n"
+                        "  --sweep SOURCE_FILE  run a program for every value of up to %d inputs, with settings budget=N (default: %d),\n"
+                        "                     output=Rn (default: R0), Rn=VALUES and [ADDR]=VALUES, VALUES being a value or a range LOW..HIGH,\n"
+                        "                     and print the number of instances by outcome, their instructions and the values of the output\n"
+                        "  --harts N SOURCE_FILE  run a program on N harts sharing memory, up to %d, each one with its number in R0\n"
+                        "                     and a stack of %d words after the one of the previous hart, and print their states ;\n"
+                        "                     harts take turns of --quantum instructions (default: %d), or run on threads of their own\n"
+                        "                     with --parallel, each one executing at most --budget instructions (default: no limit)\n"
+                        "  --pipeline SOURCE_FILE...  run programs as a pipeline, up to %d stages, each one reading the words written by\n"
+                        "                     the previous one with RECV, and writing words with SEND to the next one or to the output ;\n"
+                        "                     the first stage reads the words of the --input file, channels hold --capacity words\n"
+                        "                     (default: %d), and stages share --threads threads (default: one per stage, up to processors)\n"
+                        "Memory options:\n"
+                        "  --memsize N        number of words of memory, up to %d, or the maximum of the variant (default: %d)\n"
+                        "  --stack-start N    adress of the first word pushed (default: last word of memory, or middle of memory with --stack-up)\n"
+                        "  --stack-up         make the stack go through ascending adresses\n"
+                        "  --banks N          number of memory banks, selected with the BANK instruction (default: none)\n"
+                        "  --bank-size N      number of words of each bank, mapped right after memory (default: all the adresses after memory)\n"
+                        "  --frames N         save the registers of CALLs in a frame stack of at most N frames, out of memory, instead of the stack\n"
+                        "Logging options, given before any command (levels go from %d, fatal errors, to %d, debugging messages):\n"
+                        "  --log-level N      maximum level of messages displayed to stdout (default: %d)\n"
+                        "  --err-log-level N  maximum level of messages displayed to stderr, when not to stdout (default: %d)\n"
+                        "  --log-ring N       record messages up to level N in memory, and print the last %d ones on faults (default: none)\n"
+                        "  --no-ansi          don't color the output\n", argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], FLEET_MAX_THREADS, SCHEDULER_QUANTUM, SWEEP_MAX_RANGES, SWEEP_BUDGET, HARTS_MAX, HARTS_STACK, HARTS_QUANTUM, PIPELINE_MAX_STAGES, CHANNEL_CAPACITY, MAX_MEMSIZE, MEMSIZE,
+                        LOG_FATAL_ERROR, LOG_DEBUG, OUT_LOG_LEVEL, ERR_LOG_LEVEL, LOG_RING_SIZE);
+        fprintf(stderr, "Variants:\n");
+        for (unsigned int i = 0; i < variants_count; i++)
+            fprintf(stderr, "  %-18s %u-bit words, %u registers, up to %u words of memory%s\n", variants[i].name, variants[i].bits, variants[i].nregs, variants[i].max_memsize,
+                    (variants[i].run ? ", to HALT only" : " (default, in the debugger)"));
         return 1;
     }
 
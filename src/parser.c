@@ -13,6 +13,8 @@ typedef struct {
 
     REG pc;             /*!< currently location in memory */
     cmd_word* mem;      /*!< the whole memory */
+    REG* high;          /*!< high half of each word of the memory */
+    REG mhigh[3];       /*!< high half of each word of the instruction being parsed */
     int* pcline;        /*!< pcline[pc] => .procsi line (size of memsize) */
     REG memsize;        /*!< size of the memory */
     FILE* fp;           /*!< pointer to .procsi FILE */
@@ -39,6 +41,7 @@ LblListElm *lbllist_add(LblListElm *head, REG ptr, char *name, size_t len)
     newhead->pointer = ptr;
     newhead->name = malloc(len + 1);
     strncpy(newhead->name, name, len);
+    newhead->name[len] = '\0';
 
     return newhead;
 }
@@ -222,8 +225,7 @@ bool parse_number(Parser* parser, int* value, bool modifiable)
 bool parse_attrib(Parser *parser, PMode *pmode, int *data, int *reg)
 {
     bool ispointer = false,
-         isregister = false,
-         isimmediate = false;
+         isregister = false;
     int n;
     
     // skipy
@@ -241,7 +243,6 @@ bool parse_attrib(Parser *parser, PMode *pmode, int *data, int *reg)
     // immediat mode is specified by precessing the number by #
     if(*parser->cur == '#' && ispointer == false)
     {
-        isimmediate = true;
         parser->col++;
         parser->cur++;
     }
@@ -329,9 +330,15 @@ bool parse_dest(Parser* parser, cmd_word m[3], unsigned int *instrsize)
         return false;
     }
     if(dpmode == PM_REG || dpmode == PM_IND)
+    {
         m[0].codage.dest = dreg;
+        parser->mhigh[0] |= HIGH_REGISTERS(0, dreg);
+    }
     if(dpmode == PM_IMM || dpmode == PM_DIR)
+    {
+        parser->mhigh[*instrsize] = (unsigned) ddata >> 16;
         m[(*instrsize)++].brut = ddata;
+    }
     
     // guess the mode
     switch(dpmode)
@@ -378,9 +385,15 @@ bool parse_source(Parser* parser, cmd_word m[3], unsigned int *instrsize)
         return false;
     }
     if(spmode == PM_REG || spmode == PM_IND)
+    {
         m[0].codage.source = sreg;
+        parser->mhigh[0] |= HIGH_REGISTERS(sreg, 0);
+    }
     if(spmode == PM_IMM || spmode == PM_DIR)
+    {
+        parser->mhigh[*instrsize] = (unsigned) sdata >> 16;
         m[(*instrsize)++].brut = sdata;
+    }
     
     // guess the mode
     m[0].codage.mode = pseudomode_to_mode(parser, spmode, PM_REG);
@@ -421,9 +434,15 @@ bool parse_destsource(Parser* parser, cmd_word m[3], unsigned int *instrsize)
         return false;
     }
     if(dpmode == PM_REG || dpmode == PM_IND)
+    {
         m[0].codage.dest = dreg;
+        parser->mhigh[0] |= HIGH_REGISTERS(0, dreg);
+    }
     if(dpmode == PM_IMM || dpmode == PM_DIR)
+    {
+        parser->mhigh[*instrsize] = (unsigned) ddata >> 16;
         m[(*instrsize)++].brut = ddata;
+    }
     
     // assert there is a coma beteen source and destination
     if (*parser->cur == ',')
@@ -447,9 +466,15 @@ bool parse_destsource(Parser* parser, cmd_word m[3], unsigned int *instrsize)
         return false;
     }
     if(spmode == PM_REG || spmode == PM_IND)
+    {
         m[0].codage.source = sreg;
+        parser->mhigh[0] |= HIGH_REGISTERS(sreg, 0);
+    }
     if(spmode == PM_IMM || spmode == PM_DIR)
+    {
+        parser->mhigh[*instrsize] = (unsigned) sdata >> 16;
         m[(*instrsize)++].brut = sdata;
+    }
 
     for(; isblank(*parser->cur); parser->col++,parser->cur++)
     {}
@@ -460,6 +485,63 @@ bool parse_destsource(Parser* parser, cmd_word m[3], unsigned int *instrsize)
     return true;
 }
 
+/**Parses block and atomic instructions, having three registers: destination, source and count (in that order) for block ones
+ *@param    parser      pointer to the Parser structure
+ *@param    m           output array containing the instruction and its inline word
+ *@param    instrsize   size of the instruction, and then size of m array
+ *@returns	false if any error occurs
+ *@see	    instructions.h#BLOCK_OPERANDS
+ */
+bool parse_block(Parser* parser, cmd_word m[3], unsigned int *instrsize)
+{
+    int regs[3], data;
+    PMode pmode;
+
+    // assert there is at least one whitespace before
+    if(!isblank(*parser->cur))
+    {
+        logm(LOG_ERROR, "Unexpected token at %d:%d : `%c'",
+             parser->row, parser->col, *parser->cur);
+        return false;
+    }
+
+    for(int i = 0; i < 3; i++)
+    {
+        // assert there is a coma between registers
+        if(i > 0)
+        {
+            if(*parser->cur != ',')
+            {
+                logm(LOG_ERROR, "Unexpected token at %d:%d : `%c'",
+                     parser->row, parser->col, *parser->cur);
+                return false;
+            }
+            parser->cur++;
+            parser->col++;
+        }
+
+        if(!parse_attrib(parser, &pmode, &data, &regs[i]))
+        {
+            return false;
+        }
+        if(pmode != PM_REG || regs[i] >= NREGS)
+        {
+            logm(LOG_ERROR, "Block and atomic instructions only take registers at %d:%d",
+                 parser->row, parser->col);
+            return false;
+        }
+
+        for(; isblank(*parser->cur); parser->col++,parser->cur++)
+        {}
+    }
+
+    m[0].codage.mode = REGIMM;
+    m[0].codage.dest = regs[0];
+    m[(*instrsize)++].brut = BLOCK_OPERANDS(regs[1], regs[2]);
+
+    return true;
+}
+
 /**Parses a single instruction knowing it's opcode
  *@param    parser      pointer to the Parser structure
  *@param    m           output array containing the instruction (and value if needed)
@@ -469,6 +551,8 @@ bool parse_destsource(Parser* parser, cmd_word m[3], unsigned int *instrsize)
 bool parse_instruction(Parser* parser, cmd_word m[3], unsigned int *instrsize)
 {
     Instr instr = getInstruction(m[0]);
+    if (PACKED_INSTRUCTION(m[0].codage.codeop))
+        return parse_block(parser, m, instrsize);
     if (instr.source)
 	{
 		if (instr.destination)
@@ -492,7 +576,7 @@ bool parse_instruction(Parser* parser, cmd_word m[3], unsigned int *instrsize)
 bool parse_pass_line(Parser* parser, char *line)
 {
     char instr[256];
-    cmd_word m[3];
+    cmd_word m[3] = {{0}};
     unsigned int instrsize;
 
     parser->cur = line;
@@ -518,6 +602,7 @@ bool parse_pass_line(Parser* parser, char *line)
         }
 
         instrsize = 1;
+        memset(parser->mhigh, 0, sizeof(parser->mhigh));
         parser->cur += len;
         parser->col += len;
 
@@ -533,6 +618,18 @@ bool parse_pass_line(Parser* parser, char *line)
         else if(!strcasecmp(instr, "sub"))
             m[0].codage.codeop = SUB;
 
+        else if(!strcasecmp(instr, "cmp"))
+            m[0].codage.codeop = CMP;
+
+        else if(!strcasecmp(instr, "mul"))
+            m[0].codage.codeop = MUL;
+
+        else if(!strcasecmp(instr, "div"))
+            m[0].codage.codeop = DIV;
+
+        else if(!strcasecmp(instr, "mod"))
+            m[0].codage.codeop = MOD;
+
         else if(!strcasecmp(instr, "and"))
             m[0].codage.codeop = AND;
 
@@ -551,9 +648,62 @@ bool parse_pass_line(Parser* parser, char *line)
         else if(!strcasecmp(instr, "jeq"))
             m[0].codage.codeop = JEQ;
 
+        else if(!strcasecmp(instr, "jne"))
+            m[0].codage.codeop = JNE;
+
+        else if(!strcasecmp(instr, "jlt"))
+            m[0].codage.codeop = JLT;
+
+        else if(!strcasecmp(instr, "jge"))
+            m[0].codage.codeop = JGE;
+
+        else if(!strcasecmp(instr, "jle"))
+            m[0].codage.codeop = JLE;
+
+        else if(!strcasecmp(instr, "jgt"))
+            m[0].codage.codeop = JGT;
+
+        else if(!strcasecmp(instr, "jc"))
+            m[0].codage.codeop = JC;
+
+        else if(!strcasecmp(instr, "jnc"))
+            m[0].codage.codeop = JNC;
+
+        else if(!strcasecmp(instr, "jo"))
+            m[0].codage.codeop = JO;
+
+        else if(!strcasecmp(instr, "jno"))
+            m[0].codage.codeop = JNO;
+
         else if(!strcasecmp(instr, "call"))
             m[0].codage.codeop = CALL;
 
+        else if(!strcasecmp(instr, "memcpy"))
+            m[0].codage.codeop = MEMCPY;
+
+        else if(!strcasecmp(instr, "memset"))
+            m[0].codage.codeop = MEMSET;
+
+        else if(!strcasecmp(instr, "memcmp"))
+            m[0].codage.codeop = MEMCMP;
+        else if(!strcasecmp(instr, "bank"))
+            m[0].codage.codeop = BANK;
+
+        else if(!strcasecmp(instr, "cas"))
+            m[0].codage.codeop = CAS;
+
+        else if(!strcasecmp(instr, "fadd"))
+            m[0].codage.codeop = FADD;
+
+        else if(!strcasecmp(instr, "fence"))
+            m[0].codage.codeop = FENCE;
+
+        else if(!strcasecmp(instr, "send"))
+            m[0].codage.codeop = SEND;
+
+        else if(!strcasecmp(instr, "recv"))
+            m[0].codage.codeop = RECV;
+
         else if(!strcasecmp(instr, "ret"))
             m[0].codage.codeop = RET;
 
@@ -599,6 +749,7 @@ bool parse_pass_line(Parser* parser, char *line)
                 for(int i = 0; i < instrsize; i++)
                 {
                     parser->pcline[parser->pc] = parser->row;
+                    parser->high[parser->pc] = parser->mhigh[i];
                     parser->mem[parser->pc++].brut = m[i].brut;
                 }
             }
@@ -658,6 +809,7 @@ bool parse_first_pass(Parser* parser)
     // allocate the memory correspind size needed to write the code
     parser->mem = malloc(parser->memsize * sizeof(parser->mem[0]));
     parser->pcline = malloc(parser->memsize * sizeof(parser->pcline[0]));
+    parser->high = malloc(parser->memsize * sizeof(parser->high[0]));
     
     return true;
 }
@@ -710,6 +862,7 @@ bool sivm_parse(ParserResult *presult, FILE* f)
     // write
     presult->memsize = parser.memsize;
     presult->mem = parser.mem;
+    presult->high = parser.high;
     presult->pcline = parser.pcline;
     presult->labels_head = parser.labels;
 
@@ -736,6 +889,19 @@ bool sivm_parse_file(ParserResult *presult, char *file)
     return ret;
 }
 
+void sivm_parse_free(ParserResult *presult)
+{
+    for (LblListElm *label = presult->labels_head, *next; label; label = next)
+    {
+        next = lbllist_next(label);
+        free(label->name);
+        free(label);
+    }
+    free(presult->mem);
+    free(presult->high);
+    free(presult->pcline);
+}
+
 void save_program(char *filename, cmd_word mem[], int memsize)
 {
     FILE *f = fopen(filename, "wb");
@@ -49,10 +49,21 @@ LblListElm *lbllist_next(LblListElm *current);
 bool lbllist_get(LblListElm *head, char *name, size_t len, REG *pointer);
 //@}
 
+/**@name	Wide words
+ *Variants with 32-bit words (see variant.h) take the same assembled code, with the high half of each word kept apart.
+ *The high half of a command word holds the high bits of its register numbers, for variants with more than 8 registers ; the one of an inline word holds the high bits of its value.
+ */
+//@{
+#define HIGH_REGISTERS(source, dest)	((source) >> 3 | (dest) >> 3 << 4)
+#define HIGH_SOURCE(high)				((high) & 0xF)
+#define HIGH_DEST(high)					((high) >> 4 & 0xF)
+//@}
+
 typedef struct
 {
     int memsize; /*!< code's size in memory */
     cmd_word *mem; /*!< cmd_word array of size memsize, containing assembled code */
+    REG *high; /*!< REG array of size memsize, containing the high half of each word, NULL for binary files (see HIGH_REGISTERS) */
 
     LblListElm *labels_head; /*!< head of chained list of labels */
 
@@ -68,6 +79,11 @@ typedef struct
  */
 bool sivm_parse_file(ParserResult *presult, char *file);
 
+/**Frees what sivm_parse_file allocated in the given parser result
+ *@param    presult  pointer to a parser result filled by sivm_parse_file
+ */
+void sivm_parse_free(ParserResult *presult);
+
 /**Save the program into a file in a binary format
  *@param    filename file output
  *@param    mem      program
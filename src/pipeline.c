@@ -0,0 +1,340 @@
+#define _DEFAULT_SOURCE	/*clock_gettime, _SC_NPROCESSORS_ONLN*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "pipeline.h"
+#include "scheduler.h"
+#include "parser.h"
+#include "util.h"
+
+/**@name	Pipelines
+ *@see	pipeline.h
+ */
+//@{
+/**Thread running stages of a pipeline: stages first, first + step, first + 2 * step...*/
+typedef struct
+{
+	sivm_pipeline *pipeline;
+	unsigned int first;
+	unsigned int step;
+	sivm_scheduler scheduler;	/*!< scheduler whose task i is stage first + i * step */
+	channel_waiter waiter;		/*!< waiter of the channel ends of the stages */
+	pthread_t thread;
+} pipeline_thread;
+
+/**Fills the first channel of the given pipeline with the words of the given file, and closes it.
+ *Words are numbers, in decimal or in hexadecimal with the 0x prefix, separated by blanks.
+ *@param	file	the file of the words, NULL for the pipeline to have no input
+ *@returns	false if the file can't be read, holds something else than words, or there is no memory left for them
+ */
+static bool pipeline_input(sivm_pipeline *pipeline, const char *file)
+{
+	REG *words = NULL;
+	unsigned int nwords = 0, size = 0;
+	FILE *in = NULL;
+	long word;
+	int read = EOF; //what fscanf returned, 2 once an error was reported
+
+	if (file && ! (in = fopen(file, "r"))) {
+		logm(LOG_ERROR, "Unable to open input file `%s'", file);
+		return false;
+	}
+	while (in && (read = fscanf(in, "%li", &word)) == 1) {
+		if (word < -(1L << (8 * sizeof(REG) - 1)) || word >= (1L << (8 * sizeof(REG)))) {
+			logm(LOG_ERROR, "Input word %u of `%s' doesn't fit in a register: %ld", nwords + 1, file, word);
+			read = 2;
+			break;
+		}
+		if (nwords == size) {
+			REG *more = realloc(words, (size = (size ? 2 * size : 256)) * sizeof(REG));
+			if (! more) {
+				logm(LOG_ERROR, "Not enough memory for %u input words", size);
+				read = 2;
+				break;
+			}
+			words = more;
+		}
+		words[nwords++] = word;
+	}
+	if (in)
+		fclose(in);
+	if (read != EOF) {
+		if (read == 0)
+			logm(LOG_ERROR, "Input file `%s' holds something else than words after word %u", file, nwords);
+		free(words);
+		return false;
+	}
+
+	sivm_channel *channel = &pipeline->channels[0];
+	if (! channel_new(channel, nwords)) {
+		free(words);
+		return false;
+	}
+	pipeline->nchannels++;
+	for (unsigned int i = 0; i < nwords; i++)
+		channel_send(channel, words[i]);
+	channel_close(&channel->producer, &channel->consumer);
+	free(words);
+	return true;
+}
+
+/**Makes a pipeline of the programs of the given source files, in order.
+ *@param	input		file of the words read by the first stage, NULL for none (see pipeline_input)
+ *@param	capacity	number of words of the channels between stages, CHANNEL_CAPACITY if 0
+ *@param	budget		maximum number of instructions executed by each stage, SIVM_NO_BUDGET for none
+ *@returns	false if a program can't be assembled or doesn't fit in memory, or the input can't be read, in which case the pipeline must not be used
+ *@see	pipeline_free
+ */
+bool pipeline_new(sivm_pipeline *pipeline, char **files, unsigned int nstages, const char *input, unsigned int capacity, uint64_t budget, const sivm_config *config)
+{
+	*pipeline = (sivm_pipeline) { .stages = NULL };
+	if (nstages == 0 || nstages > PIPELINE_MAX_STAGES) {
+		logm(LOG_ERROR, "Illegal number of stages: %u (maximum is %d)", nstages, PIPELINE_MAX_STAGES);
+		return false;
+	}
+	pipeline->stages = calloc(nstages, sizeof(pipeline_stage));
+	pipeline->channels = calloc(nstages + 1, sizeof(sivm_channel));
+	if (! pipeline->stages || ! pipeline->channels) {
+		logm(LOG_ERROR, "Not enough memory for %u stages", nstages);
+		pipeline_free(pipeline);
+		return false;
+	}
+	if (! pipeline_input(pipeline, input)) {
+		pipeline_free(pipeline);
+		return false;
+	}
+	for (; pipeline->nchannels <= nstages; pipeline->nchannels++)
+		if (! channel_new(&pipeline->channels[pipeline->nchannels], capacity)) {
+			pipeline_free(pipeline);
+			return false;
+		}
+
+	for (unsigned int i = 0; i < nstages; i++) {
+		pipeline_stage *stage = &pipeline->stages[i];
+		ParserResult program = { .high = NULL };
+		if (! sivm_parse_file(&program, files[i])) {
+			logm(LOG_ERROR, "Unable to load / assemble file `%s'", files[i]);
+			pipeline_free(pipeline);
+			return false;
+		}
+		if (program.memsize > config->memsize) {
+			logm(LOG_ERROR, "Program `%s' is too big (%d words, memsize being %u)", files[i], program.memsize, config->memsize);
+			sivm_parse_free(&program);
+			pipeline_free(pipeline);
+			return false;
+		}
+		if (! sivm_new(&stage->sivm, config)) {
+			sivm_parse_free(&program);
+			pipeline_free(pipeline);
+			return false;
+		}
+		pipeline->nstages++;
+		sivm_load(&stage->sivm, program.memsize, program.mem);
+		sivm_parse_free(&program);
+		stage->sivm.input = &pipeline->channels[i];
+		stage->sivm.output = &pipeline->channels[i + 1];
+		stage->budget = budget;
+		stage->stop = SIVM_BUDGET;
+	}
+	return true;
+}
+
+/**Frees the given pipeline, its stages and its channels.*/
+void pipeline_free(sivm_pipeline *pipeline)
+{
+	for (unsigned int i = 0; i < pipeline->nstages; i++)
+		sivm_free(&pipeline->stages[i].sivm);
+	for (unsigned int i = 0; i < pipeline->nchannels; i++)
+		channel_free(&pipeline->channels[i]);
+	free(pipeline->stages);
+	free(pipeline->channels);
+	*pipeline = (sivm_pipeline) { .stages = NULL };
+}
+
+/**Publishes the counts of the channel ends of the given stage of a pipeline, for the stages around it to see all the words it wrote and read.
+ *@param	over	whether the stage stopped, in which case its channel ends are closed
+ */
+static void pipeline_flush(sivm_pipeline *pipeline, unsigned int stage, bool over)
+{
+	sivm_channel *input = &pipeline->channels[stage], *output = &pipeline->channels[stage + 1];
+	if (over) {
+		channel_close(&input->consumer, &input->producer);
+		channel_close(&output->producer, &output->consumer);
+		return;
+	}
+	if (input->consumer.count != input->consumer.shared)
+		channel_publish(&input->consumer, &input->producer);
+	if (output->producer.count != output->producer.shared)
+		channel_publish(&output->producer, &output->consumer);
+}
+
+/**Makes the tasks of the given thread that can go on after blocking on a channel runnable again.
+ *@returns	the number of tasks woken up
+ */
+static unsigned int pipeline_wake(pipeline_thread *thread)
+{
+	sivm_scheduler *scheduler = &thread->scheduler;
+	unsigned int woken = 0;
+	for (unsigned int i = 0; scheduler->nblocked && i < scheduler->ntasks; i++) {
+		SIVM *sivm = scheduler->tasks[i].sivm;
+		if (scheduler->tasks[i].blocked && ! channel_waits(sivm, sivm->mem[sivm->pc].codage.codeop)) {
+			scheduler_wake(scheduler, i);
+			thread->pipeline->stages[thread->first + i * thread->step].waits++;
+			woken++;
+		}
+	}
+	return woken;
+}
+
+/**Runs the stages of the given thread until they all stopped.
+ *After each round of its scheduler, the thread flushes the channel ends of its stages, closes the ones of the stages that stopped, and wakes up the stages that can go on ; when all the stages left are blocked, it sleeps until another thread changes one of their channels.
+ */
+static void* pipeline_work(void *data)
+{
+	pipeline_thread *thread = data;
+	sivm_scheduler *scheduler = &thread->scheduler;
+	bool *over = calloc(scheduler->ntasks, sizeof(bool)); //stages whose channels are closed
+
+	while (scheduler->nrunnable || scheduler->nblocked) {
+		scheduler_run(scheduler, 1);
+		for (unsigned int i = 0; i < scheduler->ntasks; i++)
+			if (! over || ! over[i]) {
+				bool parked = scheduler->tasks[i].parked;
+				pipeline_flush(thread->pipeline, thread->first + i * thread->step, parked);
+				if (over)
+					over[i] = parked;
+			}
+		if (pipeline_wake(thread) || scheduler->nrunnable || ! scheduler->nblocked)
+			continue;
+		channel_prepare_sleep(&thread->waiter);
+		if (pipeline_wake(thread))
+			__atomic_store_n(&thread->waiter.sleeping, 0, __ATOMIC_RELAXED);
+		else
+			channel_sleep(&thread->waiter);
+	}
+	free(over);
+	return NULL;
+}
+
+/**Prints the words written by the last stage of the given pipeline as they come, until it stops, one per line.
+ *@param	waiter	waiter of the calling thread, woken up by the last stage
+ */
+static void pipeline_drain(sivm_pipeline *pipeline, channel_waiter *waiter)
+{
+	sivm_channel *channel = &pipeline->channels[pipeline->nstages];
+	for (;;) {
+		bool over = channel_closed(&channel->producer); //before looking for words, for none to be sent in between
+		while (channel_can_recv(channel))
+			printf("%u\n", channel_recv(channel));
+		if (over)
+			break;
+		channel_publish(&channel->consumer, &channel->producer);
+		channel_prepare_sleep(waiter);
+		if (channel_can_recv(channel) || channel_closed(&channel->producer))
+			__atomic_store_n(&waiter->sleeping, 0, __ATOMIC_RELAXED);
+		else
+			channel_sleep(waiter);
+	}
+	channel_close(&channel->consumer, &channel->producer);
+	fflush(stdout);
+}
+
+/**Runs the given pipeline until all of its stages stopped, printing the words written by the last one.
+ *Stages are spread over the threads in turn, the calling thread printing the output.
+ *@param	nthreads	number of threads running the stages, the number of stages at most, or the number of processors if 0
+ *@param	quantum		number of instructions a stage executes in a turn, SCHEDULER_QUANTUM if 0
+ *@returns	false if there is no memory left to run the stages, or a thread can't be started
+ *@see	pipeline_print
+ */
+bool pipeline_run(sivm_pipeline *pipeline, unsigned int nthreads, unsigned int quantum)
+{
+	pipeline_thread *threads;
+	channel_waiter sink;
+	unsigned int started = 0;
+	bool ok = true;
+	struct timespec begin, end;
+
+	if (nthreads == 0) {
+		long processors = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = (processors > 0 ? processors : 1);
+	}
+	if (nthreads > pipeline->nstages)
+		nthreads = pipeline->nstages;
+	if (! (threads = calloc(nthreads, sizeof(pipeline_thread)))) {
+		logm(LOG_ERROR, "Not enough memory for %u threads", nthreads);
+		return false;
+	}
+
+	channel_waiter_new(&sink);
+	pipeline->channels[pipeline->nstages].consumer.waiter = &sink;
+	for (unsigned int t = 0; t < nthreads; t++) {
+		pipeline_thread *thread = &threads[t];
+		*thread = (pipeline_thread) { .pipeline = pipeline, .first = t, .step = nthreads };
+		scheduler_new(&thread->scheduler, quantum);
+		channel_waiter_new(&thread->waiter);
+		for (unsigned int i = t; ok && i < pipeline->nstages; i += nthreads) {
+			ok = (scheduler_add(&thread->scheduler, &pipeline->stages[i].sivm, pipeline->stages[i].budget) >= 0);
+			pipeline->channels[i].consumer.waiter = &thread->waiter;
+			pipeline->channels[i + 1].producer.waiter = &thread->waiter;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	if (! ok)
+		logm(LOG_ERROR, "Not enough memory to schedule %u stages", pipeline->nstages);
+	for (; ok && started < nthreads; started++)
+		if (pthread_create(&threads[started].thread, NULL, pipeline_work, &threads[started])) {
+			logm(LOG_ERROR, "Unable to start more than %u threads", started);
+			ok = false;
+		}
+	if (ok)
+		pipeline_drain(pipeline, &sink);
+	else { //the stages that run end with the ones that can't
+		for (unsigned int i = 0; i < pipeline->nstages; i++)
+			if (i % nthreads >= started)
+				pipeline_flush(pipeline, i, true);
+		channel_close(&pipeline->channels[pipeline->nstages].consumer, &pipeline->channels[pipeline->nstages].producer);
+	}
+	for (unsigned int t = 0; t < started; t++)
+		pthread_join(threads[t].thread, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	uint64_t retired = 0;
+	for (unsigned int t = 0; t < nthreads; t++) {
+		pipeline_thread *thread = &threads[t];
+		for (unsigned int i = 0; i < thread->scheduler.ntasks; i++)
+			pipeline->stages[thread->first + i * thread->step].stop = thread->scheduler.tasks[i].stop;
+		scheduler_free(&thread->scheduler);
+		channel_waiter_free(&thread->waiter);
+	}
+	for (unsigned int i = 0; i < pipeline->nstages; i++)
+		retired += pipeline->stages[i].sivm.retired;
+	if (ok)
+		logm(LOG_SUMMARY, "%u stages on %u threads, %llu instructions in %.3f s", pipeline->nstages, nthreads, (unsigned long long) retired,
+			 (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9);
+
+	channel_waiter_free(&sink);
+	free(threads);
+	return ok;
+}
+
+/**Prints the state of each stage of the given pipeline once they stopped, one line each.
+ *Lines hold, separated by tabs: the number of the stage, its status, the number of instructions it executed, its registers, the number of times it blocked on a channel, and the message of its fault if any.
+ */
+void pipeline_print(const sivm_pipeline *pipeline)
+{
+	for (unsigned int i = 0; i < pipeline->nstages; i++) {
+		pipeline_stage *stage = &pipeline->stages[i];
+		SIVM *sivm = &stage->sivm;
+		printf("%u\t%s\t%llu\tPC=%u SR=%u SP=%u", i, (stage->stop == SIVM_HALT ? "halted" : (stage->stop == SIVM_FAULT ? "fault" : "budget")),
+			   (unsigned long long) sivm->retired, sivm->pc, sivm_flags(sivm), sivm->sp);
+		for (unsigned int reg = 0; reg < NREGS; reg++)
+			printf(" R%u=%u", reg, sivm->reg[reg]);
+		printf("\twaits=%llu", (unsigned long long) stage->waits);
+		printf((stage->stop == SIVM_FAULT ? "\t%s\n" : "\n"), sivm->fault_message);
+	}
+}
+//@}
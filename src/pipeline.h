@@ -0,0 +1,46 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sivm.h"
+#include "engine.h"
+#include "channel.h"
+
+/**@name	Pipelines
+ *Dataflow pipeline of SIVMs, its stages, each one running its own program: stage i reads the words written by stage i - 1 with RECV, and writes the words stage i + 1 reads with SEND (see channel.h).
+ *The first stage reads the words of the input, and the words written by the last stage are printed as they come, one per line.
+ *Stages are spread over threads in turn, each thread being a cooperative scheduler of its stages (see scheduler.h): a stage blocked on a channel is left out of the turns until the other end of the channel changes, and the thread sleeps when all of its stages are blocked, so that no thread ever spins on a channel.
+ *A stage that halts, faults or spends its budget closes both of its channels: the next stage reads what's left then finds the end of its input, and the words the previous stage still writes are dropped.
+ *@see	pipeline.c#pipeline_run
+ */
+//@{
+/**Maximum number of stages.*/
+#define PIPELINE_MAX_STAGES 64
+
+/**Stage of a pipeline.*/
+typedef struct
+{
+	SIVM sivm;			/*!< SIVM of the stage, whose input and output are the channels around it */
+	uint64_t budget;	/*!< maximum number of instructions to execute, SIVM_NO_BUDGET for none */
+	sivm_stop stop;		/*!< why sivm_run last returned, see sivm_run */
+	uint64_t waits;		/*!< number of times the stage blocked on a channel */
+} pipeline_stage;
+
+/**Pipeline.*/
+typedef struct
+{
+	pipeline_stage *stages;
+	unsigned int nstages;
+	sivm_channel *channels;	/*!< nstages + 1 channels, channel i feeding stage i, the last one feeding the output */
+	unsigned int nchannels;	/*!< number of channels made */
+} sivm_pipeline;
+
+bool pipeline_new(sivm_pipeline *pipeline, char **files, unsigned int nstages, const char *input, unsigned int capacity, uint64_t budget, const sivm_config *config);
+bool pipeline_run(sivm_pipeline *pipeline, unsigned int nthreads, unsigned int quantum);
+void pipeline_print(const sivm_pipeline *pipeline);
+void pipeline_free(sivm_pipeline *pipeline);
+//@}
+
+#endif /*PIPELINE_H*/
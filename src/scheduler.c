@@ -0,0 +1,115 @@
+#include <stdlib.h>
+
+#include "scheduler.h"
+#include "util.h"
+
+/**@name	Cooperative scheduling
+ *@see	scheduler.h
+ */
+//@{
+/**Makes an empty scheduler.
+ *@param	quantum	fuel given to a task for a turn, SCHEDULER_QUANTUM if 0
+ *@see	scheduler_free
+ */
+void scheduler_new(sivm_scheduler *scheduler, unsigned int quantum)
+{
+	*scheduler = (sivm_scheduler) { .quantum = (quantum ? quantum : SCHEDULER_QUANTUM) };
+}
+
+/**Adds a runnable task to the given scheduler, for the given SIVM.
+ *The SIVM is only run by scheduler_run from then on, and isn't freed by the scheduler.
+ *@param	budget	maximum number of instructions the task executes, SIVM_NO_BUDGET for none
+ *@returns	the index of the task, -1 if there is no memory left for it
+ */
+int scheduler_add(sivm_scheduler *scheduler, SIVM *sivm, uint64_t budget)
+{
+	if (scheduler->ntasks == scheduler->capacity) {
+		unsigned int capacity = (scheduler->capacity ? 2 * scheduler->capacity : 64);
+		scheduler_task *tasks = realloc(scheduler->tasks, capacity * sizeof(scheduler_task));
+		if (tasks)
+			scheduler->tasks = tasks;
+		unsigned int *runnable = realloc(scheduler->runnable, capacity * sizeof(unsigned int));
+		if (runnable)
+			scheduler->runnable = runnable;
+		if (! tasks || ! runnable) {
+			logm(LOG_ERROR, "Not enough memory for %u tasks", capacity);
+			return -1;
+		}
+		scheduler->capacity = capacity;
+	}
+
+	unsigned int index = scheduler->ntasks++;
+	scheduler->tasks[index] = (scheduler_task) { .sivm = sivm, .budget = budget, .parked = (budget == 0), .stop = SIVM_BUDGET };
+	if (budget)
+		scheduler->runnable[scheduler->nrunnable++] = index;
+	return index;
+}
+
+/**Runs at most the given number of rounds of the given scheduler, each one giving a quantum of fuel to all runnable tasks in turn.
+ *A task is parked once sivm_run returns for another reason than running out of fuel (HALT, a fault, a breakpoint...), or once its budget is spent ; a task blocked on a channel is only left out until it's woken up.
+ *Tasks that are still runnable keep their order, for the next round to go through memory in the same direction.
+ *@param	rounds	maximum number of rounds, UINT64_MAX to run until all tasks are parked or blocked
+ *@returns	the number of runnable tasks left
+ */
+unsigned int scheduler_run(sivm_scheduler *scheduler, uint64_t rounds)
+{
+	const uint64_t quantum = scheduler->quantum;
+	scheduler_task *tasks = scheduler->tasks;
+	unsigned int *runnable = scheduler->runnable;
+
+	for (; rounds && scheduler->nrunnable; rounds--) {
+		unsigned int kept = 0;
+		for (unsigned int i = 0; i < scheduler->nrunnable; i++) {
+			scheduler_task *task = &tasks[runnable[i]];
+			SIVM *sivm = task->sivm;
+			uint64_t left = task->budget - task->used, start = sivm->retired;
+
+			task->stop = sivm_run(sivm, (left < quantum ? left : quantum));
+			task->used += sivm->retired - start;
+			task->turns++;
+			scheduler->used += sivm->retired - start;
+			if (task->stop == SIVM_BUDGET && task->used < task->budget)
+				runnable[kept++] = runnable[i];
+			else if (task->stop == SIVM_BLOCKED) {
+				task->blocked = true;
+				scheduler->nblocked++;
+			}
+			else
+				task->parked = true;
+		}
+		scheduler->nrunnable = kept;
+		scheduler->rounds++;
+	}
+	return scheduler->nrunnable;
+}
+
+/**Makes the given blocked task of the given scheduler runnable again, for its SEND or RECV to be tried again in the next round.
+ *The task takes its place among the runnable ones in the order tasks were added.
+ */
+void scheduler_wake(sivm_scheduler *scheduler, unsigned int task)
+{
+	unsigned int i = scheduler->nrunnable++;
+	for (; i > 0 && scheduler->runnable[i - 1] > task; i--)
+		scheduler->runnable[i] = scheduler->runnable[i - 1];
+	scheduler->runnable[i] = task;
+	scheduler->tasks[task].blocked = false;
+	scheduler->tasks[task].stop = SIVM_BUDGET;
+	scheduler->nblocked--;
+}
+
+/**Tells which part of the fuel used by all tasks of the given scheduler was used by the given one.
+ *@returns	the CPU share of the task, from 0 to 1
+ */
+double scheduler_share(const sivm_scheduler *scheduler, unsigned int task)
+{
+	return (scheduler->used ? (double) scheduler->tasks[task].used / scheduler->used : 0);
+}
+
+/**Frees the memory of the given scheduler, leaving the SIVMs of its tasks as they are.*/
+void scheduler_free(sivm_scheduler *scheduler)
+{
+	free(scheduler->tasks);
+	free(scheduler->runnable);
+	*scheduler = (sivm_scheduler) { .quantum = scheduler->quantum };
+}
+//@}
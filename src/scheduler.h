@@ -0,0 +1,56 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sivm.h"
+#include "engine.h"
+
+/**@name	Cooperative scheduling
+ *Many SIVMs multiplexed on the calling thread: each runnable SIVM is given a quantum of fuel, a number of instructions to execute with sivm_run, in turn.
+ *An SIVM holds all of its state, so that switching from one to the next is nothing more than taking the next pointer.
+ *Runnable tasks are visited in the order they were added, which is the order of their SIVMs in memory when they come from a single array, and tasks that stop are parked: they're left out of the next rounds.
+ *Tasks blocked on a channel (see channel.h) are left out of the rounds too, until scheduler_wake makes them runnable again.
+ *Fuel is also what the CPU share of each task is measured in.
+ *@see	scheduler.c#scheduler_run
+ */
+//@{
+/**Fuel given to each task for a turn when none is given.*/
+#define SCHEDULER_QUANTUM 1000
+
+/**Task of a scheduler.*/
+typedef struct
+{
+	SIVM *sivm;
+	uint64_t budget;	/*!< maximum number of instructions to execute, SIVM_NO_BUDGET for none */
+	uint64_t used;		/*!< fuel used: number of instructions executed under the scheduler */
+	uint64_t turns;		/*!< number of quanta the task was given */
+	bool parked;		/*!< whether the task stopped, see stop */
+	bool blocked;		/*!< whether the task waits on a channel, see scheduler_wake */
+	sivm_stop stop;		/*!< why sivm_run last returned: SIVM_BUDGET when the task is runnable or spent its budget, SIVM_BLOCKED while it's blocked, see sivm_run for the others */
+} scheduler_task;
+
+/**Scheduler, whose tasks are only run by the thread calling scheduler_run.*/
+typedef struct
+{
+	unsigned int quantum;		/*!< fuel given to a task for a turn */
+	scheduler_task *tasks;		/*!< tasks, in the order they were added */
+	unsigned int ntasks;
+	unsigned int capacity;		/*!< number of tasks there is room for */
+	unsigned int *runnable;		/*!< runnable tasks, as ascending indexes in tasks */
+	unsigned int nrunnable;
+	unsigned int nblocked;		/*!< number of blocked tasks */
+	uint64_t used;				/*!< fuel used by all tasks */
+	uint64_t rounds;			/*!< number of rounds run */
+} sivm_scheduler;
+
+void scheduler_new(sivm_scheduler *scheduler, unsigned int quantum);
+int scheduler_add(sivm_scheduler *scheduler, SIVM *sivm, uint64_t budget);
+unsigned int scheduler_run(sivm_scheduler *scheduler, uint64_t rounds);
+void scheduler_wake(sivm_scheduler *scheduler, unsigned int task);
+double scheduler_share(const sivm_scheduler *scheduler, unsigned int task);
+void scheduler_free(sivm_scheduler *scheduler);
+//@}
+
+#endif /*SCHEDULER_H*/
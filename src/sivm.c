@@ -1,79 +1,489 @@
 #include <stdlib.h>
+#include <stdarg.h>
 
 #include "sivm.h"
 #include "instructions.h"
 #include "cmd_word.h"
+#include "fusion.h"
+#include "jit.h"
+#include "verifier.h"
+#include "hooks.h"
+#include "image.h"
+#include "flags.h"
 
 /**@name	SIVM setup*/
 //@{
 
-/**Initializes an SIVM.
- *Inits PC, SP and SR registers to the values defined in the SIVM.h file.
+/**Initializes an SIVM with the given memory geometry.
+ *Inits PC and SR registers to the values defined in the SIVM.h file, and SP to the one of the geometry.
  *Inits all memory and registers of the SIVM to 0.
+ *@param	config	memory geometry, see SIVM_DEFAULT_CONFIG
+ *@returns	false if the geometry is illegal or the memory can't be allocated, in which case the SIVM must not be used
+ *@see	sivm_free
  */
-void sivm_new(SIVM *sivm)
+bool sivm_new(SIVM *sivm, const sivm_config *config)
 {
-    sivm->pc = PC_START;
-    sivm->sp = SP_START;
-    sivm->sr = SR_START;
+	if (config->memsize == 0 || config->memsize > MAX_MEMSIZE) {
+		logm(LOG_ERROR, "Illegal memory size: %u (maximum is %d)", config->memsize, MAX_MEMSIZE);
+		return false;
+	}
+	if (config->sp_incr != 1 && config->sp_incr != -1) {
+		logm(LOG_ERROR, "Illegal stack incrementation: %d (has to be 1 or -1)", config->sp_incr);
+		return false;
+	}
+	if (config->banks && (config->banks > MAX_MEMSIZE || config->bank_size == 0 || config->memsize + config->bank_size > MAX_MEMSIZE)) {
+		logm(LOG_ERROR, "Illegal banks: %u banks of %u words (the window after the %u words of memory has to fit in %d words)", config->banks, config->bank_size, config->memsize, MAX_MEMSIZE);
+		return false;
+	}
 	
-	if (SP_START + SP_INCR > MEMSIZE || SP_START + SP_INCR <= 0)
+	sivm->memsize = config->memsize;
+	sivm->outside = ((config->memsize & (config->memsize - 1)) ? 0 : ~(config->memsize - 1));
+	sivm->sp_incr = config->sp_incr;
+	sivm->nbanks = config->banks;
+	sivm->bank_size = (config->banks ? config->bank_size : 0);
+	sivm->bank = 0;
+	sivm->window = NULL;
+	sivm->banks = (config->banks ? calloc(config->banks, sizeof(cmd_word *)) : NULL); //banks themselves are allocated on first access
+	sivm->nframes = 0;
+	sivm->max_frames = config->frames;
+	sivm->frames = (config->frames ? malloc(config->frames * sizeof(sivm_frame)) : NULL);
+	sivm->mem = malloc(config->memsize * sizeof(cmd_word)); //both are cleared by sivm_reset
+	sivm->shared = false;
+	sivm->mapped = 0;
+	sivm->image = NULL;
+	sivm->code = malloc(config->memsize * sizeof(decoded));
+	if (! sivm->mem || ! sivm->code || (config->banks && ! sivm->banks) || (config->frames && ! sivm->frames)) {
+		logm(LOG_ERROR, "Not enough memory for an SIVM of %u words", config->memsize);
+		free(sivm->mem);
+		free(sivm->code);
+		free(sivm->banks);
+		free(sivm->frames);
+		return false;
+	}
+	
+	sivm->jit = NULL;
+	sivm->hooks = NULL;
+	sivm->input = sivm->output = NULL;
+	sivm_set_fault_policy(sivm, SIVM_TRAP, NULL, NULL);
+	sivm_reset(sivm, config->sp_start);
+	
+	if (! sivm_in_memory(sivm, config->sp_start) || ! sivm_in_memory(sivm, (REG) (config->sp_start + config->sp_incr)))
 		logm(LOG_ERROR, "Stack init and incrementation are not in the same way, VM will crash at first PUSH.");
 	
 	if (PARAM_REGS_END > NREGS || PARAM_REGS_START > NREGS || PARAM_REGS_END < PARAM_REGS_START)
 		logm(LOG_ERROR, "Reserved argument registers have illegal values, VM will crash at first CALL or RET.");
 	
-    for (unsigned int i = 0; i < NREGS; i++)
-        sivm->reg[i] = 0;
-    for (unsigned int i = 0; i < MEMSIZE; i++)
-        sivm->mem[i].brut = 0;
+	return true;
+}
+
+/**Frees the memory of an SIVM, and its native code if it has a JIT.
+ *@see	sivm_new
+ */
+void sivm_free(SIVM *sivm)
+{
+	jit_disable(sivm);
+	sivm_free_hooks(sivm);
+	for (unsigned int i = 0; i < sivm->nbanks; i++)
+		free(sivm->banks[i]);
+	free(sivm->banks);
+	free(sivm->frames);
+	if (sivm->mapped)
+		image_unmap(sivm);
+	else {
+		if (! sivm->shared)
+			free(sivm->mem);
+		free(sivm->code);
+	}
+	sivm->banks = NULL;
+	sivm->frames = NULL;
+	sivm->window = NULL;
+	sivm->mem = NULL;
+	sivm->code = NULL;
+}
+
+/**Brings the given SIVM back to its state right after sivm_new, for it to run another program without allocating its memory again.
+ *Memory, banks and frames are cleared, and the JIT is disabled ; hooks, the fault policy and the image of the SIVM are kept.
+ *An SIVM mapping a program image drops the pages it copied rather than clearing them (see image.h).
+ *@param	sp_start	SP at startup, see sivm_config
+ */
+void sivm_reset(SIVM *sivm, REG sp_start)
+{
+	jit_disable(sivm);
+	if (! sivm->mapped || ! image_clear(sivm)) {
+		memset(sivm->mem, 0, sivm->memsize * sizeof(cmd_word));
+		memset(sivm->code, 0, sivm->memsize * sizeof(decoded)); //all entries are DECODE_PENDING, without breakpoint nor verification
+	}
+	for (unsigned int i = 0; i < sivm->nbanks; i++) {
+		free(sivm->banks[i]);
+		sivm->banks[i] = NULL;
+	}
+	sivm->bank = 0;
+	sivm->window = NULL;
+	sivm->nframes = 0;
 	
-	logm(LOG_STEP, "VM successfully initialized.");
+	sivm->pc = PC_START;
+	sivm->sp = sp_start;
+	sivm->sr = SR_START;
+	for (unsigned int i = 0; i < NREGS; i++)
+		sivm->reg[i] = 0;
+	sivm->flag_src = 0;
+	sivm->flag_op = FLAGS_LOGIC;
+	sivm->retired = 0;
+	for (unsigned int i = 0; i < FUSION_COUNT; i++)
+		sivm->fused[i] = 0;
+	sivm->depth = 0;
+	sivm->stop_depth = -1;
+	sivm->verified = false;
+	sivm->fault = SIVM_FAULT_NONE;
+	sivm->fault_message[0] = '\0';
+	sivm->sink.brut = 0;
 }
 
 /**Loads the given program in the given SIVM.
+ *Also builds the predecoded instructions cache for the whole memory, looks for superinstructions in it, and verifies the program.
  *@returns	false if the SIVM's memory is too small to load the whole program, true if the loading was successful.
  */
 bool sivm_load(SIVM *sivm, int memsize, cmd_word mem[memsize])
 {
-	if (memsize > MEMSIZE) return false;
+	if (memsize > sivm->memsize) return false;
 	
-    for (unsigned int i = 0; i < memsize; i++)
-        sivm->mem[i] = mem[i];
+	for (unsigned int i = 0; i < memsize; i++)
+		sivm->mem[i] = mem[i];
+
+	for (unsigned int i = 0; i < sivm->memsize; i++)
+		sivm_decode(sivm, i);
+	for (unsigned int i = 0; i < sivm->memsize; i++)
+		sivm_fuse(sivm, i);
+	sivm_verify(sivm);
+
+	return true;
+}
+
+/**Makes the given SIVM a copy of the given one, which must have the same memory geometry (see sivm_config) and no JIT.
+ *Memory, banks, frames and registers are copied, and so are the predecoded instructions and the verification of the program: forking many SIVMs from one that loaded a program is much cheaper than loading it in each of them.
+ *When the model has an image of its memory, the copy maps it instead, only copying the pages it writes to (see image.h).
+ *The fault policy, hooks and channels of the given SIVM are kept.
+ *@returns	false if there is no memory left for the banks of the copy
+ */
+bool sivm_fork(SIVM *sivm, const SIVM *model)
+{
+	jit_disable(sivm);
+	if (! model->image || ! image_map(sivm, model->image)) {
+		memcpy(sivm->mem, model->mem, sivm->memsize * sizeof(cmd_word));
+		memcpy(sivm->code, model->code, sivm->memsize * sizeof(decoded));
+	}
+	for (unsigned int i = 0; i < sivm->nbanks; i++)
+		if (! model->banks[i]) {
+			free(sivm->banks[i]);
+			sivm->banks[i] = NULL;
+		}
+		else if (! sivm->banks[i] && ! (sivm->banks[i] = malloc(sivm->bank_size * sizeof(cmd_word)))) {
+			logm(LOG_ERROR, "Not enough memory for bank %u", i);
+			return false;
+		}
+		else
+			memcpy(sivm->banks[i], model->banks[i], sivm->bank_size * sizeof(cmd_word));
+	sivm->bank = model->bank;
+	sivm->window = (sivm->nbanks ? sivm->banks[sivm->bank] : NULL);
+	sivm->nframes = model->nframes;
+	if (model->nframes)
+		memcpy(sivm->frames, model->frames, model->nframes * sizeof(sivm_frame));
+
+	sivm->pc = model->pc;
+	sivm->sp = model->sp;
+	sivm->sr = model->sr;
+	memcpy(sivm->reg, model->reg, sizeof(sivm->reg));
+	sivm->flag_src = model->flag_src;
+	sivm->flag_op = model->flag_op;
+	sivm->retired = model->retired;
+	memcpy(sivm->fused, model->fused, sizeof(sivm->fused));
+	sivm->depth = model->depth;
+	sivm->stop_depth = model->stop_depth;
+	sivm->verified = model->verified;
+	sivm->fault = model->fault;
+	strcpy(sivm->fault_message, model->fault_message);
+	sivm->sink = model->sink;
+	return true;
+}
+
+/**Makes the given SIVM a hart of the given one: it drops its own memory for the memory of the model, and starts from a copy of its predecoded instructions.
+ *Both SIVMs must have the same memory size and no banks, and the model must be freed after all its harts ; the registers of the hart are left as they are.
+ *Writes of a hart only invalidate its own predecoded instructions: harts don't see code written by each other (see harts.h).
+ */
+void sivm_share(SIVM *sivm, SIVM *model)
+{
+	jit_disable(sivm);
+	if (! sivm->shared)
+		free(sivm->mem);
+	sivm->mem = model->mem;
+	sivm->shared = true;
+	memcpy(sivm->code, model->code, sivm->memsize * sizeof(decoded));
+	sivm->verified = model->verified;
+}
+//@}
+
+
+/**@name	Memory banks*/
+//@{
+/**Maps the given bank in the bank window of the given SIVM.
+ *Only the window pointer changes, the bank being allocated on its first access.
+ *@returns	false if there is no such bank
+ */
+bool sivm_select_bank(SIVM *sivm, REG bank)
+{
+	if (bank >= sivm->nbanks) {
+		sivm_raise(sivm, SIVM_FAULT_BANK, NULL, "Invalid bank: %u (number of banks is %u)", bank, sivm->nbanks);
+		return false;
+	}
+	sivm->bank = bank;
+	sivm->window = sivm->banks[bank];
+	return true;
+}
+
+/**Locates the data word at the given adress, in memory or in the bank window.
+ *Adresses in neither go through checkMemoryAccess, and may be fixed to adresses in memory.
+ *Words of the window are not code, and don't need to be invalidated when written to.
+ *@returns	a pointer to the word, or to the SIVM's sink if the fault of the access was trapped
+ */
+cmd_word* sivm_data(SIVM *sivm, REG *index)
+{
+	if (! sivm_in_window(sivm, *index))
+		return (checkMemoryAccess(sivm, index) ? &sivm->mem[*index] : &sivm->sink);
+	if (! sivm->window) {
+		sivm->window = sivm->banks[sivm->bank] = calloc(sivm->bank_size, sizeof(cmd_word));
+		if (! sivm->window) {
+			sivm_raise(sivm, SIVM_FAULT_BANK, NULL, "Not enough memory for bank %u (%u words)", sivm->bank, sivm->bank_size);
+			return &sivm->sink;
+		}
+	}
+	return &sivm->window[*index - sivm->memsize];
+}
+//@}
+
+
+/**@name	Shadow frame stack
+ *@see	sivm_frame
+ */
+//@{
+/**Saves the registers of a CALL in a new frame.
+ *The frame stack has to have room for it, which callers check beforehand so that the CALL can fail before any side effect.
+ *@param	from	adress of the last word of the CALL
+ *@param	target	adress called
+ */
+void sivm_push_frame(SIVM *sivm, REG from, REG target)
+{
+	sivm_frame *frame = &sivm->frames[sivm->nframes++];
+	memcpy(frame->reg, sivm->reg, sizeof(frame->reg));
+	frame->from = from;
+	frame->target = target;
+}
+
+/**Restores the registers saved by the last CALL, except parameter registers, and removes its frame.
+ *A RET without frame, to an adress pushed by the program, leaves the registers as they are.
+ */
+void sivm_pop_frame(SIVM *sivm)
+{
+	if (! sivm->nframes)
+		return;
+	sivm_frame *frame = &sivm->frames[--sivm->nframes];
+	memcpy(sivm->reg, frame->reg, PARAM_REGS_START * sizeof(REG));
+	if (PARAM_REGS_END + 1 < NREGS)
+		memcpy(&sivm->reg[PARAM_REGS_END + 1], &frame->reg[PARAM_REGS_END + 1], (NREGS - PARAM_REGS_END - 1) * sizeof(REG));
+}
+//@}
+
+
+/**@name	Predecoded instructions cache*/
+//@{
+/**Reads a word of memory to decode it.
+ *Words next to code are decoded too, and may be data that other harts write with atomic instructions meanwhile (see harts.h): the read is atomic as well, which costs nothing more than a plain one.
+ */
+static inline REG peek(SIVM *sivm, REG addr)
+{
+	return __atomic_load_n(&sivm->mem[addr].brut, __ATOMIC_RELAXED);
+}
+
+/**Decodes the instruction starting at the given adress into the predecoded instructions cache of the given SIVM.
+ *Instructions that can't be safely predecoded are marked as DECODE_GENERIC, and will go through sivm_exec with all its checks and diagnostics.
+ *@see	decoded
+ */
+void sivm_decode(SIVM *sivm, REG addr)
+{
+	decoded *d = &sivm->code[addr];
+	cmd_word word = { .brut = peek(sivm, addr) };
+	mode destMode, srcMode;
+	
+	d->codeop = word.codage.codeop;
+	d->handler = word.codage.codeop;
+	d->exec = getHandler(word);
+	d->status = DECODE_GENERIC;
+	d->length = 1;
+	d->span = 1;
+	
+	if (! d->exec) //unknown instruction or illegal adressing mode (instructions with arity 0 are only predecoded if their mode is left blank)
+		return;
+	
+	getModes(&word, &destMode, &srcMode);
+	d->destMode = destMode;
+	d->srcMode = srcMode;
+	d->dest = word.codage.dest;
+	d->source = word.codage.source;
+	
+	//inline words are read in the same order as in sivm_exec: source first, then destination
+	if (srcMode == IMMEDIATE || srcMode == DIRECT) {
+		if (! sivm_in_memory(sivm, addr + d->length)) return;
+		d->srcWord = peek(sivm, addr + d->length++);
+		if (srcMode == DIRECT && ! sivm_in_memory(sivm, d->srcWord)) return;
+	}
+	if (destMode == DIRECT) {
+		if (! sivm_in_memory(sivm, addr + d->length)) return;
+		d->destWord = peek(sivm, addr + d->length++);
+		if (! sivm_in_memory(sivm, d->destWord)) return;
+	}
+	if (addr + d->length > UINT16_MAX) return; //PC wraps around after the last word of the adress space, see increment_PC
+	
+	d->span = d->length;
+	d->status = DECODE_OK;
+}
+
+/**Invalidates the predecoded instructions that may have been decoded from the word at the given adress.
+ *Any instruction starting up to MAX_INSTR_LENGTH - 1 words before the adress may span over it, as well as any superinstruction starting up to MAX_FUSED_LENGTH - 1 words before.
+ *Compiled blocks containing the adress are thrown away as well.
+ *@param	written	whether the word was written to, in which case the instructions lose their verification
+ */
+static void invalidate(SIVM *sivm, REG addr, bool written)
+{
+	for (unsigned int i = 0; i < MAX_FUSED_LENGTH && i <= addr; i++)
+		if (sivm_in_memory(sivm, addr - i) && (i < MAX_INSTR_LENGTH || i < sivm->code[addr - i].span)) {
+			sivm->code[addr - i].status = DECODE_PENDING;
+			if (written)
+				sivm->code[addr - i].verified = false;
+		}
+	if (sivm->jit)
+		jit_invalidate(sivm, addr);
+}
+
+/**Invalidates the predecoded instructions that may have been decoded from the word at the given adress.
+ *Has to be called after each write to the SIVM's memory, since code is allowed to modify itself.
+ *@see	invalidate
+ */
+void sivm_invalidate(SIVM *sivm, REG addr)
+{
+	invalidate(sivm, addr, true);
+}
+
+/**Sets or removes a breakpoint on the instruction starting at the given adress.
+ *Superinstructions spanning over the adress are invalidated, so that they don't skip the breakpoint.
+ *@see	engine.c#sivm_run
+ */
+void sivm_set_breakpoint(SIVM *sivm, REG addr, bool set)
+{
+	if (sivm_in_memory(sivm, addr) && sivm->code[addr].breakpoint != set) {
+		sivm->code[addr].breakpoint = set;
+		invalidate(sivm, addr, false);
+	}
+}
+
+/**Invalidates the predecoded instructions spanning over the given destination operand, if it lies in the SIVM's memory.*/
+void invalidate_destination(SIVM *sivm, REG *dest)
+{
+	cmd_word *word = (cmd_word *) dest;
+	if (word >= sivm->mem && word < sivm->mem + sivm->memsize)
+		sivm_invalidate(sivm, word - sivm->mem);
+}
 
-    return true;
+/**Reports the write to the given destination operand to the hooks, if it lies in the SIVM's memory or bank window.*/
+static void report_destination(SIVM *sivm, REG *dest)
+{
+	cmd_word *word = (cmd_word *) dest;
+	if (word >= sivm->mem && word < sivm->mem + sivm->memsize)
+		SIVM_EVENT(sivm, SIVM_EVENT_WRITE, word - sivm->mem, *dest);
+	else if (sivm->window && word >= sivm->window && word < sivm->window + sivm->bank_size)
+		SIVM_EVENT(sivm, SIVM_EVENT_WRITE, sivm->memsize + (word - sivm->window), *dest);
 }
 //@}
 
 
 bool increment_PC(SIVM *);
+static bool step(SIVM *);
+static bool sivm_step_verified(SIVM *, decoded *);
 
 bool sivm_exec(SIVM *, cmd_word *);
 
 
-/**@name	Consistency checks*/
+/**@name	Faults*/
 //@{
-/**Checks whether the given index is legal for access to the memory.
- *@returns	true if the access is legal.
+/**Sets what the given SIVM does on faults.
+ *SIVMs trap faults unless told otherwise, and never wait for the user nor write anything by themselves.
+ *@param	handler	the function called on faults with the SIVM_CALLBACK policy, ignored otherwise
+ *@param	data	passed through to handler
+ *@see	sivm_fault_policy
+ */
+void sivm_set_fault_policy(SIVM *sivm, sivm_fault_policy policy, sivm_fault_handler handler, void *data)
+{
+	sivm->fault_policy = (policy == SIVM_CALLBACK && ! handler ? SIVM_TRAP : policy);
+	sivm->fault_handler = handler;
+	sivm->fault_data = data;
+}
+
+/**Raises a fault in the given SIVM, and applies its fault policy.
+ *Only the first fault of an instruction is recorded, the ones it may lead to being ignored.
+ *@param	value	the faulty value, that a fault handler may fix, NULL if the fault can't be recovered from
+ *@param	format, ...		the message of the fault, see printf
+ *@returns	true if the fault handler fixed value, false if the fault is trapped, which it always is when value is NULL
  */
-bool checkMemoryAccess(REG *index)
+bool sivm_raise(SIVM *sivm, sivm_fault fault, REG *value, const char *format, ...)
 {
-	if (*index > MEMSIZE) {
-		superRecover(index, "Invalid memory access: %u (memsize is %d)", *index, MEMSIZE);
+	if (sivm->fault)
 		return false;
+	
+	va_list args;
+	va_start(args, format);
+	vsnprintf(sivm->fault_message, FAULT_MESSAGE_LENGTH, format, args);
+	va_end(args);
+	sivm->fault = fault;
+	
+	switch (sivm->fault_policy) {
+		case SIVM_ABORT:
+			logm(LOG_FATAL_ERROR, "%s", sivm->fault_message);
+			break;
+		case SIVM_CALLBACK:
+			if (sivm->fault_handler(sivm, value, sivm->fault_data) && value) { //faults without a value are trapped whatever the handler says
+				sivm->fault = SIVM_FAULT_NONE;
+				return true;
+			}
+			break;
+		default:
+			break;
 	}
+	SIVM_EVENT(sivm, SIVM_EVENT_FAULT, (value ? *value : 0), fault);
+	return false;
+}
+//@}
+
+
+/**@name	Consistency checks*/
+//@{
+/**Checks whether the given index is legal for access to the memory of the given SIVM.
+ *Illegal indexes raise a fault until they are fixed.
+ *@see	sivm_in_memory
+ *@returns	true if the access is legal, possibly after the index was fixed by the fault handler.
+ */
+bool checkMemoryAccess(SIVM *sivm, REG *index)
+{
+	while (! sivm_in_memory(sivm, *index))
+		if (! sivm_raise(sivm, SIVM_FAULT_MEMORY, index, "Invalid memory access: %u (memsize is %u)", *index, sivm->memsize))
+			return false;
 	return true;
 }
 
 /**Checks whether the given index is legal for access to a register.
  *@returns	true if the access is legal.
  */
-bool checkRegisterAccess(REG index)
+bool checkRegisterAccess(SIVM *sivm, REG index)
 {
-	if (index >= NREGS) {
-		logm(LOG_FATAL_ERROR, "Invalid register access: %d (number of registers is %d)", index, NREGS);
-		return false;
-	}
+	if (index >= NREGS)
+		return sivm_raise(sivm, SIVM_FAULT_REGISTER, NULL, "Invalid register access: %d (number of registers is %d)", index, NREGS);
 	return true;
 }
 //@}
@@ -83,113 +493,183 @@ bool checkRegisterAccess(REG index)
 //@{
 
 /**Executes the next instruction in the given SIVM.
- *@see	sivm_exec
- *@see	increment_PC
- *@returns	true if the instruction was correctly executed, false if the SIVM has to stop (whether on HALT instruction or because of a bad instruction).
+ *Its events are delivered to the hooks before returning, unless sivm_run will.
+ *@see	step
+ *@returns	true if the instruction was correctly executed, false if the SIVM has to stop, on HALT instruction or on a fault (see the SIVM's fault), PC being left on the faulty instruction.
  */
 bool sivm_step(SIVM *sivm)
 {
-	checkMemoryAccess(&sivm->pc);
-    cmd_word *m = &sivm->mem[sivm->pc];
+	if (! sivm->hooks)
+		return step(sivm);
+	
+	uint64_t retired = sivm->retired;
+	sivm->hooks->at = sivm->pc;
+	bool executed = step(sivm);
+	if (sivm->retired != retired)
+		sivm_record_event(sivm, SIVM_EVENT_RETIRE, sivm->hooks->at, 0, 0);
+	if (! sivm->hooks->running)
+		sivm_flush_events(sivm);
+	return executed;
+}
 
-    /* stop the vm */
-    if (m->codage.codeop == HALT) {
+/**Executes the next instruction in the given SIVM, through its handler if it is predecoded.
+ *@see	sivm_exec
+ *@see	increment_PC
+ *@returns	see sivm_step
+ */
+static bool step(SIVM *sivm)
+{
+	sivm->fault = SIVM_FAULT_NONE;
+	
+	if (sivm->verified && sivm_in_memory(sivm, sivm->pc) && sivm->code[sivm->pc].verified)
+		return sivm_step_verified(sivm, &sivm->code[sivm->pc]);
+	
+	if (! checkMemoryAccess(sivm, &sivm->pc))
+		return false;
+	
+	decoded *d = &sivm->code[sivm->pc];
+	if (d->status == DECODE_PENDING)
+		sivm_decode(sivm, sivm->pc);
+	
+	if (d->codeop == HALT) {
 		logm(LOG_DEBUG, "HALT instruction encountered, stopping VM.");
-        return false;
+		return false;
 	}
 	
-    if (! sivm_exec(sivm, m)) return false;
+	REG pc = sivm->pc;
+	if (d->status == DECODE_OK ? ! d->exec(sivm, d) : ! sivm_exec(sivm, &sivm->mem[sivm->pc])) {
+		sivm->pc = pc; //the faulty instruction is left under PC, to be inspected or executed again
+		return false;
+	}
 
+	sivm->retired++;
 	return increment_PC(sivm);
 }
 
+/**Same as sivm_step, for an instruction that passed sivm_verify.
+ *Its modes, inline words and static jump target are known to be legal, and PC stays in memory after executing it, so only the checks of its handler and instruction function remain.
+ *Its predecoded entry may be pending after a breakpoint change, but is still up to date, since verification is lost as soon as one of its words is written to.
+ *@see	verifier.h#sivm_verify
+ */
+static bool sivm_step_verified(SIVM *sivm, decoded *d)
+{
+	if (d->codeop == HALT) {
+		logm(LOG_DEBUG, "HALT instruction encountered, stopping VM.");
+		return false;
+	}
+	
+	REG pc = sivm->pc;
+	if (! d->exec(sivm, d)) {
+		sivm->pc = pc;
+		return false;
+	}
+	sivm->retired++;
+	if (sivm->pc == UINT16_MAX) sivm->pc = 0; //see increment_PC
+	sivm->pc++;
+	return true;
+}
+
 /**Handles PC incrementation for an SIVM.
  *Also checks for PC validity, which is why you shouldn't increment PC by hand.
- *@returns	false if PC can't be incremented anymore (ie current PC >= MEMSIZE)
+ *@returns	false if PC can't be incremented anymore (ie current PC is out of memory)
  */
 bool increment_PC(SIVM *sivm)
 {
 	if (sivm->pc == UINT16_MAX) sivm->pc = 0;
-	if (checkMemoryAccess(&sivm->pc)) {
+	if (sivm_in_memory(sivm, sivm->pc)) {
 		sivm->pc++;
 		return true;
 	}
-	logm(LOG_FATAL_ERROR, "PC too high (%d, memsize being %d)", sivm->pc + 1, MEMSIZE);
-	return false;
+	return sivm_raise(sivm, SIVM_FAULT_PC, NULL, "PC too high (%d, memsize being %u)", sivm->pc + 1, sivm->memsize);
+}
+
+/**Moves PC to the next word of the current instruction.
+ *@returns	a pointer to the word, or to the SIVM's sink if the instruction is cut by the end of memory
+ */
+static cmd_word* next_word(SIVM *sivm)
+{
+	if (increment_PC(sivm) && checkMemoryAccess(sivm, &sivm->pc))
+		return &sivm->mem[sivm->pc];
+	return &sivm->sink;
 }
 
 /**Computes the destination from a command word.
  *<strong>WARNING</strong>: updates PC if necessary
  *@param	sivm	the VM in which to get the parameters
  *@param	word	the command word from which to compute parameters
- *@return	a pointer to the destination operand, possibly null if the mode encoded in the given word is illegal
+ *@return	a pointer to the destination operand, the SIVM's sink if the operand raised a fault that was trapped
  */
 REG* getDestinationParameter(SIVM *sivm, cmd_word *word)
 {
 	mode destMode, srcMode;
-	getModes(word, &destMode, &srcMode);
+	if (! getModes(word, &destMode, &srcMode)) {
+		sivm_raise(sivm, SIVM_FAULT_INSTRUCTION, NULL, "Invalid destination adressing mode (command: %d)", word->brut);
+		return &sivm->sink.brut;
+	}
 	
 	switch (destMode) {
 		case REGISTER:
-			checkRegisterAccess(word->codage.dest);
+			if (! checkRegisterAccess(sivm, word->codage.dest))
+				return &sivm->sink.brut;
 			return &sivm->reg[word->codage.dest];
 			break;
-		case IMMEDIATE:
-			logm(LOG_FATAL_ERROR, "Invalid adressing mode: destination parameter can't be an immediate value! (command: %d)", *word);
-			return NULL;
-			break;
 		case DIRECT:
-			increment_PC(sivm);
-			checkMemoryAccess(&sivm->mem[sivm->pc].brut);
-			return &(sivm->mem[sivm->mem[sivm->pc].brut].brut);
+			return &sivm_data(sivm, &next_word(sivm)->brut)->brut;
 			break;
 		case INDIRECT:
-			checkMemoryAccess(&sivm->reg[word->codage.dest]);
-			return &(sivm->mem[sivm->reg[word->codage.dest]].brut);
+			return &sivm_data(sivm, &sivm->reg[word->codage.dest])->brut;
 			break;
 		default:
-			logm(LOG_FATAL_ERROR, "Invalid destination adressing mode (command: %d)", *word);
-			return NULL;
+			sivm_raise(sivm, SIVM_FAULT_INSTRUCTION, NULL, "Invalid adressing mode: destination parameter can't be an immediate value! (command: %d)", word->brut);
+			return &sivm->sink.brut;
 	}
 }
 
+/**Reads the data word at the given adress for a source operand, and reports it to the hooks.
+ *@see	sivm_data
+ */
+static cmd_word read_data(SIVM *sivm, REG *index)
+{
+	cmd_word value = *sivm_data(sivm, index);
+	if (! sivm->fault)
+		SIVM_EVENT(sivm, SIVM_EVENT_READ, *index, value.brut);
+	return value;
+}
+
 /**Computes the source from a command word.
  *<strong>WARNING</strong>: updates PC if necessary
  *@param	sivm	the VM in which to get the parameters
  *@param	word	the command word from which to compute parameters
- *@return	the value of the source operand
+ *@return	the value of the source operand, the one of the SIVM's sink if the operand raised a fault that was trapped
  */
 cmd_word getSourceParameter(SIVM *sivm, cmd_word *word)
 {
 	mode destMode, srcMode;
-	getModes(word, &destMode, &srcMode);
+	if (! getModes(word, &destMode, &srcMode)) {
+		sivm_raise(sivm, SIVM_FAULT_INSTRUCTION, NULL, "Invalid source adressing mode (command: %d)", word->brut);
+		return sivm->sink;
+	}
 	
 	switch (srcMode) {
 		case REGISTER:
-			checkRegisterAccess(word->codage.dest);
+			if (! checkRegisterAccess(sivm, word->codage.source))
+				return sivm->sink;
 			return (cmd_word) sivm->reg[word->codage.source];
 			break;
 		case IMMEDIATE:
-			increment_PC(sivm);
-			return sivm->mem[sivm->pc];
+			return *next_word(sivm);
 			break;
 		case DIRECT:
-			increment_PC(sivm);
-			checkMemoryAccess(&sivm->mem[sivm->pc].brut);
-			return (cmd_word) sivm->mem[sivm->mem[sivm->pc].brut].brut;
+			return read_data(sivm, &next_word(sivm)->brut);
 			break;
 		case INDIRECT:
-			checkMemoryAccess(&sivm->reg[word->codage.dest]);
-			return sivm->mem[sivm->reg[word->codage.source]];
-			break;
 		default:
-			logm(LOG_FATAL_ERROR, "Invalid source adressing mode (command: %d)", *word);
-			return (cmd_word) {.codage = { HALT }}; //Don't test for this value to detect errors, because it might also be a valid integer value
+			return read_data(sivm, &sivm->reg[word->codage.source]);
 	}
 }
 
 /**Executes the given word in the given SIVM.
- *Checks for invalid adressing modes.
+ *Faults raised by the operands are checked before executing the instruction.
  *<strong>WARNING</strong>: may update PC through calls to getSourceParameter and getDestinationParameter.
  *@see	getSourceParameter
  *@see	getDestinationParameter
@@ -198,22 +678,36 @@ cmd_word getSourceParameter(SIVM *sivm, cmd_word *word)
 bool sivm_exec(SIVM *sivm, cmd_word *word)
 {	
 	Instr instr = getInstruction(*word);
+	if (! instr.function)
+		return sivm_raise(sivm, SIVM_FAULT_INSTRUCTION, NULL, "Unknown instruction (command: %d)", word->brut);
+	
 	cmd_word source = getSourceParameter(sivm, word);
 	REG *dest = getDestinationParameter(sivm, word);
+	if (sivm->fault)
+		return false;
 	
 	if (instr.function(sivm, dest, source)) {
-		logm(LOG_DEBUG, "Instruction successful");
+		invalidate_destination(sivm, dest);
+		if (sivm->hooks)
+			report_destination(sivm, dest);
 		return true;
-	} else {
-		logm(LOG_ERROR, "Instruction unsuccessful (command: %d)", *word);
-		return false;
-	}
+	} else
+		return sivm_raise(sivm, SIVM_FAULT_INSTRUCTION, NULL, "Instruction unsuccessful (command: %d)", word->brut); //instructions raise their own faults, this one is ignored
+
 }
 //@}
 
 
 /**@name	SIVM status inquiry*/
 //@{
+/**Materialises the given SIVM's condition flags.
+ *@returns	the value of the status register, see flags.h
+ */
+REG sivm_flags(SIVM *sivm)
+{
+	return flags_compute(sivm->sr, sivm->flag_src, sivm->flag_op);
+}
+
 /**Prints the given SIVM's register value.
  *@returns	true if the register is a legal one, false if no corresponding register was found (won't print diagnostic message in this case)
  */
@@ -224,7 +718,7 @@ bool sivm_print_register(SIVM *sivm, unsigned int reg)
 			printf((ANSI_OUTPUT ? "\e[36mPC\e\[0m = %d\n" : "PC = %d\n"), sivm->pc);
 			break;
 		case SR:
-			printf((ANSI_OUTPUT ? "\e[36mSR\e\[0m = %d\n" : "SR = %d\n"), sivm->sr);
+			printf((ANSI_OUTPUT ? "\e[36mSR\e\[0m = %d\n" : "SR = %d\n"), sivm_flags(sivm));
 			break;
 		case SP:
 			printf((ANSI_OUTPUT ? "\e[36mSP\e\[0m = %d\n" : "SP = %d\n"), sivm->sp);
@@ -244,8 +738,12 @@ bool sivm_print_register(SIVM *sivm, unsigned int reg)
  */
 bool sivm_print_memory(SIVM *sivm, unsigned int mem)
 {
-	if (mem >= MEMSIZE) return false;
-	printf((ANSI_OUTPUT ? "\e[36mMEM[%d]\e\[0m = %d\n" : "MEM[%d] = %d\n"), mem, sivm->mem[mem].brut);
+	if (mem < sivm->memsize)
+		printf((ANSI_OUTPUT ? "\e[36mMEM[%d]\e\[0m = %d\n" : "MEM[%d] = %d\n"), mem, sivm->mem[mem].brut);
+	else if (sivm_in_window(sivm, mem)) //banks that were never accessed are only zeros
+		printf((ANSI_OUTPUT ? "\e[36mMEM[%d]\e\[0m = %d (bank %d)\n" : "MEM[%d] = %d (bank %d)\n"), mem, (sivm->window ? sivm->window[mem - sivm->memsize].brut : 0), sivm->bank);
+	else
+		return false;
 	return true;
 }
 
@@ -261,29 +759,29 @@ void sivm_status(SIVM *sivm)
       	sivm_print_register(sivm, i);
 }
 
+/**Prints the given SIVM's shadow frame stack, from the innermost frame.*/
+void sivm_print_frames(SIVM *sivm)
+{
+	if (! sivm->frames) {
+		printf("No frame stack: registers are saved on the stack (see --frames)\n");
+		return;
+	}
+	printf("%u frame(s), at most %u\n", sivm->nframes, sivm->max_frames);
+	for (unsigned int i = sivm->nframes; i-- > 0;) {
+		sivm_frame *frame = &sivm->frames[i];
+		printf((ANSI_OUTPUT ? "\e[35m#%u\e[0m CALL at %d to %d\n\t" : "#%u CALL at %d to %d\n\t"), i, frame->from, frame->target);
+		for (unsigned int reg = 0; reg < NREGS; reg++)
+			printf("%sR%u = %d", (reg ? ", " : ""), reg, frame->reg[reg]);
+		printf("\n");
+	}
+}
+
 /**Returns the given SIVM's current instruction in disassembly form.*/
 char* sivm_get_instruction_string(SIVM *sivm)
 {
-	mode modes[2];
-	if (getModes((cmd_word*) &sivm->pc, &modes[0], &modes[1]));
-	int wordCount = 1;
-	for (int i = 0; i < 2; i++)
-	{
-		switch (modes[i])
-		{
-			case IMMEDIATE:
-			case DIRECT:
-				wordCount++;
-				break;
-			default:
-				break;
-		}
-	}
-	cmd_word words[wordCount];
-	for (int i = 0; i <= wordCount; i++) {
-		checkMemoryAccess(&sivm->pc + i);
+	cmd_word words[MAX_INSTR_LENGTH] = {{0}};
+	for (int i = 0; i < MAX_INSTR_LENGTH && sivm_in_memory(sivm, sivm->pc + i); i++)
 		words[i] = sivm->mem[sivm->pc + i];
-	}
 	char *result = malloc(MAX_INSTR_PRINT_SIZE * sizeof(char));
     result[0] = '\0';
 	disassemble_single_instruction(result, words);
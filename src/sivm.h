@@ -23,21 +23,41 @@ typedef uint16_t REG;
  *@see	PARAM_REGS_START
  */
 #define PARAM_REGS_END NREGS
-/**Size of an SIVM's memory*/
+/**Default size of an SIVM's memory
+ *@see	sivm_config
+ */
 #define MEMSIZE 128
+/**Maximum size of an SIVM's memory: the whole adress space of a REG.*/
+#define MAX_MEMSIZE (1 << 16)
 /**PC index at SIVM startup*/
 #define PC_START 0
 /**SR index at SIVM startup*/
 #define SR_START 0
-/**SP index at SIVM startup*/
+/**Default SP index at SIVM startup*/
 #define SP_START MEMSIZE-1
-/**SP incrementation
+/**Default SP incrementation
  *Set it to (+)1 to go through ascending adresses, -1 to go through descending adresses.
  *Standard operation is found by setting SP_START at MEMSIZE and this variable to -1 (descending adresses).
  */
 #define SP_INCR -1
 //@}
 
+/**Memory geometry of an SIVM, given to sivm_new.
+ *Banks extend the memory with data only: the bank selected by the BANK instruction is seen through a window of bank_size words, right after the memory.
+ */
+typedef struct
+{
+	unsigned int memsize;	/*!< number of words of memory, from 1 to MAX_MEMSIZE */
+	unsigned int sp_start;	/*!< SP at startup */
+	int sp_incr;			/*!< SP incrementation on PUSH, see SP_INCR */
+	unsigned int banks;		/*!< number of banks, 0 for none */
+	unsigned int bank_size;	/*!< number of words of each bank, memsize + bank_size being at most MAX_MEMSIZE */
+	unsigned int frames;	/*!< maximum depth of the shadow frame stack, 0 for CALL to save registers on the stack (see sivm_frame) */
+} sivm_config;
+
+/**Memory geometry of an SIVM when none is given: MEMSIZE words, a stack going down from the last one, no banks, and registers saved on the stack.*/
+#define SIVM_DEFAULT_CONFIG ((sivm_config) { MEMSIZE, SP_START, SP_INCR, 0, 0, 0 })
+
 /**@name	Status registers conventions
  *Defines the numerical values for the SP, SR and PC registers used internally.
  *<strong>WARNING</strong>: do not set these to anything between 0 and NREGS!
@@ -70,30 +90,224 @@ typedef union
 		unsigned dest   : 3;
 	} codage;
 } cmd_word;
+
+/**Number of opcodes a command word can encode.*/
+#define OPCODES_COUNT (1 << 6)
+//@}
+
+typedef struct sivm SIVM;
+
+/**Signature of the functions emulating instructions.
+ *@see	instructions.h#Instr
+ */
+typedef bool (*instr_function)(SIVM *sivm, REG *dest, cmd_word source);
+
+/**@name	Faults
+ *What an SIVM does when an instruction can't be executed is chosen for each SIVM, see sivm_set_fault_policy.
+ *Faults are only raised out of the fast paths, which hand anything out of the ordinary to sivm_step.
+ */
+//@{
+/**Kinds of faults.*/
+typedef enum
+{
+	SIVM_FAULT_NONE = 0,	/*!< the last instruction was executed without fault */
+	SIVM_FAULT_MEMORY,		/*!< access out of memory and of the bank window, stack overflows included */
+	SIVM_FAULT_PC,			/*!< PC went out of memory */
+	SIVM_FAULT_REGISTER,	/*!< access to a register that doesn't exist */
+	SIVM_FAULT_INSTRUCTION,	/*!< unknown instruction, or illegal adressing mode */
+	SIVM_FAULT_DIVISION,	/*!< division by zero */
+	SIVM_FAULT_LOOP,		/*!< jump to the jump itself */
+	SIVM_FAULT_BANK,		/*!< selection of a bank that doesn't exist, or no memory left for it */
+	SIVM_FAULT_FRAMES,		/*!< frame stack overflow */
+	SIVM_FAULT_CHANNEL		/*!< SEND or RECV without a channel, or on a channel it would have to wait for (see channel.h) */
+} sivm_fault;
+
+/**What to do on a fault.*/
+typedef enum
+{
+	SIVM_TRAP = 0,	/*!< the faulty instruction isn't executed: sivm_step returns false and sivm_run SIVM_FAULT, the fault being recorded in the SIVM */
+	SIVM_ABORT,		/*!< the program exits with the message of the fault */
+	SIVM_CALLBACK	/*!< the fault handler of the SIVM may fix the faulty value, otherwise the fault is trapped */
+} sivm_fault_policy;
+
+/**Signature of the fault handlers of the SIVM_CALLBACK policy.
+ *The fault and its message are already recorded in the SIVM.
+ *Handlers are called on all faults, but only recover from the ones with a value: when value is NULL, the fault is trapped whatever the handler returns.
+ *@param	value	the faulty value (adress, jump target...), NULL if the fault can't be recovered from
+ *@param	data	the data given along with the handler
+ *@returns	true if the handler fixed value and the access has to go on with it, false for the fault to be trapped ; ignored when value is NULL
+ */
+typedef bool (*sivm_fault_handler)(SIVM *sivm, REG *value, void *data);
+
+/**Maximum length of the message of a fault, terminating null included.*/
+#define FAULT_MESSAGE_LENGTH 128
 //@}
 
-typedef struct {
+typedef struct decoded decoded;
+
+/**Signature of the handlers executing a predecoded instruction, specialized for its instruction and adressing mode.
+ *@see	instructions.c#handlers
+ */
+typedef bool (*instr_handler)(SIVM *sivm, decoded *d);
+
+/**@name	Predecoded instructions cache
+ *Every address of an SIVM's memory has a matching entry caching the decoding of the instruction starting there.
+ *Entries are built by sivm_load, and invalidated whenever one of the words they were decoded from is written to.
+ */
+//@{
+/**Status of a predecoded instruction.*/
+typedef enum
+{
+	DECODE_PENDING = 0, /*!< entry has to be decoded (again) before use */
+	DECODE_OK,          /*!< entry is up to date and can be executed directly */
+	DECODE_GENERIC      /*!< instruction can't be predecoded (illegal mode, truncated instruction, out of bounds direct adress...) and has to go through sivm_exec */
+} decode_status;
+
+/**Superinstructions.
+ *Frequent sequences of instructions that sivm_run executes at once, in a single fused body.
+ *@see	fusion.c#sivm_fuse
+ */
+typedef enum
+{
+	FUSION_NONE = 0,
+	FUSION_SUB_JEQ,		/*!< SUB Rx, src + JEQ #target */
+	FUSION_AND_JEQ,		/*!< AND Rx, src + JEQ #target */
+	FUSION_LOAD_ADD,	/*!< LOAD Rx, (#imm|[dir]) + ADD Ry, src */
+	FUSION_MOV_SHL_OR,	/*!< MOV Rx, src + SHL Ry, src + OR Rz, src */
+	FUSION_COUNT
+} fusion;
+
+/**Predecoded instruction.
+ *Holds everything sivm_exec would otherwise compute again on each execution of an instruction.
+ *@see	sivm_decode
+ */
+struct decoded
+{
+	instr_handler exec;			/*!< the handler specialized for the instruction and its adressing mode */
+	uint8_t status;				/*!< one of decode_status */
+	uint8_t codeop;				/*!< opcode of the instruction */
+	uint8_t handler;			/*!< entry of sivm_run's dispatch table: the opcode, or a superinstruction starting here */
+	uint8_t length;				/*!< length of the instruction, in words */
+	uint8_t span;				/*!< number of words executed by handler: the length, or the length of the whole superinstruction */
+	uint8_t destMode;			/*!< destination operand kind (REGISTER, DIRECT or INDIRECT), see instructions.h#mode */
+	uint8_t srcMode;			/*!< source operand kind (REGISTER, IMMEDIATE, DIRECT or INDIRECT), see instructions.h#mode */
+	uint8_t dest;				/*!< destination register index */
+	uint8_t source;				/*!< source register index */
+	REG destWord;				/*!< inline destination word (direct adress) */
+	REG srcWord;				/*!< inline source word (immediate value or direct adress) */
+	bool breakpoint;			/*!< sivm_run stops before executing this instruction */
+	bool verified;				/*!< sivm_verify checked this instruction, which sivm_step can execute without static checks ; cleared when one of its words is written to */
+};
+
+/**Maximum length of an instruction, in words.*/
+#define MAX_INSTR_LENGTH 3
+/**Maximum length of a superinstruction, in words.*/
+#define MAX_FUSED_LENGTH 6
+//@}
+
+/**Frame of the shadow frame stack.
+ *With a frame stack, CALL only pushes the return adress on the stack, and saves the registers in a new frame at once ; RET restores the ones that aren't parameters, and removes the frame.
+ *@see	sivm_config#frames
+ */
+typedef struct
+{
+	REG reg[NREGS];			/*!< registers when the CALL was executed */
+	REG from;				/*!< adress of the last word of the CALL, pushed as the return adress */
+	REG target;				/*!< adress called */
+} sivm_frame;
+
+struct jit;
+struct sivm_hooks;
+struct sivm_channel;
+struct sivm_image;
+
+struct sivm {
     REG pc;
     REG sp;
-    REG sr;
+    REG sr;					/*!< result of the last flag-setting instruction, from which the flags are computed (see flags.h) */
     REG reg[NREGS];
-	cmd_word mem[MEMSIZE];
-} SIVM;
+	REG flag_src;			/*!< source operand of the last flag-setting instruction */
+	uint8_t flag_op;		/*!< kind of the last flag-setting instruction, see flags.h#flags_op */
+	cmd_word *mem;			/*!< memory, of memsize words */
+	bool shared;			/*!< mem belongs to another SIVM, of which this one is a hart (see sivm_share) */
+	size_t mapped;			/*!< size of the mapping holding mem then code once they map a program image, 0 while they're allocated (see image.h) */
+	const struct sivm_image *image;	/*!< image of mem and code, mapped by the SIVMs forked from this one rather than copied, NULL if there is none (see sivm_fork) */
+	decoded *code;			/*!< predecoded instruction starting at each adress, memsize entries */
+	unsigned int memsize;	/*!< number of words of memory, see sivm_config */
+	unsigned int outside;	/*!< bits that are only set in adresses out of memory if memsize is a power of two, 0 otherwise (see sivm_in_memory) */
+	int sp_incr;			/*!< SP incrementation on PUSH, see sivm_config */
+	cmd_word **banks;		/*!< storage of each bank, NULL until it is first accessed (see sivm_data) */
+	unsigned int nbanks;	/*!< number of banks, see sivm_config */
+	unsigned int bank_size;	/*!< number of words of the bank window, 0 if there are no banks */
+	REG bank;				/*!< selected bank */
+	cmd_word *window;		/*!< storage of the selected bank, NULL until it is first accessed */
+	sivm_frame *frames;		/*!< shadow frame stack, NULL if CALL saves registers on the stack */
+	unsigned int nframes;	/*!< number of frames on the frame stack */
+	unsigned int max_frames;	/*!< maximum number of frames, see sivm_config */
+	sivm_fault fault;		/*!< fault of the last instruction, SIVM_FAULT_NONE if there was none */
+	char fault_message[FAULT_MESSAGE_LENGTH];	/*!< description of the fault */
+	sivm_fault_policy fault_policy;	/*!< see sivm_set_fault_policy */
+	sivm_fault_handler fault_handler;	/*!< handler of the SIVM_CALLBACK policy */
+	void *fault_data;		/*!< data given to fault_handler */
+	cmd_word sink;			/*!< word accessed in place of an invalid one once its fault is trapped, so that operands can be fetched before checking for faults */
+	uint64_t retired;		/*!< number of instructions executed since initialization */
+	uint64_t fused[FUSION_COUNT];	/*!< number of executions of each superinstruction */
+	int depth;				/*!< number of CALLs not returned from yet */
+	int stop_depth;			/*!< sivm_run stops when a RET brings depth back to this value, -1 to never stop */
+	struct jit *jit;		/*!< native code cache, NULL if the SIVM is only interpreted (see jit.h) */
+	struct sivm_hooks *hooks;	/*!< hooks on execution events, NULL if there are none (see hooks.h) */
+	bool verified;			/*!< the loaded program passed sivm_verify (see verifier.h) */
+	struct sivm_channel *input;		/*!< channel RECV reads from, NULL if there is none (see channel.h) */
+	struct sivm_channel *output;	/*!< channel SEND writes to, NULL if there is none */
+};
 
 /**
  * \brief Initializes a new ProcSI virtual machine
  * \author Me
  */
-void sivm_new(SIVM *sivm);
+bool sivm_new(SIVM *sivm, const sivm_config *config);
+void sivm_free(SIVM *sivm);
+void sivm_reset(SIVM *sivm, REG sp_start);
 bool sivm_load(SIVM *sivm, int memsize, cmd_word mem[memsize]);
+bool sivm_fork(SIVM *sivm, const SIVM *model);
+void sivm_share(SIVM *sivm, SIVM *model);
 bool sivm_step(SIVM *sivm);
 
+void sivm_decode(SIVM *sivm, REG addr);
+void sivm_invalidate(SIVM *sivm, REG addr);
+void sivm_set_breakpoint(SIVM *sivm, REG addr, bool set);
+
+REG sivm_flags(SIVM *sivm);
 void sivm_status(SIVM *sivm);
 bool sivm_print_register(SIVM *sivm, unsigned int reg);
 bool sivm_print_memory(SIVM *sivm, unsigned int mem);
 
-bool checkMemoryAccess(REG *index);
-bool checkRegisterAccess(REG index);
+/**Tells whether the given adress is in the memory of the given SIVM.
+ *Power-of-two memory sizes are checked by masking ; with the whole adress space, every REG adress passes the mask.
+ */
+static inline bool sivm_in_memory(const SIVM *sivm, unsigned int addr)
+{
+	return (sivm->outside ? ! (addr & sivm->outside) : addr < sivm->memsize);
+}
+
+/**Tells whether the given adress is in the bank window of the given SIVM, right after its memory.*/
+static inline bool sivm_in_window(const SIVM *sivm, unsigned int addr)
+{
+	return addr - sivm->memsize < sivm->bank_size;
+}
+
+bool sivm_select_bank(SIVM *sivm, REG bank);
+cmd_word* sivm_data(SIVM *sivm, REG *index);
+
+void sivm_push_frame(SIVM *sivm, REG from, REG target);
+void sivm_pop_frame(SIVM *sivm);
+void sivm_print_frames(SIVM *sivm);
+
+void sivm_set_fault_policy(SIVM *sivm, sivm_fault_policy policy, sivm_fault_handler handler, void *data);
+bool sivm_raise(SIVM *sivm, sivm_fault fault, REG *value, const char *format, ...);
+
+bool checkMemoryAccess(SIVM *sivm, REG *index);
+bool checkRegisterAccess(SIVM *sivm, REG index);
 
 char* sivm_get_instruction_string(SIVM *sivm);
 
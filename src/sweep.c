@@ -0,0 +1,328 @@
+#define _DEFAULT_SOURCE	/*clock_gettime*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "sweep.h"
+#include "engine.h"
+#include "parser.h"
+#include "util.h"
+
+/**@name	Settings
+ *@see	sweep.h
+ */
+//@{
+/**Parses a value, or a range of values LOW..HIGH, of an input, each one from -32768 to 65535.
+ *@returns	false if the text is neither, or the range is empty or has more than 65536 values
+ */
+static bool parse_values(const char *text, sweep_input *input)
+{
+	char *end;
+	long low = strtol(text, &end, 0), high = low;
+	if (end == text)
+		return false;
+	if (end[0] == '.' && end[1] == '.') {
+		const char *rest = end + 2;
+		high = strtol(rest, &end, 0);
+		if (end == rest)
+			return false;
+	}
+	input->low = low;
+	input->count = high - low + 1;
+	return *end == '\0' && low >= -32768 && high <= 65535 && high >= low && input->count <= 65536;
+}
+
+/**Parses a setting of a sweep: budget=N, output=Rn, or Rn=VALUES and [ADDR]=VALUES, VALUES being a value or a range (see parse_values).
+ *Fixed inputs are set in the model SIVM, and ranges added to the sweep.
+ *@returns	false if the setting is illegal
+ */
+static bool parse_setting(sivm_sweep *sweep, const char *setting)
+{
+	const char *value = strchr(setting, '=');
+	sweep_input input = { .memory = false };
+	unsigned int reg;
+	char *end, extra;
+
+	if (! value || value[1] == '\0')
+		return false;
+	value++;
+	if (! strncmp("budget=", setting, 7)) {
+		sweep->budget = strtoull(value, &end, 0);
+		return value[0] != '-' && *end == '\0';
+	}
+	if (! strncmp("output=", setting, 7))
+		return (value[0] == 'R' || value[0] == 'r') && sscanf(value + 1, "%u%c", &reg, &extra) == 1 && reg < NREGS && (sweep->output = reg, true);
+
+	if ((setting[0] == 'R' || setting[0] == 'r') && sscanf(setting + 1, "%u%c", &reg, &extra) == 2 && extra == '=' && reg < NREGS)
+		input.index = reg;
+	else if (setting[0] == '[') {
+		long addr = strtol(setting + 1, &end, 0);
+		if (end == setting + 1 || end[0] != ']' || end[1] != '=' || addr < 0 || addr >= sweep->config.memsize)
+			return false;
+		input.memory = true;
+		input.index = addr;
+	}
+	else
+		return false;
+	if (! parse_values(value, &input))
+		return false;
+
+	if (input.count > 1) {
+		if (sweep->nranges == SWEEP_MAX_RANGES)
+			return false;
+		sweep->ranges[sweep->nranges++] = input;
+		sweep->count *= input.count;
+	}
+	else if (input.memory) {
+		sweep->model.mem[input.index].brut = (REG) input.low;
+		sivm_invalidate(&sweep->model, input.index);
+	}
+	else
+		sweep->model.reg[input.index] = (REG) input.low;
+	return true;
+}
+
+/**Makes a new sweep of the program of the given source file, with the given settings.
+ *Settings are any of budget=N, output=Rn (R0 by default), Rn=VALUES and [ADDR]=VALUES, VALUES being either a value or a range LOW..HIGH ; at most SWEEP_MAX_RANGES inputs can go over a range.
+ *Registers and words of memory not given are 0, and each instance executes at most SWEEP_BUDGET instructions unless the budget is given.
+ *@param	config	memory geometry of the SIVMs of the instances
+ *@returns	false if the program can't be assembled or doesn't fit in memory, or a setting is illegal, in which case the sweep must not be used
+ *@see	sweep_free
+ */
+bool sweep_new(sivm_sweep *sweep, char *file, char *settings[], unsigned int nsettings, const sivm_config *config)
+{
+	ParserResult program = { .high = NULL };
+
+	*sweep = (sivm_sweep) { .config = *config, .image = { .fd = -1 }, .budget = SWEEP_BUDGET, .count = 1 };
+	if (! sivm_parse_file(&program, file)) {
+		logm(LOG_ERROR, "Unable to load / assemble file `%s'", file);
+		return false;
+	}
+	if (program.memsize > config->memsize) {
+		logm(LOG_ERROR, "Program `%s' is too big (%d words, memsize being %u)", file, program.memsize, config->memsize);
+		sivm_parse_free(&program);
+		return false;
+	}
+	if (! sivm_new(&sweep->model, config)) {
+		sivm_parse_free(&program);
+		return false;
+	}
+	sivm_load(&sweep->model, program.memsize, program.mem);
+	sivm_parse_free(&program);
+
+	for (unsigned int i = 0; i < nsettings; i++)
+		if (! parse_setting(sweep, settings[i])) {
+			logm(LOG_ERROR, "Illegal setting `%s' (see --sweep)", settings[i]);
+			sweep_free(sweep);
+			return false;
+		}
+	if (IMAGE_PAYS(config->memsize) && image_new(&sweep->image, &sweep->model))
+		sweep->model.image = &sweep->image;
+	return true;
+}
+
+/**Frees the model SIVM, its image and the outcomes of the given sweep.*/
+void sweep_free(sivm_sweep *sweep)
+{
+	sivm_free(&sweep->model);
+	image_free(&sweep->image);
+	free(sweep->totals.histogram);
+	sweep->totals.histogram = NULL;
+}
+//@}
+
+
+/**@name	Instances*/
+//@{
+/**Thread of a sweep, with the outcomes of the instances it ran.*/
+typedef struct
+{
+	sivm_sweep *sweep;
+	uint64_t *next;			/*!< next instance no thread took yet, shared by all threads */
+	sweep_totals totals;
+	bool ok;				/*!< false if the thread ran out of memory */
+	pthread_t thread;
+} sweeper;
+
+/**Gives the value of the given range for an instance, the ranges before it being already taken out of the instance.
+ *@param	instance	index of the instance, divided by the number of values of the range on return
+ */
+static REG value_of(const sweep_input *input, uint64_t *instance)
+{
+	REG value = (REG) (input->low + (long) (*instance % input->count));
+	*instance /= input->count;
+	return value;
+}
+
+/**Sets the inputs of the given instance of the given sweep, in an SIVM forked from its model.*/
+static void set_inputs(const sivm_sweep *sweep, SIVM *sivm, uint64_t instance)
+{
+	for (unsigned int i = 0; i < sweep->nranges; i++) {
+		const sweep_input *input = &sweep->ranges[i];
+		REG value = value_of(input, &instance);
+		if (input->memory) {
+			sivm->mem[input->index].brut = value;
+			sivm_invalidate(sivm, input->index);
+		}
+		else
+			sivm->reg[input->index] = value;
+	}
+}
+
+/**Counts the outcome of the given instance, run in the given SIVM, in the given totals.
+ *Instances have to be counted in ascending order for each totals, for the first instance of each kind of fault to be the one kept.
+ */
+static void count(sweep_totals *totals, const SIVM *sivm, sivm_stop stop, uint64_t instance, unsigned int output)
+{
+	totals->retired += sivm->retired;
+	if (sivm->retired < totals->fewest)
+		totals->fewest = sivm->retired;
+	if (sivm->retired > totals->most)
+		totals->most = sivm->retired;
+
+	if (stop == SIVM_HALT) {
+		totals->halted++;
+		totals->histogram[sivm->reg[output]]++;
+	}
+	else if (stop == SIVM_FAULT && sivm->fault < SWEEP_FAULT_KINDS) {
+		if (! totals->faults[sivm->fault]++) {
+			totals->first[sivm->fault] = instance;
+			strcpy(totals->message[sivm->fault], sivm->fault_message);
+		}
+	}
+	else
+		totals->budget++;
+}
+
+/**Runs the instances the given sweeper takes, SWEEP_CHUNK at a time, until there is none left.*/
+static void* sweep_work(void *data)
+{
+	sweeper *self = data;
+	sivm_sweep *sweep = self->sweep;
+	SIVM sivm;
+
+	if (! (self->ok = sivm_new(&sivm, &sweep->config)))
+		return NULL;
+	for (uint64_t begin; self->ok && (begin = __atomic_fetch_add(self->next, SWEEP_CHUNK, __ATOMIC_RELAXED)) < sweep->count; )
+		for (uint64_t i = begin; i < begin + SWEEP_CHUNK && i < sweep->count; i++) {
+			if (! (self->ok = sivm_fork(&sivm, &sweep->model)))
+				break;
+			set_inputs(sweep, &sivm, i);
+			count(&self->totals, &sivm, sivm_run(&sivm, sweep->budget), i, sweep->output);
+		}
+	sivm_free(&sivm);
+	return NULL;
+}
+
+/**Adds the given totals of a thread to the given ones.*/
+static void merge(sweep_totals *totals, const sweep_totals *more)
+{
+	totals->halted += more->halted;
+	totals->budget += more->budget;
+	for (unsigned int kind = 0; kind < SWEEP_FAULT_KINDS; kind++)
+		if (more->faults[kind]) {
+			if (! totals->faults[kind] || more->first[kind] < totals->first[kind]) {
+				totals->first[kind] = more->first[kind];
+				strcpy(totals->message[kind], more->message[kind]);
+			}
+			totals->faults[kind] += more->faults[kind];
+		}
+	totals->retired += more->retired;
+	if (more->fewest < totals->fewest)
+		totals->fewest = more->fewest;
+	if (more->most > totals->most)
+		totals->most = more->most;
+	for (unsigned int value = 0; value <= UINT16_MAX; value++)
+		totals->histogram[value] += more->histogram[value];
+}
+
+/**Runs all instances of the given sweep on a pool of threads, aggregating their outcomes in its totals.
+ *Each thread forks its instances in a single SIVM of its own, and keeps totals of its own, added up once all threads are over.
+ *@param	threads	number of threads, at least 1, and at most one for each SWEEP_CHUNK instances
+ *@returns	false if there is no memory left for the threads
+ *@see	sweep_print
+ */
+bool sweep_run(sivm_sweep *sweep, unsigned int threads)
+{
+	uint64_t next = 0, chunks = (sweep->count + SWEEP_CHUNK - 1) / SWEEP_CHUNK;
+	struct timespec begin, end;
+
+	if (threads > chunks)
+		threads = chunks;
+	sweeper *sweepers = calloc(threads, sizeof(sweeper));
+	bool ok = (sweepers != NULL);
+	for (unsigned int i = 0; ok && i < threads; i++) {
+		sweepers[i] = (sweeper) { .sweep = sweep, .next = &next, .totals = { .fewest = UINT64_MAX } };
+		ok = (sweepers[i].totals.histogram = calloc(UINT16_MAX + 1, sizeof(uint64_t))) != NULL;
+	}
+	if (! ok) {
+		logm(LOG_ERROR, "Not enough memory for %u threads", threads);
+		for (unsigned int i = 0; sweepers && i < threads; i++)
+			free(sweepers[i].totals.histogram);
+		free(sweepers);
+		return false;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	unsigned int started = 1;
+	for (; started < threads; started++)
+		if (pthread_create(&sweepers[started].thread, NULL, sweep_work, &sweepers[started])) {
+			logm(LOG_WARNING, "Unable to start more than %u threads", started);
+			break;
+		}
+	sweep_work(&sweepers[0]);
+	for (unsigned int i = 1; i < started; i++)
+		pthread_join(sweepers[i].thread, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	free(sweep->totals.histogram);
+	sweep->totals = sweepers[0].totals;
+	ok = sweepers[0].ok;
+	for (unsigned int i = 1; i < threads; i++) {
+		ok = ok && (i >= started || sweepers[i].ok);
+		merge(&sweep->totals, &sweepers[i].totals);
+		free(sweepers[i].totals.histogram);
+	}
+	free(sweepers);
+	if (! ok) {
+		logm(LOG_ERROR, "Not enough memory for the SIVMs of the sweep");
+		return false;
+	}
+	logm(LOG_SUMMARY, "%llu instances, %llu instructions in %.3f s on %u threads", (unsigned long long) sweep->count,
+		 (unsigned long long) sweep->totals.retired, (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9, started);
+	return true;
+}
+
+/**Prints the outcomes of the given sweep, one line each, with fields separated by tabs:
+ *<ul>
+ *	<li>instances, then their number</li>
+ *	<li>halted and budget, then the number of instances that reached a HALT instruction or executed their budget</li>
+ *	<li>fault, then for each kind of fault raised: the number of instances that raised it, the inputs of the first one, and its message</li>
+ *	<li>instructions, then the number of instructions executed by all instances, the lowest and the highest number executed by an instance</li>
+ *	<li>the output register and one of its values, then the number of halted instances that ended with it, for each such value in ascending order</li>
+ *</ul>
+ */
+void sweep_print(const sivm_sweep *sweep)
+{
+	const sweep_totals *totals = &sweep->totals;
+
+	printf("instances\t%llu\nhalted\t%llu\nbudget\t%llu\n", (unsigned long long) sweep->count, (unsigned long long) totals->halted,
+		   (unsigned long long) totals->budget);
+	for (unsigned int kind = 0; kind < SWEEP_FAULT_KINDS; kind++)
+		if (totals->faults[kind]) {
+			uint64_t instance = totals->first[kind];
+			printf("fault\t%llu\t", (unsigned long long) totals->faults[kind]);
+			for (unsigned int i = 0; i < sweep->nranges; i++) {
+				const sweep_input *input = &sweep->ranges[i];
+				printf((input->memory ? "%s[%u]=%u" : "%sR%u=%u"), (i ? " " : ""), input->index, value_of(input, &instance));
+			}
+			printf("\t%s\n", totals->message[kind]);
+		}
+	printf("instructions\t%llu\t%llu\t%llu\n", (unsigned long long) totals->retired, (unsigned long long) (totals->fewest == UINT64_MAX ? 0 : totals->fewest),
+		   (unsigned long long) totals->most);
+	for (unsigned int value = 0; value <= UINT16_MAX; value++)
+		if (totals->histogram[value])
+			printf("R%u=%u\t%llu\n", sweep->output, value, (unsigned long long) totals->histogram[value]);
+}
+//@}
@@ -0,0 +1,69 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sivm.h"
+#include "image.h"
+
+/**@name	Parameter sweeps
+ *One program run for every value of one or two inputs (registers or words of memory) over given ranges, its other inputs being fixed.
+ *The program is loaded once in a model SIVM, from which each instance is forked with its inputs set (see sivm_fork).
+ *Instances are taken in order by a pool of threads, SWEEP_CHUNK at a time, and their outcomes are aggregated as they end: nothing is kept for each instance.
+ *@see	sweep.c#sweep_run
+ */
+//@{
+/**Number of instances a thread takes at once.*/
+#define SWEEP_CHUNK 256
+/**Maximum number of inputs going over a range.*/
+#define SWEEP_MAX_RANGES 2
+/**Budget of each instance when none is given, so that a sweep ends even if some instances never halt.*/
+#define SWEEP_BUDGET 1000000
+/**Number of kinds of faults, see sivm_fault.*/
+#define SWEEP_FAULT_KINDS (SIVM_FAULT_FRAMES + 1)
+
+/**Input of the instances of a sweep going over a range.*/
+typedef struct
+{
+	bool memory;	/*!< whether the input is a word of memory rather than a register */
+	REG index;		/*!< adress of the word, or number of the register */
+	long low;		/*!< first value */
+	long count;		/*!< number of values, from low on */
+} sweep_input;
+
+/**Aggregated outcomes of instances.*/
+typedef struct
+{
+	uint64_t halted;							/*!< number of instances that reached a HALT instruction */
+	uint64_t budget;							/*!< number of instances that executed their budget */
+	uint64_t faults[SWEEP_FAULT_KINDS];			/*!< number of instances that raised each kind of fault */
+	uint64_t first[SWEEP_FAULT_KINDS];			/*!< first instance that raised each kind of fault */
+	char message[SWEEP_FAULT_KINDS][FAULT_MESSAGE_LENGTH];	/*!< message of the fault of each first instance */
+	uint64_t retired;							/*!< number of instructions executed by all instances */
+	uint64_t fewest;							/*!< lowest number of instructions executed by an instance */
+	uint64_t most;								/*!< highest number of instructions executed by an instance */
+	uint64_t *histogram;						/*!< number of halted instances for each value of the output register */
+} sweep_totals;
+
+/**Parameter sweep.*/
+typedef struct
+{
+	sivm_config config;						/*!< memory geometry of the SIVMs of all instances */
+	SIVM model;								/*!< SIVM with the program loaded and the fixed inputs set */
+	sivm_image image;						/*!< image of the model, mapped by the instances when IMAGE_PAYS (see image.h) */
+	uint64_t budget;						/*!< maximum number of instructions executed by each instance */
+	unsigned int output;					/*!< register whose values are counted in the histogram */
+	sweep_input ranges[SWEEP_MAX_RANGES];	/*!< inputs going over a range, the first one changing the fastest */
+	unsigned int nranges;
+	uint64_t count;							/*!< number of instances */
+	sweep_totals totals;					/*!< outcomes of all instances, once sweep_run returned */
+} sivm_sweep;
+
+bool sweep_new(sivm_sweep *sweep, char *file, char *settings[], unsigned int nsettings, const sivm_config *config);
+bool sweep_run(sivm_sweep *sweep, unsigned int threads);
+void sweep_print(const sivm_sweep *sweep);
+void sweep_free(sivm_sweep *sweep);
+//@}
+
+#endif /*SWEEP_H*/
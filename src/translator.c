@@ -0,0 +1,493 @@
+#include <stdlib.h>
+
+#include "translator.h"
+#include "instructions.h"
+#include "flags.h"
+#include "util.h"
+
+/**@name	Ahead-of-time translation to C
+ *Each reachable instruction becomes a labelled block of C code, guest registers becoming locals of the generated main function.
+ *Static jumps are translated to gotos, and jumps whose target is only known at run time (RET, jumps to a register or memory value) go through a switch over all translated adresses.
+ *Translated programs can't modify their own code: stores to a word holding a translated instruction abort the program.
+ *Run-time errors that would raise a fault in the emulator abort the program with a message and the registers dump.
+ */
+//@{
+
+/**Analysis of a program to translate.*/
+typedef struct
+{
+	SIVM sivm;					/*!< VM in which the program is loaded, only used for its predecoded instructions */
+	bool *reachable;			/*!< instructions to translate, one entry per word of memory */
+	bool *code;					/*!< words holding a translated instruction, one entry per word of memory */
+	bool dynamic;				/*!< whether the program has jumps to a register or memory value */
+	bool dispatch;				/*!< whether the program needs the switch over all adresses (dynamic jumps or RET) */
+} translation;
+
+/**Adress of the instruction executed after a jump to the given target.
+ *@see	sivm.c#increment_PC
+ */
+static REG jump_target(REG target)
+{
+	return (target ? target : 1);
+}
+
+/**Tells whether a jump from the given instruction to its immediate target passes the checks of instr_jmp.*/
+static bool legal_jump(SIVM *sivm, decoded *d, REG addr)
+{
+	REG last = addr + d->length - 1;
+	return sivm_in_memory(sivm, d->srcWord) && d->srcWord != last && d->srcWord != (REG) (last - 1);
+}
+
+/**Marks the instructions reachable from the given adresses, following fall-throughs and static jumps.
+ *@param	stack	adresses to start from, with one entry per word of memory
+ *@param	top		number of adresses in stack
+ */
+static void explore(translation *t, REG stack[], int top)
+{
+	while (top > 0) {
+		REG addr = stack[--top];
+		decoded *d = &t->sivm.code[addr];
+		bool falls = true;
+		REG next[2];
+		int nnext = 0;
+
+		t->code[addr] = true;
+		if (d->codeop == HALT || d->status != DECODE_OK)
+			continue;
+		for (int i = 1; i < d->length; i++)
+			t->code[addr + i] = true;
+
+		if (d->codeop == JMP || d->codeop == CALL || flags_conditional(d->codeop)) {
+			falls = (d->codeop != JMP);
+			if (d->srcMode != IMMEDIATE)
+				t->dynamic = t->dispatch = true;
+			else if (legal_jump(&t->sivm, d, addr))
+				next[nnext++] = jump_target(d->srcWord);
+		} else if (d->codeop == RET) { //return points are reached through the CALLs
+			falls = false;
+			t->dispatch = true;
+		}
+		if (falls && sivm_in_memory(&t->sivm, addr + d->length))
+			next[nnext++] = addr + d->length;
+
+		for (int i = 0; i < nnext; i++)
+			if (! t->reachable[next[i]]) {
+				t->reachable[next[i]] = true;
+				stack[top++] = next[i];
+			}
+	}
+}
+
+/**Finds the instructions to translate.
+ *Any adress may be the target of a dynamic jump, so all of them are translated if the program has one.
+ */
+static bool analyze(translation *t)
+{
+	REG *stack = malloc(t->sivm.memsize * sizeof(REG));
+	int top = 0;
+
+	if (! stack)
+		return false;
+
+	t->reachable[PC_START] = true;
+	stack[top++] = PC_START;
+	explore(t, stack, top);
+
+	if (t->dynamic) {
+		top = 0;
+		for (unsigned int addr = 0; addr < t->sivm.memsize; addr++)
+			if (! t->reachable[addr]) {
+				t->reachable[addr] = true;
+				stack[top++] = addr;
+			}
+		explore(t, stack, top);
+	}
+	free(stack);
+	return true;
+}
+
+/**Writes the C expression of the source operand of the given instruction.*/
+static void source_expression(char *buffer, decoded *d)
+{
+	switch (d->srcMode) {
+		case REGISTER:	sprintf(buffer, "r%d", d->source); break;
+		case IMMEDIATE:	sprintf(buffer, "%u", d->srcWord); break;
+		case DIRECT:	sprintf(buffer, "mem[%u]", d->srcWord); break;
+		default:		sprintf(buffer, "mem[r%d]", d->source); break;
+	}
+}
+
+/**Writes the C code of a jump to the target held in src.*/
+static void emit_dynamic_jump(FILE *out, REG addr, REG last)
+{
+	fprintf(out, "\tif (src >= MEMSIZE) FAULT(%u, \"Invalid memory access\");\n", addr);
+	if (last > 0)
+		fprintf(out, "\tif (src == %u || src == %u) FAULT(%u, \"Infinite loop\");\n", last, last - 1, addr);
+	else
+		fprintf(out, "\tif (src == %u) FAULT(%u, \"Infinite loop\");\n", last, addr);
+	fprintf(out, "\tpc = (src ? src : 1);\n\tgoto dispatch;\n");
+}
+
+/**Writes the C code of the jump of the given JMP, JEQ or CALL instruction.*/
+static void emit_jump(FILE *out, translation *t, decoded *d, REG addr)
+{
+	REG last = addr + d->length - 1;
+
+	if (d->srcMode != IMMEDIATE)
+		emit_dynamic_jump(out, addr, last);
+	else if (legal_jump(&t->sivm, d, addr))
+		fprintf(out, "\tgoto L%u;\n", jump_target(d->srcWord));
+	else if (! sivm_in_memory(&t->sivm, d->srcWord))
+		fprintf(out, "\tFAULT(%u, \"Invalid memory access\");\n", addr);
+	else
+		fprintf(out, "\tFAULT(%u, \"Infinite loop\");\n", addr);
+}
+
+/**Returns the C expression of the condition of the given conditional jump, in terms of a "flags" variable.
+ *@see	instructions.def#CONDITIONAL_JUMPS
+ */
+static const char* condition_expression(unsigned codeop)
+{
+	switch (codeop) {
+#define CONDITION_STRING(name, condition) case name: return #condition;
+		CONDITIONAL_JUMPS(CONDITION_STRING)
+#undef CONDITION_STRING
+		default:
+			return "0";
+	}
+}
+
+/**Writes the C code keeping the source operand and kind of a flag-setting instruction, before it is executed.*/
+static void emit_set_flags(FILE *out, char *src, flags_op op)
+{
+	fprintf(out, "\tflag_src = %s;\n\tflag_op = %d;\n", src, op);
+}
+
+/**Writes the C code of a block instruction (see instructions.h#BLOCK_OPERANDS), whose bounds are checked once for the whole block.
+ *@returns	false if its operands are invalid
+ */
+static bool emit_block(FILE *out, decoded *d, REG addr)
+{
+	int from = BLOCK_SOURCE(d->srcWord), count = BLOCK_COUNT(d->srcWord);
+
+	if (! BLOCK_OPERANDS_VALID(d->srcWord)) {
+		fprintf(out, "\tFAULT(%u, \"Invalid block instruction operands\");\n", addr);
+		return false;
+	}
+	fprintf(out, "\tif ((unsigned) r%d + r%d > MEMSIZE", d->dest, count);
+	if (d->codeop != MEMSET)
+		fprintf(out, " || (unsigned) r%d + r%d > MEMSIZE", from, count);
+	fprintf(out, ") FAULT(%u, \"Invalid memory access\");\n", addr);
+
+	switch (d->codeop) {
+		case MEMCPY:	//blocks may overlap, so copy in the right direction
+			fprintf(out, "\tif (r%d <= r%d)\n\t\tfor (src = 0; src < r%d; src++) WRITE(r%d + src, mem[r%d + src], %u);\n", d->dest, from, count, d->dest, from, addr);
+			fprintf(out, "\telse\n\t\tfor (src = r%d; src-- > 0;) WRITE(r%d + src, mem[r%d + src], %u);\n", count, d->dest, from, addr);
+			break;
+		case MEMSET:
+			fprintf(out, "\tfor (src = 0; src < r%d; src++) WRITE(r%d + src, r%d, %u);\n", count, d->dest, from, addr);
+			break;
+		case MEMCMP:	//sets the flags like CMP on the first words that differ
+			fprintf(out, "\tfor (src = 0; src < r%d && mem[r%d + src] == mem[r%d + src]; src++)\n\t\t;\n", count, d->dest, from);
+			fprintf(out, "\tflag_op = %d;\n", FLAGS_SUB);
+			fprintf(out, "\tif (src < r%d) {\n\t\tflag_src = mem[r%d + src];\n\t\tsr = mem[r%d + src] - mem[r%d + src];\n", count, from, d->dest, from);
+			fprintf(out, "\t} else {\n\t\tflag_src = 0;\n\t\tsr = 0;\n\t}\n");
+			break;
+	}
+	return true;
+}
+
+/**Writes the C code of an atomic instruction (see instructions.h#ATOMIC_INSTRUCTION), which is an ordinary access in a translated program since it runs on a single thread.
+ *@returns	false if its operands are invalid
+ */
+static bool emit_atomic(FILE *out, decoded *d, REG addr)
+{
+	int first = BLOCK_SOURCE(d->srcWord), second = BLOCK_COUNT(d->srcWord);
+
+	if (! BLOCK_OPERANDS_VALID(d->srcWord)) {
+		fprintf(out, "\tFAULT(%u, \"Invalid atomic instruction operands\");\n", addr);
+		return false;
+	}
+	fprintf(out, "\tCHECK(r%d, %u);\n\tsrc = mem[r%d];\n", d->dest, addr, d->dest);
+	if (d->codeop == CAS) {	//sets the flags like CMP on the old value and the expected one
+		fprintf(out, "\tflag_src = r%d;\n\tflag_op = %d;\n\tsr = src - r%d;\n", first, FLAGS_SUB, first);
+		fprintf(out, "\tif (src == r%d) WRITE(r%d, r%d, %u);\n\tr%d = src;\n", first, d->dest, second, addr, first);
+	} else {
+		fprintf(out, "\tflag_src = r%d;\n\tflag_op = %d;\n\tsr = src + r%d;\n", first, FLAGS_ADD, first);
+		fprintf(out, "\tWRITE(r%d, sr, %u);\n\tr%d = src;\n", d->dest, addr, second);
+	}
+	return true;
+}
+
+/**Writes the labelled block of C code of the instruction at the given adress.
+ *@returns	false if execution can't go on with the next instruction
+ */
+static bool emit_instruction(FILE *out, translation *t, REG addr)
+{
+	decoded *d = &t->sivm.code[addr];
+	REG last = addr + d->length - 1;
+	char src[32];
+
+	fprintf(out, "L%u: /* %s */\n", addr, getInstruction(t->sivm.mem[addr]).name);
+
+	if (d->codeop == HALT) {
+		fprintf(out, "\tpc = %u;\n\tgoto halt;\n", addr);
+		return false;
+	}
+	if (d->status != DECODE_OK) {
+		fprintf(out, "\tFAULT(%u, \"Instruction can't be translated\");\n", addr);
+		return false;
+	}
+
+	source_expression(src, d);
+	if (d->srcMode == INDIRECT)
+		fprintf(out, "\tCHECK(r%d, %u);\n", d->source, addr);
+	if (d->destMode == INDIRECT)
+		fprintf(out, "\tCHECK(r%d, %u);\n", d->dest, addr);
+
+	switch (d->codeop) {
+		case LOAD:
+			fprintf(out, "\tr%d = %s;\n", d->dest, src);
+			break;
+		case STORE:
+			if (d->destMode == DIRECT)
+				fprintf(out, "\tWRITE(%u, %s, %u);\n", d->destWord, src, addr);
+			else
+				fprintf(out, "\tWRITE(r%d, %s, %u);\n", d->dest, src, addr);
+			break;
+		case MOV:	emit_set_flags(out, src, FLAGS_LOGIC);	fprintf(out, "\tr%d = %s;\n\tsr = r%d;\n", d->dest, src, d->dest); break;
+		case ADD:	emit_set_flags(out, src, FLAGS_ADD);	fprintf(out, "\tr%d += %s;\n\tsr = r%d;\n", d->dest, src, d->dest); break;
+		case SUB:	emit_set_flags(out, src, FLAGS_SUB);	fprintf(out, "\tr%d -= %s;\n\tsr = r%d;\n", d->dest, src, d->dest); break;
+		case AND:	emit_set_flags(out, src, FLAGS_LOGIC);	fprintf(out, "\tr%d &= %s;\n\tsr = r%d;\n", d->dest, src, d->dest); break;
+		case OR:	emit_set_flags(out, src, FLAGS_LOGIC);	fprintf(out, "\tr%d |= %s;\n\tsr = r%d;\n", d->dest, src, d->dest); break;
+		case SHL:	emit_set_flags(out, src, FLAGS_LOGIC);	fprintf(out, "\tr%d = SHL(r%d, %s);\n\tsr = r%d;\n", d->dest, d->dest, src, d->dest); break;
+		case SHR:	emit_set_flags(out, src, FLAGS_LOGIC);	fprintf(out, "\tr%d = SHR(r%d, %s);\n\tsr = r%d;\n", d->dest, d->dest, src, d->dest); break;
+		case CMP:	emit_set_flags(out, src, FLAGS_SUB);	fprintf(out, "\tsr = r%d - %s;\n", d->dest, src); break;
+		case MUL:	emit_set_flags(out, src, FLAGS_LOGIC);	fprintf(out, "\tr%d = (unsigned) r%d * %s;\n\tsr = r%d;\n", d->dest, d->dest, src, d->dest); break;
+		case DIV:
+		case MOD:
+			fprintf(out, "\tif (! %s) FAULT(%u, \"Division by zero\");\n", src, addr);
+			emit_set_flags(out, src, FLAGS_LOGIC);
+			fprintf(out, "\tr%d %s= %s;\n\tsr = r%d;\n", d->dest, (d->codeop == DIV ? "/" : "%"), src, d->dest);
+			break;
+		case MEMCPY:
+		case MEMSET:
+		case MEMCMP:
+			if (! emit_block(out, d, addr))
+				return false;
+			break;
+		case CAS:
+		case FADD:
+			if (! emit_atomic(out, d, addr))
+				return false;
+			break;
+		case FENCE:	//translated programs have a single thread
+			break;
+		case BANK:	//banks live outside of the translated memory
+		case SEND:	//so do channels
+		case RECV:
+			fprintf(out, "\tFAULT(%u, \"Instruction can't be translated\");\n", addr);
+			return false;
+		case JMP:
+			fprintf(out, "\tsrc = %s;\n", src);
+			emit_jump(out, t, d, addr);
+			return false;
+		case JEQ:
+			fprintf(out, "\tsrc = %s;\n\tif (sr == 0) {\n", src);
+			emit_jump(out, t, d, addr);
+			fprintf(out, "\t}\n");
+			break;
+		case JNE: case JLT: case JGE: case JLE: case JGT:
+		case JC: case JNC: case JO: case JNO:
+			fprintf(out, "\tsrc = %s;\n\tflags = FLAGS();\n\tif (%s) {\n", src, condition_expression(d->codeop));
+			emit_jump(out, t, d, addr);
+			fprintf(out, "\t}\n");
+			break;
+		case PUSH:
+			fprintf(out, "\tPUSH(%s, %u);\n", src, addr);
+			break;
+		case POP:
+			fprintf(out, "\tPOP(r%d, %u);\n", d->dest, addr);
+			break;
+		case CALL:
+			fprintf(out, "\tsrc = %s;\n\tPUSH(%u, %u);\n", src, last, addr);
+			for (int i = 0; i < NREGS; i++)
+				if (i < PARAM_REGS_START || i > PARAM_REGS_END) //see instr_call
+					fprintf(out, "\tPUSH(r%d, %u);\n", i, addr);
+			emit_jump(out, t, d, addr);
+			return false;
+		case RET:
+			for (int i = NREGS - 1; i >= 0; i--)
+				if (i < PARAM_REGS_START || i > PARAM_REGS_END) //see instr_ret
+					fprintf(out, "\tPOP(r%d, %u);\n", i, addr);
+			fprintf(out, "\tPOP(src, %u);\n", addr);
+			fprintf(out, "\tif (src != 0xFFFF && src >= MEMSIZE) FAULT(%u, \"Invalid memory access\");\n", addr);
+			fprintf(out, "\tpc = (src == 0xFFFF ? 0 : src) + 1;\n\tgoto dispatch;\n");
+			return false;
+	}
+	return true;
+}
+
+/**Writes the printf format of a line of sivm_status' dump.*/
+static void emit_register_format(FILE *out, char *name)
+{
+	if (ANSI_OUTPUT)
+		fprintf(out, "\"\\033[36m%s\\033[0m = %%d\\n\"", name);
+	else
+		fprintf(out, "\"%s = %%d\\n\"", name);
+}
+
+/**Writes the part of the C program that doesn't depend on the translated instructions, up to the start of main.*/
+static void emit_header(FILE *out, translation *t)
+{
+	fprintf(out, "/* PROCSI program translated to C by procsi --translate. */\n\n");
+	fprintf(out, "#include <stdio.h>\n#include <stdint.h>\n\n");
+	fprintf(out, "typedef uint16_t REG;\n\n");
+	fprintf(out, "#define MEMSIZE %u\n#define SP_INCR (%d)\n\n", t->sivm.memsize, t->sivm.sp_incr);
+
+	/*words after the last non-zero one are left to the zero-initialization of static arrays*/
+	unsigned int used = t->sivm.memsize;
+	while (used > 0 && ! t->sivm.mem[used - 1].brut)
+		used--;
+	fprintf(out, "static REG mem[MEMSIZE] = {");
+	for (unsigned int i = 0; i < used; i++)
+		fprintf(out, "%s%u", (i % 16 ? ", " : (i ? ",\n\t" : "\n\t")), t->sivm.mem[i].brut);
+	fprintf(out, "\n};\n\n");
+
+	fprintf(out, "/* words holding translated instructions */\nstatic const char code[MEMSIZE] = {");
+	for (unsigned int i = 0, first = 1; i < t->sivm.memsize; i++)
+		if (t->code[i]) {
+			fprintf(out, "%s[%d] = 1", (first ? "\n\t" : (i % 8 ? ", " : ",\n\t")), i);
+			first = 0;
+		}
+	fprintf(out, "\n};\n\n");
+
+	fprintf(out, "#define FLAG_Z %d\n#define FLAG_N %d\n#define FLAG_C %d\n#define FLAG_V %d\n\n", FLAG_Z, FLAG_N, FLAG_C, FLAG_V);
+	fprintf(out, "/* see flags.h in the emulator */\n");
+	fprintf(out, "static REG compute_flags(REG result, REG operand, int op)\n{\n");
+	fprintf(out, "\tREG flags = (result ? 0 : FLAG_Z) | (result & 0x8000 ? FLAG_N : 0);\n\tREG before;\n\n");
+	fprintf(out, "\tif (op == %d) {\n", FLAGS_ADD);
+	fprintf(out, "\t\tbefore = result - operand;\n");
+	fprintf(out, "\t\tif (result < before) flags |= FLAG_C;\n");
+	fprintf(out, "\t\tif ((before ^ result) & (operand ^ result) & 0x8000) flags |= FLAG_V;\n");
+	fprintf(out, "\t} else if (op == %d) {\n", FLAGS_SUB);
+	fprintf(out, "\t\tbefore = result + operand;\n");
+	fprintf(out, "\t\tif (before < operand) flags |= FLAG_C;\n");
+	fprintf(out, "\t\tif ((before ^ operand) & (before ^ result) & 0x8000) flags |= FLAG_V;\n");
+	fprintf(out, "\t}\n\treturn flags;\n}\n\n");
+
+	fprintf(out, "static void status(REG pc, REG sr, REG sp, const REG r[])\n{\n");
+	fprintf(out, "\tprintf(");
+	emit_register_format(out, "PC");
+	fprintf(out, ", pc);\n\tprintf(");
+	emit_register_format(out, "SR");
+	fprintf(out, ", sr);\n\tprintf(");
+	emit_register_format(out, "SP");
+	fprintf(out, ", sp);\n\tfor (int i = 0; i < %d; i++)\n\t\tprintf(", NREGS);
+	if (ANSI_OUTPUT)
+		fprintf(out, "\"\\033[36mR%%d\\033[0m = %%d\\n\"");
+	else
+		fprintf(out, "\"R%%d = %%d\\n\"");
+	fprintf(out, ", i, r[i]);\n}\n\n");
+
+	fprintf(out, "#define FAULT(at, message)\tdo { pc = (at); error = (message); goto fault; } while (0)\n");
+	fprintf(out, "#define CHECK(index, at)\tdo { if ((index) >= MEMSIZE) FAULT(at, \"Invalid memory access\"); } while (0)\n");
+	fprintf(out, "#define WRITE(index, value, at)\tdo { if (code[index]) FAULT(at, \"Self-modifying code can't be translated\"); mem[index] = (value); } while (0)\n");
+	fprintf(out, "#define PUSH(value, at)\tdo { if (sp >= MEMSIZE || (REG) (sp + SP_INCR) >= MEMSIZE) FAULT(at, \"Invalid memory access\"); WRITE(sp, value, at); sp += SP_INCR; } while (0)\n");
+	fprintf(out, "#define POP(dest, at)\tdo { if ((REG) (sp - SP_INCR) >= MEMSIZE) FAULT(at, \"Invalid memory access\"); sp -= SP_INCR; dest = mem[sp]; } while (0)\n");
+	fprintf(out, "/* shift counts are taken modulo 32, like the emulator does on x86 hosts */\n");
+	fprintf(out, "#define SHL(x, n)\t((REG) ((unsigned) (x) << ((n) & 31)))\n");
+	fprintf(out, "#define SHR(x, n)\t((REG) ((unsigned) (x) >> ((n) & 31)))\n");
+	fprintf(out, "#define FLAGS()\tcompute_flags(sr, flag_src, flag_op)\n\n");
+}
+
+/**Frees a translation, and the VM the program was loaded in.*/
+static void translation_free(translation *t)
+{
+	sivm_free(&t->sivm);
+	free(t->reachable);
+	free(t->code);
+	free(t);
+}
+
+bool translate_program(char *filename, cmd_word mem[], int memsize, const sivm_config *config)
+{
+	translation *t = calloc(1, sizeof(translation));
+	if (! t) {
+		logm(LOG_ERROR, "Not enough memory to translate the program");
+		return false;
+	}
+	if (! sivm_new(&t->sivm, config)) {
+		free(t);
+		return false;
+	}
+	logm(LOG_STEP, "VM successfully initialized.");
+	t->reachable = calloc(t->sivm.memsize, sizeof(bool));
+	t->code = calloc(t->sivm.memsize, sizeof(bool));
+	if (! t->reachable || ! t->code) {
+		logm(LOG_ERROR, "Not enough memory to translate the program");
+		translation_free(t);
+		return false;
+	}
+	if (! sivm_load(&t->sivm, memsize, mem)) {
+		logm(LOG_ERROR, "Program is too big (%d words, memsize being %u)", memsize, t->sivm.memsize);
+		translation_free(t);
+		return false;
+	}
+	if (! analyze(t)) {
+		logm(LOG_ERROR, "Not enough memory to translate the program");
+		translation_free(t);
+		return false;
+	}
+
+	FILE *out = fopen(filename, "w");
+	if (! out) {
+		logm(LOG_ERROR, "Unable to open file %s for writing", filename);
+		translation_free(t);
+		return false;
+	}
+
+	emit_header(out, t);
+	fprintf(out, "int main(void)\n{\n");
+	fprintf(out, "\tREG pc = %d, sp = %d, sr = %d, src = 0, flag_src = 0, flags = 0;\n\tint flag_op = %d;\n", PC_START, t->sivm.sp, SR_START, FLAGS_LOGIC);
+	fprintf(out, "\tREG");
+	for (int i = 0; i < NREGS; i++)
+		fprintf(out, "%s r%d = 0", (i ? "," : ""), i);
+	fprintf(out, ";\n\tconst char *error = \"\";\n\t(void) src, (void) mem, (void) code, (void) flags;\n\n");
+
+	fprintf(out, "\tgoto L%d;\n\n", PC_START);
+	if (t->dispatch) {
+		fprintf(out, "dispatch:\n\tswitch (pc) {\n");
+		for (unsigned int addr = 0; addr < t->sivm.memsize; addr++)
+			if (t->reachable[addr])
+				fprintf(out, "\t\tcase %d: goto L%d;\n", addr, addr);
+		fprintf(out, "\t\tdefault: FAULT(pc, \"Jump to an adress that wasn't translated\");\n\t}\n\n");
+	}
+
+	for (unsigned int addr = 0; addr < t->sivm.memsize; addr++) {
+		if (! t->reachable[addr])
+			continue;
+		if (! emit_instruction(out, t, addr))
+			continue;
+		unsigned int next = addr + t->sivm.code[addr].length;
+		if (! sivm_in_memory(&t->sivm, next))
+			fprintf(out, "\tFAULT(%u, \"PC too high\");\n", next);
+		else
+			fprintf(out, "\tgoto L%u;\n", next);
+	}
+
+	/*halt and fault may be unused, depending on the program*/
+	fprintf(out, "\nhalt: __attribute__((unused));\n\tstatus(pc, FLAGS(), sp, (REG[]) {");
+	for (int i = 0; i < NREGS; i++)
+		fprintf(out, "%sr%d", (i ? ", " : " "), i);
+	fprintf(out, " });\n\treturn 0;\n\n");
+	fprintf(out, "fault: __attribute__((unused));\n\tfprintf(stderr, \"%%s (PC = %%d)\\n\", error, pc);\n\tstatus(pc, FLAGS(), sp, (REG[]) {");
+	for (int i = 0; i < NREGS; i++)
+		fprintf(out, "%sr%d", (i ? ", " : " "), i);
+	fprintf(out, " });\n\treturn 1;\n}\n");
+
+	fclose(out);
+	translation_free(t);
+	return true;
+}
+//@}
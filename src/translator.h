@@ -0,0 +1,18 @@
+#ifndef TRANSLATOR_H
+#define TRANSLATOR_H
+
+#include <stdbool.h>
+
+#include "sivm.h"
+
+/**Translates a program to a standalone C program.
+ *The generated program runs the given one natively, and prints the same registers dump as sivm_status when reaching HALT.
+ *@param	filename	the C file to write
+ *@param	mem			the program to translate
+ *@param	memsize		size of the program, in words
+ *@param	config		memory geometry of the VM the program is meant to run in
+ *@returns	false if the program couldn't be loaded or the C file couldn't be written
+ */
+bool translate_program(char *filename, cmd_word mem[], int memsize, const sivm_config *config);
+
+#endif /*TRANSLATOR_H*/
@@ -19,12 +19,62 @@ bool readLine(char *str, size_t length)
     return ret == 1;
 }
 
-void logm(char level, char *format, ...)
+bool log_ansi = true;
+int log_err_level = ERR_LOG_LEVEL;
+int log_out_level = OUT_LOG_LEVEL;
+int log_ring_level = RING_LOG_LEVEL;
+
+/**Slot of the log ring.*/
+typedef struct
+{
+	unsigned long sequence;		/*!< number of the message plus one once it is written, 0 while it is being written */
+	char level;
+	char message[LOG_RING_MESSAGE_LENGTH];
+} log_slot;
+
+static log_slot log_ring[LOG_RING_SIZE];
+/**Number of messages ever recorded in the log ring, the next one going to the slot of this number modulo LOG_RING_SIZE.*/
+static unsigned long log_ring_head = 0;
+
+/**Records a message in the log ring, overwriting the oldest one.*/
+static void log_ring_record(char level, const char *format, va_list args)
+{
+	unsigned long n = __atomic_fetch_add(&log_ring_head, 1, __ATOMIC_RELAXED);
+	log_slot *slot = &log_ring[n % LOG_RING_SIZE];
+	
+	__atomic_store_n(&slot->sequence, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	slot->level = level;
+	vsnprintf(slot->message, LOG_RING_MESSAGE_LENGTH, format, args);
+	__atomic_store_n(&slot->sequence, n + 1, __ATOMIC_RELEASE);
+}
+
+void log_ring_dump(void)
+{
+	static const char *names[] = { "fatal", "error", "warning", "info", "debug" };
+	unsigned long head = __atomic_load_n(&log_ring_head, __ATOMIC_ACQUIRE);
+	char message[LOG_RING_MESSAGE_LENGTH];
+	
+	printf("Log ring (last %lu of %lu message(s)):\n", (head < LOG_RING_SIZE ? head : LOG_RING_SIZE), head);
+	for (unsigned long n = (head < LOG_RING_SIZE ? 0 : head - LOG_RING_SIZE); n < head; n++) {
+		log_slot *slot = &log_ring[n % LOG_RING_SIZE];
+		if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != n + 1)
+			continue;
+		char level = slot->level;
+		memcpy(message, slot->message, LOG_RING_MESSAGE_LENGTH);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != n + 1) //overwritten while being copied
+			continue;
+		message[LOG_RING_MESSAGE_LENGTH - 1] = '\0';
+		printf("  %-7s %s\n", (level >= 0 && level <= LOG_DEBUG ? names[(int) level] : "step"), message);
+	}
+}
+
+void log_message(char level, const char *format, ...)
 {
     va_list args;
-    va_start(args, format);
 	
-	char *color;
+	char *color = "[0m";
 	switch (level) {
 		case LOG_STEP:
 			color = "[32m";
@@ -48,34 +98,36 @@ void logm(char level, char *format, ...)
 			break;
 	}
 	
-	if (level == LOG_STEP)
-		level = OUT_LOG_LEVEL; //This way, we make sure important steps are always displayed
+	char filter = LOG_FILTER_LEVEL(level);
+	if (filter <= log_ring_level || (level == LOG_STEP && log_ring_level >= 0)) {
+		va_start(args, format);
+		log_ring_record(filter, format, args);
+		va_end(args);
+	}
 	
-	if (level <= OUT_LOG_LEVEL)
+	FILE *out;
+	if (level == LOG_SUMMARY)
+		out = (filter <= log_out_level || filter <= log_err_level ? stderr : NULL);
+	else
+		out = (level == LOG_STEP || level <= log_out_level ? stdout : (level <= log_err_level ? stderr : NULL)); //important steps are always displayed
+	if (out)
     {
 		if (ANSI_OUTPUT) {
-			fprintf(stdout, "\e");
-			fprintf(stdout, color);
+			fprintf(out, "\e");
+			fputs(color, out);
 		}
-        vfprintf(stdout, format, args);
-        if (ANSI_OUTPUT) fprintf(stdout, "\e[0m\n");
-		else fprintf(stdout, "\n");
-    }
-	else if (level <= ERR_LOG_LEVEL)
-    {
-		if (ANSI_OUTPUT) {
-			fprintf(stderr, "\e");
-			fprintf(stderr, color);
-		}
-        vfprintf(stderr, format, args);
-        if (ANSI_OUTPUT) fprintf(stdout, "\e[0m\n");
-		else fprintf(stderr, "\n");
+		va_start(args, format);
+        vfprintf(out, format, args);
+		va_end(args);
+        if (ANSI_OUTPUT) fprintf(out, "\e[0m\n");
+		else fprintf(out, "\n");
     }
 	
-	if (level <= FATAL_LEVEL)
+	if (level <= FATAL_LEVEL) {
+		if (log_ring_level >= 0)
+			log_ring_dump();
 		exit(1);
-		
-    va_end(args);
+	}
 }
 
 bool superRecover(REG *val, char *format, ...)
@@ -83,7 +135,8 @@ bool superRecover(REG *val, char *format, ...)
     va_list args;
     va_start(args, format);
 	char msg[500];
-	vsprintf(msg, format,args);
+	vsnprintf(msg, sizeof(msg), format, args);
+    va_end(args);
 	
 	logm(FATAL_LEVEL + 1, "%s", msg);
 
@@ -91,15 +144,18 @@ bool superRecover(REG *val, char *format, ...)
 	printf("\n========>> Fatal error: SUPERRECOVER ACTIVATED <<========\n\nDon't panic! SuperRecover has your back!\nPlease modify the value that caused the invalid access (%d), or type any letter to continue with the fatal error: ", *val);
 	if (ANSI_OUTPUT) printf("\e[0m");
 	int buffer;
-	if (! scanf("%d", &buffer)) {
+	bool recovered = (scanf("%d", &buffer) == 1);
+	
+	// vide le buffer d'entrée
+	int c;
+	while (((c = getchar()) != '\n') && c != EOF);
+	
+	if (! recovered) {
 		printf("Well, we tried to save you...\n");
-		logm(LOG_FATAL_ERROR, "%s", msg);
 		return false;
 	}
 	printf("%d\n", buffer);
 	*val = (REG) buffer;
-
-    va_end(args);
 	
 	return true;
-}
\ No newline at end of file
+}
@@ -10,14 +10,17 @@
 /**@name	Display and logging settings
  *Defines the level of verbosity of the program and level of output formatting.
  *0 is the less verbose mode (displays fatal errors only).
+ *Messages above LOG_MAX_LEVEL are compiled out, the others are filtered at run time by the levels below, that main sets from the command line.
  */
 //@{
 /**Activate colored output or not*/
-#define ANSI_OUTPUT true
+#define ANSI_OUTPUT log_ansi
 /**Level for messages informing user about important good steps (ie. init successful).
  *These won't be affected by LOG_LEVEL.
  */
 #define LOG_STEP 100
+/**Level for summaries of runs (jobs, instructions, time...), filtered as LOG_INFO but always displayed to stderr, so that they don't mix with results printed to stdout.*/
+#define LOG_SUMMARY 101
 
 #define LOG_FATAL_ERROR 0
 #define LOG_ERROR 1
@@ -26,10 +29,39 @@
 #define LOG_DEBUG 4
 /**Level of message from which error is considered as fatal (exits)*/
 #define FATAL_LEVEL 0
-/**Maximum level of messages to be displayed to stderr*/
+/**Maximum level of messages compiled in: calls to logm with a higher level compile to nothing.
+ *Define it to a lower level (ie. -DLOG_MAX_LEVEL=LOG_INFO) to remove the debugging messages from the build.
+ */
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL LOG_DEBUG
+#endif
+/**Default maximum level of messages to be displayed to stderr*/
 #define ERR_LOG_LEVEL LOG_INFO
-/**Maximum level of messages to be displayed to stdout*/
+/**Default maximum level of messages to be displayed to stdout*/
 #define OUT_LOG_LEVEL LOG_INFO
+/**Default maximum level of messages to be recorded in the log ring, -1 for none*/
+#define RING_LOG_LEVEL -1
+
+extern bool log_ansi;		/*!< colored output, see ANSI_OUTPUT */
+extern int log_err_level;	/*!< maximum level of messages to be displayed to stderr, see ERR_LOG_LEVEL */
+extern int log_out_level;	/*!< maximum level of messages to be displayed to stdout, see OUT_LOG_LEVEL */
+extern int log_ring_level;	/*!< maximum level of messages to be recorded in the log ring, see RING_LOG_LEVEL */
+//@}
+
+/**@name	Log ring
+ *In-memory sink keeping the last LOG_RING_SIZE messages, to be dumped when something goes wrong.
+ *Messages only claim their slot with an atomic increment, so that they can be logged from any thread without locking.
+ */
+//@{
+/**Number of messages kept in the log ring, a power of two.*/
+#define LOG_RING_SIZE 256
+/**Maximum length of a message of the log ring, terminating null included.*/
+#define LOG_RING_MESSAGE_LENGTH 128
+
+/**Prints the messages of the log ring, from the oldest one.
+ *Messages being overwritten while they are read are skipped.
+ */
+void log_ring_dump(void);
 //@}
 
 /**Read a line from the standard input
@@ -39,18 +71,37 @@
  */
 bool readLine(char *str, size_t length);
 
+/**Level against which messages of the given level are filtered.*/
+#define LOG_FILTER_LEVEL(level)	((level) == LOG_SUMMARY ? LOG_INFO : (level))
+
+/**Tells whether messages of the given level are displayed or recorded.
+ *Constant levels above LOG_MAX_LEVEL make it a constant false.
+ */
+#define LOG_ENABLED(level)	((level) <= FATAL_LEVEL || (level) == LOG_STEP || \
+							 (LOG_FILTER_LEVEL(level) <= LOG_MAX_LEVEL && (LOG_FILTER_LEVEL(level) <= log_out_level || LOG_FILTER_LEVEL(level) <= log_err_level || LOG_FILTER_LEVEL(level) <= log_ring_level)))
+
 /**Logs debugging messages.
+ *The level is checked before any argument is evaluated, and messages above LOG_MAX_LEVEL are compiled out.
  *@param	level	the priority level of the message ; maximum priority is 0, and should be used for fatal errors only.
  *@param	format, ...		the message to log, see printf
+ *@see	log_message
+ */
+#define logm(level, ...)	do { if (LOG_ENABLED(level)) log_message((level), __VA_ARGS__); } while (0)
+
+/**Displays and records a message according to the levels, and exits on fatal errors.
+ *Called through logm, which saves the call when the level is filtered out.
+ *@see	logm
  *@see	ERR_LOG_LEVEL
  *@see	OUT_LOG_LEVEL
+ *@see	RING_LOG_LEVEL
  */
-void logm(char level, char *format, ...);
+void log_message(char level, const char *format, ...);
 
-/**Try to make a last-moment recovery from an invalid value.
+/**Try to make a last-moment recovery from an invalid value, by asking the user for another one.
+ *Blocks on the standard input: only meant for interactive use, see debugger.c#debugger_recover.
  *@param	val	pointer to the value to possibly modify
  *@param	format, ...		the message to log, see printf
- *@returns	true if the user wanted to modify the value, false if not
+ *@returns	true if the user modified the value, false if not
  */
 bool superRecover(REG *val, char *format, ...);
 #endif /*UTIL_H*/
@@ -0,0 +1,43 @@
+#include <stdlib.h>
+
+#include "variant.h"
+#include "instructions.h"
+#include "cmd_word.h"
+#include "flags.h"
+#include "util.h"
+
+/**@name	Generated variants
+ *Each variant is generated by including the variant.def template with its parameters.
+ */
+//@{
+#define VARIANT_PASTE(name, variant)	name##_##variant
+#define VARIANT_NAME(name, variant)		VARIANT_PASTE(name, variant)
+#define VARIANT_QUOTE(variant)			#variant
+#define VARIANT_STRING(variant)			VARIANT_QUOTE(variant)
+
+/*32-bit words, 16 registers*/
+#define VARIANT				32x16
+#define VARIANT_REG			uint32_t
+#define VARIANT_NREGS		16
+#define VARIANT_MAX_MEMSIZE	(1 << 24)
+#include "variant.def"
+#undef VARIANT
+#undef VARIANT_REG
+#undef VARIANT_NREGS
+#undef VARIANT_MAX_MEMSIZE
+//@}
+
+const sivm_variant variants[] = {
+	{ "16x8",	16,	NREGS,	MAX_MEMSIZE,	NULL },
+	{ "32x16",	32,	16,		1 << 24,		run_32x16 }
+};
+
+const unsigned int variants_count = sizeof(variants) / sizeof(variants[0]);
+
+const sivm_variant* variant_find(const char *name)
+{
+	for (unsigned int i = 0; i < variants_count; i++)
+		if (! strcmp(variants[i].name, name))
+			return &variants[i];
+	return NULL;
+}
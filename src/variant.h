@@ -0,0 +1,41 @@
+#ifndef VARIANT_H
+#define VARIANT_H
+
+#include <stdbool.h>
+
+#include "sivm.h"
+#include "parser.h"
+
+/**@name	VM variants
+ *Virtual machines specialised at compile time for a width of words and a number of registers, one of which is chosen at startup.
+ *The 16-bit, 8 registers variant is the SIVM itself, with its debugger, threaded engine and JIT, and doesn't pay for the others.
+ *The others are generated from the variant.def template, a switch interpreter of its own that only runs a program from its start to HALT: they have none of the SIVM's debugger, fault policies (a fault always stops the program), hooks, banks, frame stacks or channels.
+ *The semantics of the instructions are written again in the template, which isn't generated from instructions.def and has to follow the changes of the instruction set by hand.
+ *@see	variant.c#variants
+ */
+//@{
+/**Description of a VM variant.*/
+typedef struct
+{
+	char *name;					/*!< name given to --variant, as BITSxREGISTERS */
+	unsigned int bits;			/*!< width of words and registers */
+	unsigned int nregs;			/*!< number of registers */
+	unsigned int max_memsize;	/*!< maximum number of words of memory */
+	/**Runs the given program until HALT, and prints the registers dump of sivm_status, NULL for the SIVM itself.
+	 *@returns	false if the VM couldn't be set up or the program faulted
+	 */
+	bool (*run)(const ParserResult *program, const sivm_config *config);
+} sivm_variant;
+
+/**The available variants, the SIVM being the first one and the default.*/
+extern const sivm_variant variants[];
+/**Number of available variants.*/
+extern const unsigned int variants_count;
+
+/**Finds a variant by its name.
+ *@returns	NULL if there is no such variant
+ */
+const sivm_variant* variant_find(const char *name);
+//@}
+
+#endif /*VARIANT_H*/
@@ -0,0 +1,108 @@
+#include <stdlib.h>
+
+#include "verifier.h"
+#include "instructions.h"
+#include "flags.h"
+#include "util.h"
+
+/**@name	Load-time verification
+ *Everything that can be checked once for all on a program is checked before running it, so that sivm_step only keeps the checks that depend on run-time values: indirect accesses, the stack, and dynamic jump targets.
+ *Instructions that can only be reached through a dynamic jump are not verified, and are executed with all checks.
+ */
+//@{
+
+/**Logs the reason why the instruction at the given adress prevents the program from being verified.
+ *@returns	false
+ */
+static bool reject(REG addr, char *reason)
+{
+	logm(LOG_DEBUG, "Program can't be verified: %s (adress %d)", reason, addr);
+	return false;
+}
+
+/**Checks a static jump target, with the same rules as instr_jmp.
+ *@param	target	the jump target
+ *@param	last	adress of the last word of the jump instruction
+ */
+static bool legal_target(SIVM *sivm, REG target, REG last)
+{
+	return sivm_in_memory(sivm, target) && target != last && target != last - 1;
+}
+
+/**Walks all code reachable from PC_START, and marks which adresses were reached.
+ *@param	reached		one entry per word of memory
+ *@param	pending		adresses left to walk, one entry per word of memory (every adress is pushed at most once)
+ *@returns	false if any reachable instruction doesn't pass verification
+ */
+static bool walk(SIVM *sivm, bool reached[], REG pending[])
+{
+	int count = 0;
+	
+#define FOLLOW(addr) do { \
+		unsigned int next = (addr); \
+		if (! sivm_in_memory(sivm, next)) return reject(next, "execution goes out of memory"); \
+		if (! reached[next]) { \
+			reached[next] = true; \
+			pending[count++] = next; \
+		} \
+	} while (0)
+	
+	FOLLOW(PC_START);
+	while (count > 0) {
+		REG addr = pending[--count];
+		cmd_word word = sivm->mem[addr];
+		Instr instr = getInstruction(word);
+		decoded *d = &sivm->code[addr];
+		
+		if (! instr.function)
+			return reject(addr, "unknown instruction");
+		if (instr.modes ? ! checkModes(word) : word.codage.mode != REGREG)
+			return reject(addr, "illegal adressing mode");
+		if (d->status == DECODE_PENDING)
+			sivm_decode(sivm, addr);
+		if (d->status != DECODE_OK) //modes are legal, so only the inline words can be wrong
+			return reject(addr, "instruction doesn't fit in memory, or direct adress out of bounds");
+		if (PACKED_INSTRUCTION(d->codeop) && ! BLOCK_OPERANDS_VALID(d->srcWord))
+			return reject(addr, "block or atomic instruction operands are not registers");
+		
+		if (d->codeop == HALT || d->codeop == RET)
+			continue;
+		if (d->codeop == JMP || d->codeop == CALL || flags_conditional(d->codeop)) {
+			if (d->srcMode == IMMEDIATE) {
+				if (! legal_target(sivm, d->srcWord, addr + d->length - 1))
+					return reject(addr, "illegal jump target");
+				FOLLOW(d->srcWord ? d->srcWord : 1); //see increment_PC
+			}
+			if (d->codeop == JMP)
+				continue;
+		}
+		FOLLOW(addr + d->length);
+	}
+#undef FOLLOW
+	return true;
+}
+
+bool sivm_verify(SIVM *sivm)
+{
+	bool *reached = calloc(sivm->memsize, sizeof(bool));
+	REG *pending = malloc(sivm->memsize * sizeof(REG));
+	
+	sivm->verified = false;
+	for (unsigned int i = 0; i < sivm->memsize; i++)
+		sivm->code[i].verified = false;
+	
+	if (! reached || ! pending)
+		logm(LOG_ERROR, "Not enough memory to verify the program");
+	else if (walk(sivm, reached, pending)) {
+		//the adress RET goes back to is read from the stack, so it keeps the checks of sivm_exec
+		for (unsigned int i = 0; i < sivm->memsize; i++)
+			sivm->code[i].verified = reached[i] && sivm->code[i].codeop != RET;
+		sivm->verified = true;
+		logm(LOG_DEBUG, "Program verified.");
+	}
+	
+	free(reached);
+	free(pending);
+	return sivm->verified;
+}
+//@}
@@ -0,0 +1,24 @@
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+#include <stdbool.h>
+
+#include "sivm.h"
+
+/**Verifies the program loaded in the given SIVM, and marks it as verified if it passes.
+ *All code reachable from PC_START is walked, following static jump targets, and every instruction on the way has to:
+ *<ul>
+ *	<li>be a known instruction with legal adressing modes (see checkModes)</li>
+ *	<li>fit in memory, with all its inline words</li>
+ *	<li>only use direct adresses within memory</li>
+ *	<li>only jump, if its target is immediate, to a legal adress that is no infinite loop (see instr_jmp)</li>
+ *</ul>
+ *Execution may not fall out of memory either.
+ *Instructions of a verified program are executed by sivm_step without the checks that have already been done here.
+ *@param	sivm	the VM whose program to verify, with its predecoded instructions cache built
+ *@returns	true if the program was verified
+ *@see	sivm.h#decoded
+ */
+bool sivm_verify(SIVM *sivm);
+
+#endif /*VERIFIER_H*/